@@ -0,0 +1,329 @@
+#include "BVH.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+//world-space bounds of an object-space box:
+// (transforms the center, and grows the extents by the absolute value of the matrix)
+static void transform_box(glm::mat4x3 const &world_from_object, glm::vec3 const &min, glm::vec3 const &max, glm::vec3 *world_min, glm::vec3 *world_max) {
+	glm::vec3 center = 0.5f * (min + max);
+	glm::vec3 extent = 0.5f * (max - min);
+	glm::vec3 world_center = world_from_object * glm::vec4(center, 1.0f);
+	glm::vec3 world_extent =
+		  glm::abs(world_from_object[0]) * extent.x
+		+ glm::abs(world_from_object[1]) * extent.y
+		+ glm::abs(world_from_object[2]) * extent.z;
+	*world_min = world_center - world_extent;
+	*world_max = world_center + world_extent;
+}
+
+static float surface_area(glm::vec3 const &min, glm::vec3 const &max) {
+	glm::vec3 size = glm::max(max - min, glm::vec3(0.0f));
+	return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+//current world_from_local for a drawable's transform:
+// (world matrices from the most recent Scene::update_world_matrices(), if it ran; otherwise computed now)
+static glm::mat4x3 const &get_world_from_object(Scene const &scene, Scene::Drawable const &drawable) {
+	Scene::Transform const &transform = *drawable.transform;
+	if (transform.world_cache.sweep != scene.world_sweep) transform.update_world_cache();
+	return transform.world_cache.world_from_local;
+}
+
+//-------------------------
+
+void BVH::build(Scene const &scene) {
+	items.clear();
+	unbounded.clear();
+	nodes.clear();
+
+	drawable_count = scene.drawables.size();
+	first_drawable = (scene.drawables.empty() ? nullptr : &scene.drawables.front());
+
+	//gather world-space bounds of all drawables:
+	for (auto const &drawable : scene.drawables) {
+		if (!drawable.has_bounds()) {
+			unbounded.emplace_back(&drawable);
+			continue;
+		}
+		Item &item = items.emplace_back();
+		item.drawable = &drawable;
+		transform_box(get_world_from_object(scene, drawable), drawable.min, drawable.max, &item.min, &item.max);
+		item.generation = drawable.transform->world_cache.generation;
+	}
+
+	if (items.empty()) {
+		built_area = refit_area = 0.0f;
+		return;
+	}
+
+	//build nodes top-down, splitting at the median centroid along the longest axis:
+	// (each node's children are allocated together, so 'right' is always 'left + 1')
+	nodes.reserve(2 * (items.size() / LeafSize + 1));
+	nodes.emplace_back();
+	nodes[0].first_item = 0;
+	nodes[0].item_count = uint32_t(items.size());
+
+	built_area = 0.0f;
+	for (uint32_t n = 0; n < nodes.size(); ++n) {
+		uint32_t first = nodes[n].first_item;
+		uint32_t count = nodes[n].item_count;
+
+		glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+		glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+		glm::vec3 centroid_min = min;
+		glm::vec3 centroid_max = max;
+		for (uint32_t i = first; i < first + count; ++i) {
+			min = glm::min(min, items[i].min);
+			max = glm::max(max, items[i].max);
+			glm::vec3 centroid = 0.5f * (items[i].min + items[i].max);
+			centroid_min = glm::min(centroid_min, centroid);
+			centroid_max = glm::max(centroid_max, centroid);
+		}
+		nodes[n].min = min;
+		nodes[n].max = max;
+		built_area += surface_area(min, max);
+
+		if (count <= LeafSize) continue;
+
+		glm::vec3 spread = centroid_max - centroid_min;
+		uint32_t axis = 0;
+		if (spread.y > spread[axis]) axis = 1;
+		if (spread.z > spread[axis]) axis = 2;
+		if (spread[axis] <= 0.0f) continue; //all centroids coincide; no point in splitting
+
+		uint32_t half = count / 2;
+		std::nth_element(items.begin() + first, items.begin() + first + half, items.begin() + first + count,
+			[axis](Item const &a, Item const &b) {
+				return (a.min[axis] + a.max[axis]) < (b.min[axis] + b.max[axis]);
+			}
+		);
+
+		uint32_t left = uint32_t(nodes.size());
+		nodes[n].left = left;
+		nodes.emplace_back();
+		nodes.emplace_back();
+		nodes[left].first_item = first;
+		nodes[left].item_count = half;
+		nodes[left + 1].first_item = first + half;
+		nodes[left + 1].item_count = count - half;
+	}
+	refit_area = built_area;
+}
+
+void BVH::update(Scene const &scene) {
+	//drawables added (or the whole list replaced)? rebuild:
+	if (scene.drawables.size() != drawable_count
+	 || (scene.drawables.empty() ? nullptr : &scene.drawables.front()) != first_drawable) {
+		build(scene);
+		return;
+	}
+
+	//recompute bounds of items whose transforms have changed:
+	bool changed = false;
+	for (auto &item : items) {
+		glm::mat4x3 const &world_from_object = get_world_from_object(scene, *item.drawable);
+		uint64_t generation = item.drawable->transform->world_cache.generation;
+		if (generation == item.generation) continue;
+		transform_box(world_from_object, item.drawable->min, item.drawable->max, &item.min, &item.max);
+		item.generation = generation;
+		changed = true;
+	}
+	if (!changed) return;
+
+	//refit nodes, children before parents:
+	refit_area = 0.0f;
+	for (uint32_t n = uint32_t(nodes.size()) - 1; n < nodes.size(); --n) {
+		Node &node = nodes[n];
+		if (node.left == 0) {
+			node.min = glm::vec3( std::numeric_limits< float >::infinity());
+			node.max = glm::vec3(-std::numeric_limits< float >::infinity());
+			for (uint32_t i = node.first_item; i < node.first_item + node.item_count; ++i) {
+				node.min = glm::min(node.min, items[i].min);
+				node.max = glm::max(node.max, items[i].max);
+			}
+		} else {
+			node.min = glm::min(nodes[node.left].min, nodes[node.left + 1].min);
+			node.max = glm::max(nodes[node.left].max, nodes[node.left + 1].max);
+		}
+		refit_area += surface_area(node.min, node.max);
+	}
+
+	//moved far enough that nodes overlap a lot? rebuild:
+	if (refit_area > rebuild_ratio * built_area) {
+		build(scene);
+	}
+}
+
+//-------------------------
+
+//classify a box relative to the view volume (-w <= x,y,z <= w) of clip_from_world:
+enum Containment { Outside, Intersecting, Inside };
+static Containment classify(glm::mat4 const &clip_from_world, glm::vec3 const &min, glm::vec3 const &max) {
+	//(same approach as Scene::outside_frustum, but also checks for 'entirely inside')
+	glm::vec4 corner = clip_from_world * glm::vec4(min, 1.0f);
+	glm::vec4 dx = clip_from_world[0] * (max.x - min.x);
+	glm::vec4 dy = clip_from_world[1] * (max.y - min.y);
+	glm::vec4 dz = clip_from_world[2] * (max.z - min.z);
+
+	uint32_t all_outside = 0x3f;
+	uint32_t any_outside = 0;
+	for (uint32_t i = 0; i < 8; ++i) {
+		glm::vec4 c = corner;
+		if (i & 1) c += dx;
+		if (i & 2) c += dy;
+		if (i & 4) c += dz;
+		uint32_t outside = 0;
+		if (c.x < -c.w) outside |= 0x01;
+		if (c.x >  c.w) outside |= 0x02;
+		if (c.y < -c.w) outside |= 0x04;
+		if (c.y >  c.w) outside |= 0x08;
+		if (c.z < -c.w) outside |= 0x10;
+		if (c.z >  c.w) outside |= 0x20;
+		all_outside &= outside;
+		any_outside |= outside;
+	}
+	if (all_outside) return Outside;
+	if (any_outside) return Intersecting;
+	return Inside;
+}
+
+void BVH::cull(glm::mat4 const &clip_from_world, std::vector< Scene::Drawable const * > *visible_, Scene::DrawStats *stats) const {
+	assert(visible_);
+	auto &visible = *visible_;
+
+	visible.insert(visible.end(), unbounded.begin(), unbounded.end());
+
+	uint32_t tested = 0;
+	uint32_t accepted = 0;
+
+	if (!nodes.empty()) {
+		//(tree depth is at most ~log2(items) thanks to median splits, so a small fixed stack is plenty)
+		uint32_t stack[64];
+		uint32_t stack_size = 0;
+		stack[stack_size++] = 0;
+		while (stack_size > 0) {
+			Node const &node = nodes[stack[--stack_size]];
+
+			tested += 1;
+			Containment c = classify(clip_from_world, node.min, node.max);
+			if (c == Outside) continue;
+
+			if (c == Inside) {
+				//whole subtree is visible:
+				for (uint32_t i = node.first_item; i < node.first_item + node.item_count; ++i) {
+					visible.emplace_back(items[i].drawable);
+				}
+				accepted += node.item_count;
+			} else if (node.left == 0) {
+				//leaf that crosses the frustum boundary: test items individually:
+				for (uint32_t i = node.first_item; i < node.first_item + node.item_count; ++i) {
+					tested += 1;
+					if (classify(clip_from_world, items[i].min, items[i].max) == Outside) continue;
+					visible.emplace_back(items[i].drawable);
+					accepted += 1;
+				}
+			} else {
+				assert(stack_size + 2 <= 64);
+				stack[stack_size++] = node.left + 1;
+				stack[stack_size++] = node.left;
+			}
+		}
+	}
+
+	if (stats) {
+		stats->tested = tested;
+		stats->culled = uint32_t(items.size()) - accepted;
+	}
+}
+
+//-------------------------
+
+//range of t for which origin + t * direction is inside [min,max] (returns false if it misses or leaves [t_min, t_max]):
+static bool ray_box(glm::vec3 const &origin, glm::vec3 const &inv_direction, glm::vec3 const &min, glm::vec3 const &max, float t_min, float t_max, float *t_enter) {
+	glm::vec3 t0 = (min - origin) * inv_direction;
+	glm::vec3 t1 = (max - origin) * inv_direction;
+	glm::vec3 near = glm::min(t0, t1);
+	glm::vec3 far = glm::max(t0, t1);
+	float enter = std::max(t_min, std::max(near.x, std::max(near.y, near.z)));
+	float exit = std::min(t_max, std::min(far.x, std::min(far.y, far.z)));
+	if (enter > exit) return false;
+	*t_enter = enter;
+	return true;
+}
+
+//shared traversal for raycast() and occluded():
+// finds the closest hit (or, if 'any' is set, stops at the first hit found):
+static bool traverse(BVH const &bvh, glm::vec3 const &origin, glm::vec3 const &direction, float max_t, bool any, BVH::Hit *hit) {
+	if (bvh.nodes.empty()) return false;
+
+	glm::vec3 inv_direction = 1.0f / direction;
+
+	float best = max_t;
+	Scene::Drawable const *best_drawable = nullptr;
+
+	uint32_t stack[64];
+	uint32_t stack_size = 0;
+	float t;
+	if (!ray_box(origin, inv_direction, bvh.nodes[0].min, bvh.nodes[0].max, 0.0f, best, &t)) return false;
+	stack[stack_size++] = 0;
+
+	while (stack_size > 0) {
+		BVH::Node const &node = bvh.nodes[stack[--stack_size]];
+		//(re-check, since 'best' may have improved since this node was pushed)
+		if (!ray_box(origin, inv_direction, node.min, node.max, 0.0f, best, &t)) continue;
+
+		if (node.left == 0) {
+			for (uint32_t i = node.first_item; i < node.first_item + node.item_count; ++i) {
+				BVH::Item const &item = bvh.items[i];
+				if (!ray_box(origin, inv_direction, item.min, item.max, 0.0f, best, &t)) continue;
+
+				//refine against the (tighter) object-space box:
+				Scene::Drawable const &drawable = *item.drawable;
+				glm::mat4x3 local_from_world = drawable.transform->make_local_from_world();
+				glm::vec3 local_origin = local_from_world * glm::vec4(origin, 1.0f);
+				glm::vec3 local_direction = local_from_world * glm::vec4(direction, 0.0f);
+				if (!ray_box(local_origin, 1.0f / local_direction, drawable.min, drawable.max, 0.0f, best, &t)) continue;
+
+				best = t;
+				best_drawable = &drawable;
+				if (any) break;
+			}
+			if (any && best_drawable) break;
+		} else {
+			//visit the nearer child first:
+			float t_left, t_right;
+			bool hit_left = ray_box(origin, inv_direction, bvh.nodes[node.left].min, bvh.nodes[node.left].max, 0.0f, best, &t_left);
+			bool hit_right = ray_box(origin, inv_direction, bvh.nodes[node.left + 1].min, bvh.nodes[node.left + 1].max, 0.0f, best, &t_right);
+			assert(stack_size + 2 <= 64);
+			if (hit_left && hit_right) {
+				if (t_left <= t_right) {
+					stack[stack_size++] = node.left + 1;
+					stack[stack_size++] = node.left;
+				} else {
+					stack[stack_size++] = node.left;
+					stack[stack_size++] = node.left + 1;
+				}
+			} else if (hit_left) {
+				stack[stack_size++] = node.left;
+			} else if (hit_right) {
+				stack[stack_size++] = node.left + 1;
+			}
+		}
+	}
+
+	if (!best_drawable) return false;
+	if (hit) {
+		hit->drawable = best_drawable;
+		hit->t = best;
+	}
+	return true;
+}
+
+bool BVH::raycast(glm::vec3 const &origin, glm::vec3 const &direction, Hit *hit, float max_t) const {
+	return traverse(*this, origin, direction, max_t, false, hit);
+}
+
+bool BVH::occluded(glm::vec3 const &a, glm::vec3 const &b) const {
+	return traverse(*this, a, b - a, 1.0f, true, nullptr);
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+/*
+ * BVH is a bounding volume hierarchy over the world-space bounding boxes of a Scene's drawables.
+ *
+ * It speeds up:
+ *  - view-frustum culling (set Scene::bvh and Scene::draw() will use it)
+ *  - ray queries (e.g., mouse picking and line-of-sight tests)
+ *
+ * Only drawables with bounds (see Scene::Drawable::min/max) are placed in the tree;
+ *  drawables without bounds are always reported as visible and never hit by rays.
+ *
+ * Keeping it up to date:
+ *  - update() refits the tree when transforms move (cheap; tree structure is kept)
+ *    and rebuilds it when drawables have been added or the refit tree has become too loose.
+ *  - build() rebuilds from scratch (call it after changing a drawable's min/max).
+ *
+ */
+
+#include "Scene.hpp"
+
+#include <glm/glm.hpp>
+
+#include <limits>
+#include <vector>
+
+struct BVH {
+	BVH() = default;
+	BVH(Scene const &scene) { build(scene); }
+
+	//rebuild the tree over all of scene's drawables:
+	void build(Scene const &scene);
+
+	//refit tree to current transforms (or rebuild, if needed):
+	// (uses world matrices from the scene's most recent update_world_matrices(), if it was run)
+	void update(Scene const &scene);
+
+	//find drawables whose bounds are (maybe) inside the view volume of clip_from_world:
+	// appends to 'visible'; also appends all drawables without bounds.
+	// if 'stats' is given, sets stats->tested (boxes tested) and stats->culled (drawables rejected).
+	void cull(glm::mat4 const &clip_from_world, std::vector< Scene::Drawable const * > *visible, Scene::DrawStats *stats = nullptr) const;
+
+	//find the closest drawable whose (object-space) bounding box is hit by the ray origin + t * direction for t in [0, max_t]:
+	struct Hit {
+		Scene::Drawable const *drawable = nullptr;
+		float t = std::numeric_limits< float >::infinity(); //distance along ray (in units of 'direction')
+	};
+	bool raycast(glm::vec3 const &origin, glm::vec3 const &direction, Hit *hit, float max_t = std::numeric_limits< float >::infinity()) const;
+
+	//does anything block the segment from a to b?
+	bool occluded(glm::vec3 const &a, glm::vec3 const &b) const;
+
+	//-- internals ---
+
+	//drawables in the tree (ordered so every node covers a contiguous range):
+	struct Item {
+		Scene::Drawable const *drawable = nullptr;
+		uint64_t generation = 0; //transform's world_cache.generation when min/max were computed
+		glm::vec3 min, max; //world-space bounds
+	};
+	std::vector< Item > items;
+	std::vector< Scene::Drawable const * > unbounded; //drawables without bounds
+
+	struct Node {
+		glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+		glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+		uint32_t left = 0; //index of left child (right child is left + 1); 0 for leaves
+		uint32_t first_item = 0; //range of items covered by this node
+		uint32_t item_count = 0;
+	};
+	std::vector< Node > nodes; //nodes[0] is the root; children always come after parents
+
+	enum : uint32_t { LeafSize = 4 }; //stop splitting at this many items
+
+	//used to detect when the drawables list changes:
+	size_t drawable_count = 0;
+	Scene::Drawable const *first_drawable = nullptr;
+
+	//used to decide when refit has made the tree too loose:
+	float built_area = 0.0f; //total surface area of nodes right after build()
+	float refit_area = 0.0f; //...and after the latest refit
+	float rebuild_ratio = 2.0f; //rebuild when refit_area > rebuild_ratio * built_area
+};
@@ -0,0 +1,149 @@
+#pragma once
+
+/*
+ * ChunkList< T > is a pointer-stable sequence container with (mostly) contiguous storage.
+ *
+ * Elements are stored in fixed-size chunks that are never moved or reallocated, so
+ * -- just like std::list -- pointers and references to elements remain valid as
+ * more elements are added. Unlike std::list, neighboring elements are adjacent in
+ * memory, so iterating is a linear sweep rather than a pointer chase.
+ *
+ * It provides the parts of the std::list interface that Scene (and code using Scene) relies on:
+ *   emplace_back, push_back, pop_back, front, back, size, empty, clear, iteration, copying
+ * ...plus operator[] for indexed access.
+ *
+ * NOTE: there is no mid-sequence erase; that would either move elements (breaking
+ *  pointer stability) or leave holes (breaking contiguity).
+ *
+ */
+
+#include <memory>
+#include <vector>
+#include <new>
+#include <utility>
+#include <iterator>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+template< typename T, uint32_t ChunkSize = 256 >
+struct ChunkList {
+	static_assert(ChunkSize > 0 && (ChunkSize & (ChunkSize - 1)) == 0, "ChunkSize should be a power of two (makes indexing cheap).");
+
+	ChunkList() = default;
+	ChunkList(ChunkList const &other) {
+		for (auto const &t : other) emplace_back(t);
+	}
+	ChunkList(ChunkList &&other) noexcept : chunks(std::move(other.chunks)), count(other.count) {
+		other.count = 0;
+	}
+	ChunkList &operator=(ChunkList const &other) {
+		if (this != &other) {
+			clear();
+			for (auto const &t : other) emplace_back(t);
+		}
+		return *this;
+	}
+	ChunkList &operator=(ChunkList &&other) noexcept {
+		if (this != &other) {
+			clear();
+			chunks = std::move(other.chunks);
+			count = other.count;
+			other.count = 0;
+		}
+		return *this;
+	}
+	~ChunkList() {
+		clear();
+	}
+
+	//---- adding / removing elements ----
+
+	template< typename... Args >
+	T &emplace_back(Args&&... args) {
+		if (count == chunks.size() * ChunkSize) {
+			chunks.emplace_back(new Chunk); //n.b. 'new Chunk' rather than make_unique so storage isn't zero-filled
+		}
+		T *slot = chunks[count / ChunkSize]->at(count % ChunkSize);
+		new (slot) T(std::forward< Args >(args)...);
+		++count;
+		return *slot;
+	}
+	void push_back(T const &t) { emplace_back(t); }
+	void push_back(T &&t) { emplace_back(std::move(t)); }
+
+	void pop_back() {
+		assert(count > 0);
+		back().~T();
+		--count;
+	}
+
+	//destroys all elements and frees all chunks:
+	void clear() {
+		while (count > 0) pop_back();
+		chunks.clear();
+	}
+
+	//---- element access ----
+
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+
+	T &operator[](size_t i) {
+		assert(i < count);
+		return *chunks[i / ChunkSize]->at(i % ChunkSize);
+	}
+	T const &operator[](size_t i) const {
+		assert(i < count);
+		return *chunks[i / ChunkSize]->at(i % ChunkSize);
+	}
+
+	T &front() { return (*this)[0]; }
+	T const &front() const { return (*this)[0]; }
+	T &back() { return (*this)[count - 1]; }
+	T const &back() const { return (*this)[count - 1]; }
+
+	//---- iteration ----
+
+	template< typename List, typename Value >
+	struct Iterator {
+		using iterator_category = std::bidirectional_iterator_tag;
+		using value_type = T;
+		using difference_type = std::ptrdiff_t;
+		using pointer = Value *;
+		using reference = Value &;
+
+		Iterator() = default;
+		Iterator(List *list_, size_t index_) : list(list_), index(index_) { }
+
+		reference operator*() const { return (*list)[index]; }
+		pointer operator->() const { return &(*list)[index]; }
+
+		Iterator &operator++() { ++index; return *this; }
+		Iterator operator++(int) { Iterator ret = *this; ++index; return ret; }
+		Iterator &operator--() { --index; return *this; }
+		Iterator operator--(int) { Iterator ret = *this; --index; return ret; }
+
+		bool operator==(Iterator const &o) const { return index == o.index && list == o.list; }
+		bool operator!=(Iterator const &o) const { return !(*this == o); }
+
+		List *list = nullptr;
+		size_t index = 0;
+	};
+	using iterator = Iterator< ChunkList, T >;
+	using const_iterator = Iterator< ChunkList const, T const >;
+
+	iterator begin() { return iterator(this, 0); }
+	iterator end() { return iterator(this, count); }
+	const_iterator begin() const { return const_iterator(this, 0); }
+	const_iterator end() const { return const_iterator(this, count); }
+
+	//-- internals ---
+
+	struct Chunk {
+		alignas(T) unsigned char storage[sizeof(T) * ChunkSize];
+		T *at(size_t i) { return std::launder(reinterpret_cast< T * >(storage) + i); }
+	};
+	std::vector< std::unique_ptr< Chunk > > chunks;
+	size_t count = 0;
+};
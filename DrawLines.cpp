@@ -12,17 +12,20 @@
 static GLuint vertex_buffer = 0;
 static GLuint vertex_buffer_for_color_program = 0;
 
-static Load< void > setup_buffers(LoadTagDefault, [](){
+//(Early, after color_program, so that LoadingMode can draw text while everything else loads)
+static Load< void > setup_buffers(LoadTagEarly, LoadAfter{ &color_program }, [](){
 	//you may recognize this init code from DrawSprites.cpp:
 
 	{ //set up vertex buffer:
 		glGenBuffers(1, &vertex_buffer);
+		load_count_gl_objects(1);
 		//for now, buffer will be un-filled.
 	}
 
 	{ //vertex array mapping buffer for color_program:
 		//ask OpenGL to fill vertex_buffer_for_color_program with the name of an unused vertex array object:
 		glGenVertexArrays(1, &vertex_buffer_for_color_program);
+		load_count_gl_objects(1);
 
 		//set vertex_buffer_for_color_program as the current vertex array object:
 		glBindVertexArray(vertex_buffer_for_color_program);
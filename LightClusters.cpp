@@ -0,0 +1,280 @@
+#include "LightClusters.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+//Simple fork-join pool: run(count, fn) calls fn(0) ... fn(count-1) spread over the workers and the calling thread.
+struct LightClusters::Workers {
+	Workers(uint32_t count) {
+		for (uint32_t i = 0; i < count; ++i) {
+			threads.emplace_back([this]() { work(); });
+		}
+	}
+	~Workers() {
+		{
+			std::unique_lock< std::mutex > lock(mutex);
+			quit = true;
+		}
+		start.notify_all();
+		for (auto &thread : threads) {
+			thread.join();
+		}
+	}
+
+	void run(uint32_t count, std::function< void(uint32_t) > const &fn) {
+		if (count <= 1) {
+			if (count == 1) fn(0);
+			return;
+		}
+		{
+			std::unique_lock< std::mutex > lock(mutex);
+			job = &fn;
+			job_count = count;
+			next = 0;
+			busy = uint32_t(threads.size());
+			++generation;
+		}
+		start.notify_all();
+
+		run_items();
+
+		std::unique_lock< std::mutex > lock(mutex);
+		done.wait(lock, [this]() { return busy == 0; });
+		job = nullptr;
+	}
+
+	std::vector< std::thread > threads;
+
+	std::mutex mutex;
+	std::condition_variable start; //signalled when a job is posted (or on quit)
+	std::condition_variable done; //signalled when the last worker finishes a job
+	std::function< void(uint32_t) > const *job = nullptr;
+	uint32_t job_count = 0;
+	std::atomic< uint32_t > next{0}; //next item of the current job to run
+	uint32_t busy = 0; //workers that haven't finished the current job
+	uint64_t generation = 0; //incremented for every job
+	bool quit = false;
+
+private:
+	void run_items() {
+		for (uint32_t i = next.fetch_add(1); i < job_count; i = next.fetch_add(1)) {
+			(*job)(i);
+		}
+	}
+
+	void work() {
+		uint64_t seen = 0;
+		std::unique_lock< std::mutex > lock(mutex);
+		while (true) {
+			start.wait(lock, [&]() { return quit || generation != seen; });
+			if (quit) return;
+			seen = generation;
+
+			lock.unlock();
+			run_items();
+			lock.lock();
+
+			busy -= 1;
+			if (busy == 0) done.notify_one();
+		}
+	}
+};
+
+LightClusters::LightClusters(uint32_t threads_) : threads(threads_) {
+	if (threads == 0) {
+		threads = std::clamp(std::thread::hardware_concurrency(), 1u, 8u);
+	}
+	if (threads > 1) {
+		workers = std::make_unique< Workers >(threads - 1);
+	}
+}
+
+LightClusters::~LightClusters() {
+}
+
+void LightClusters::assign(glm::mat4 const &clip_from_world, std::vector< Light > const &lights) {
+	auto before = std::chrono::steady_clock::now();
+
+	auto run = [this](uint32_t count, std::function< void(uint32_t) > const &fn) {
+		if (workers) {
+			workers->run(count, fn);
+		} else {
+			for (uint32_t i = 0; i < count; ++i) fn(i);
+		}
+	};
+
+	dims = glm::max(dims, glm::uvec3(1));
+	uint32_t const tiles = dims.x * dims.y;
+
+	grid.assign(tiles * dims.z, glm::uvec2(0));
+	indices.clear();
+
+	//---- set up cluster boundaries ----
+
+	//slices are evenly spaced in log(w):
+	near = std::max(near, 1e-6f);
+	far = std::max(far, 1.001f * near);
+	depth_scale = float(dims.z) / std::log(far / near);
+	depth_bias = -std::log(near) * depth_scale;
+	auto slice = [&](float w) -> uint32_t {
+		if (!(w > 0.0f)) return 0;
+		float s = std::floor(std::log(w) * depth_scale + depth_bias);
+		return uint32_t(std::clamp(s, 0.0f, float(dims.z - 1)));
+	};
+
+	//(rows of clip_from_world give clip coordinates as functions of world position)
+	glm::vec4 clip_x = glm::vec4(clip_from_world[0][0], clip_from_world[1][0], clip_from_world[2][0], clip_from_world[3][0]);
+	glm::vec4 clip_y = glm::vec4(clip_from_world[0][1], clip_from_world[1][1], clip_from_world[2][1], clip_from_world[3][1]);
+	glm::vec4 clip_w = glm::vec4(clip_from_world[0][3], clip_from_world[1][3], clip_from_world[2][3], clip_from_world[3][3]);
+	float w_length = glm::length(glm::vec3(clip_w)); //(0 for orthographic projections)
+
+	//planes where x/w (or y/w) is a tile boundary:
+	auto normalized = [](glm::vec4 const &plane) {
+		float length = glm::length(glm::vec3(plane));
+		return (length > 0.0f ? plane / length : plane);
+	};
+	column_planes.resize(dims.x + 1);
+	for (uint32_t i = 0; i <= dims.x; ++i) {
+		float ndc = 2.0f * float(i) / float(dims.x) - 1.0f;
+		column_planes[i] = normalized(clip_x - ndc * clip_w);
+	}
+	row_planes.resize(dims.y + 1);
+	for (uint32_t i = 0; i <= dims.y; ++i) {
+		float ndc = 2.0f * float(i) / float(dims.y) - 1.0f;
+		row_planes[i] = normalized(clip_y - ndc * clip_w);
+	}
+
+	//---- find the range of clusters touched by each light ----
+
+	//a sphere touches strip i (between planes i and i+1) if it is not entirely on the outside of either plane:
+	auto strips = [](std::vector< glm::vec4 > const &planes, glm::vec4 const &center, float radius, uint32_t *min, uint32_t *max) {
+		*min = 1; *max = 0;
+		float before = glm::dot(planes[0], center);
+		for (uint32_t i = 0; i + 1 < planes.size(); ++i) {
+			float after = glm::dot(planes[i + 1], center);
+			if (before >= -radius && after <= radius) {
+				if (*min > *max) *min = i;
+				*max = i;
+			}
+			before = after;
+		}
+		return *min <= *max;
+	};
+
+	enum : uint32_t { LightsPerJob = 64 };
+	ranges.resize(lights.size());
+	run(uint32_t((lights.size() + LightsPerJob - 1) / LightsPerJob), [&](uint32_t job) {
+		uint32_t end = std::min< uint32_t >(uint32_t(lights.size()), (job + 1) * LightsPerJob);
+		for (uint32_t l = job * LightsPerJob; l < end; ++l) {
+			Light const &light = lights[l];
+			Range &range = ranges[l];
+			range.min = glm::uvec3(1);
+			range.max = glm::uvec3(0);
+
+			glm::vec4 center = glm::vec4(light.position, 1.0f);
+			float radius = light.radius;
+
+			//depth slices:
+			if (w_length > 0.0f) {
+				float w = glm::dot(clip_w, center);
+				float dw = radius * w_length;
+				if (w + dw <= 0.0f) continue; //entirely behind the eye
+				range.min.z = slice(w - dw);
+				range.max.z = slice(w + dw);
+			} else {
+				//(orthographic: depth doesn't vary, so use every slice)
+				range.min.z = 0;
+				range.max.z = dims.z - 1;
+			}
+
+			//screen tiles:
+			if (!strips(column_planes, center, radius, &range.min.x, &range.max.x)
+			 || !strips(row_planes, center, radius, &range.min.y, &range.max.y)) {
+				range.min = glm::uvec3(1);
+				range.max = glm::uvec3(0);
+			}
+		}
+	});
+
+	//---- build per-slice lists (one job per slice) ----
+
+	slices.resize(dims.z);
+	run(dims.z, [&](uint32_t z) {
+		Slice &s = slices[z];
+		glm::uvec2 *cells = &grid[z * tiles];
+
+		auto for_each_cell = [&](auto const &fn) {
+			for (uint32_t l = 0; l < uint32_t(ranges.size()); ++l) {
+				Range const &range = ranges[l];
+				if (range.min.x > range.max.x || z < range.min.z || z > range.max.z) continue;
+				for (uint32_t y = range.min.y; y <= range.max.y; ++y) {
+					for (uint32_t x = range.min.x; x <= range.max.x; ++x) {
+						fn(cells[x + dims.x * y], l);
+					}
+				}
+			}
+		};
+
+		//count lights per cluster:
+		for_each_cell([](glm::uvec2 &cell, uint32_t) { cell.y += 1; });
+
+		//lay out cluster lists one after another:
+		uint32_t total = 0;
+		for (uint32_t t = 0; t < tiles; ++t) {
+			cells[t].x = total;
+			total += cells[t].y;
+			cells[t].y = 0;
+		}
+
+		//fill lists:
+		s.indices.resize(total);
+		for_each_cell([&s](glm::uvec2 &cell, uint32_t l) {
+			s.indices[cell.x + cell.y] = l;
+			cell.y += 1;
+		});
+	});
+
+	//---- gather slices into 'indices' ----
+
+	uint32_t total = 0;
+	for (auto &s : slices) {
+		s.first = total;
+		total += uint32_t(s.indices.size());
+	}
+	indices.resize(total);
+	run(dims.z, [&](uint32_t z) {
+		Slice const &s = slices[z];
+		if (!s.indices.empty()) {
+			std::memcpy(indices.data() + s.first, s.indices.data(), s.indices.size() * sizeof(uint32_t));
+		}
+		glm::uvec2 *cells = &grid[z * tiles];
+		for (uint32_t t = 0; t < tiles; ++t) {
+			cells[t].x += s.first;
+		}
+	});
+
+	//---- stats ----
+
+	stats = Stats();
+	stats.lights = uint32_t(lights.size());
+	for (auto const &range : ranges) {
+		if (range.min.x <= range.max.x) stats.visible += 1;
+	}
+	stats.clusters = uint32_t(grid.size());
+	for (auto const &cell : grid) {
+		if (cell.y == 0) continue;
+		stats.occupied += 1;
+		stats.max_lights = std::max(stats.max_lights, cell.y);
+	}
+	stats.mean_lights = (stats.occupied ? float(indices.size()) / float(stats.occupied) : 0.0f);
+
+	auto after = std::chrono::steady_clock::now();
+	stats.assign_ms = std::chrono::duration< double, std::milli >(after - before).count();
+}
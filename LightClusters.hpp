@@ -0,0 +1,95 @@
+#pragma once
+
+/*
+ * LightClusters assigns lights to a grid of "clusters" that subdivides the view volume,
+ *  so that a fragment shader only has to loop over the lights that can reach its cluster.
+ *
+ * The grid is dims.x by dims.y screen tiles, each split into dims.z depth slices.
+ *  Slices are spaced exponentially in clip-space w (== view depth, for perspective projections)
+ *  between 'near' and 'far'; the first slice extends to the eye and the last to infinity.
+ *
+ * Lights are world-space spheres. A light is added to every cluster whose column, row, and
+ *  slice it touches (a conservative test against the bounding planes of each).
+ *
+ * assign() spreads its work over a few worker threads (see the constructor).
+ *
+ * This is used by Scene::draw() (see Scene::light_clusters), but doesn't depend on Scene
+ * (so it is easy to benchmark -- see bench-clusters.cpp).
+ *
+ */
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+struct LightClusters {
+	//'threads' is the number of threads assign() uses (including the calling thread);
+	// 0 means "one per hardware thread" (up to 8).
+	LightClusters(uint32_t threads = 0);
+	~LightClusters();
+
+	//(owns threads, so not copyable)
+	LightClusters(LightClusters const &) = delete;
+	LightClusters &operator=(LightClusters const &) = delete;
+
+	//grid size and depth range (may be changed between calls to assign()):
+	glm::uvec3 dims = glm::uvec3(16, 9, 24);
+	float near = 0.1f;
+	float far = 100.0f;
+
+	struct Light {
+		glm::vec3 position; //world-space center
+		float radius; //distance beyond which the light is ignored
+	};
+
+	//assign lights to clusters of the view volume of clip_from_world:
+	void assign(glm::mat4 const &clip_from_world, std::vector< Light > const &lights);
+
+	//---- results of assign() ----
+
+	//lights in each cluster, as a range of 'indices' (.x: first, .y: count);
+	// cluster (x,y,z) is grid[x + dims.x * (y + dims.y * z)]:
+	std::vector< glm::uvec2 > grid;
+	//indices into the 'lights' passed to assign():
+	std::vector< uint32_t > indices;
+
+	//finding a point's slice:
+	// slice = floor(log(w) * depth_scale + depth_bias), clamped to [0, dims.z-1]
+	float depth_scale = 0.0f;
+	float depth_bias = 0.0f;
+
+	struct Stats {
+		uint32_t lights = 0; //lights passed to assign()
+		uint32_t visible = 0; //...of which touched at least one cluster
+		uint32_t clusters = 0; //clusters in the grid
+		uint32_t occupied = 0; //...of which contain at least one light
+		uint32_t max_lights = 0; //most lights in any cluster
+		float mean_lights = 0.0f; //average lights per occupied cluster
+		double assign_ms = 0.0; //time taken by assign()
+	} stats;
+
+	//---- internals ----
+
+	uint32_t threads = 1;
+	struct Workers; //thread pool (defined in LightClusters.cpp)
+	std::unique_ptr< Workers > workers;
+
+	//cluster range touched by each light (inclusive; min.x > max.x if none):
+	struct Range {
+		glm::uvec3 min, max;
+	};
+	std::vector< Range > ranges;
+
+	//bounding planes (normalized so plane . (p,1) is a distance):
+	std::vector< glm::vec4 > column_planes; //x/w == column boundary
+	std::vector< glm::vec4 > row_planes; //y/w == row boundary
+
+	//per-slice lists (cluster ranges relative to the slice's own indices):
+	struct Slice {
+		std::vector< uint32_t > indices;
+		uint32_t first = 0; //position of this slice's indices in 'indices'
+	};
+	std::vector< Slice > slices;
+};
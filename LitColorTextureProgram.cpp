@@ -11,21 +11,13 @@ Load< LitColorTextureProgram > lit_color_texture_program(LoadTagEarly, []() -> L
 	//----- build the pipeline template -----
 	lit_color_texture_program_pipeline.program = ret->program;
 
-	lit_color_texture_program_pipeline.CLIP_FROM_OBJECT_mat4 = ret->CLIP_FROM_OBJECT_mat4;
-	lit_color_texture_program_pipeline.LIGHT_FROM_OBJECT_mat4x3 = ret->LIGHT_FROM_OBJECT_mat4x3;
-	lit_color_texture_program_pipeline.LIGHT_FROM_NORMAL_mat3 = ret->LIGHT_FROM_NORMAL_mat3;
-
-	/* This will be used later if/when we build a light loop into the Scene:
-	lit_color_texture_program_pipeline.LIGHT_TYPE_int = ret->LIGHT_TYPE_int;
-	lit_color_texture_program_pipeline.LIGHT_LOCATION_vec3 = ret->LIGHT_LOCATION_vec3;
-	lit_color_texture_program_pipeline.LIGHT_DIRECTION_vec3 = ret->LIGHT_DIRECTION_vec3;
-	lit_color_texture_program_pipeline.LIGHT_ENERGY_vec3 = ret->LIGHT_ENERGY_vec3;
-	lit_color_texture_program_pipeline.LIGHT_CUTOFF_float = ret->LIGHT_CUTOFF_float;
-	*/
+	lit_color_texture_program_pipeline.OBJECT_block = ret->OBJECT_block;
+	lit_color_texture_program_pipeline.LIGHTS_block = ret->LIGHTS_block;
 
 	//make a 1-pixel white texture to bind by default:
 	GLuint tex;
 	glGenTextures(1, &tex);
+	load_count_gl_objects(1);
 
 	glBindTexture(GL_TEXTURE_2D, tex);
 	std::vector< glm::u8vec4 > tex_data(1, glm::u8vec4(0xff));
@@ -43,14 +35,61 @@ Load< LitColorTextureProgram > lit_color_texture_program(LoadTagEarly, []() -> L
 	return ret;
 });
 
-LitColorTextureProgram::LitColorTextureProgram() {
+Load< LitColorTextureProgram > lit_color_texture_program_instanced(LoadTagEarly, []() -> LitColorTextureProgram const * {
+	LitColorTextureProgram *ret = new LitColorTextureProgram(true);
+
+	//----- add to the pipeline template -----
+	lit_color_texture_program_pipeline.instanced.program = ret->program;
+
+	lit_color_texture_program_pipeline.instanced.WORLD_FROM_OBJECT_mat4x3 = ret->WORLD_FROM_OBJECT_mat4x3;
+	lit_color_texture_program_pipeline.instanced.WORLD_FROM_NORMAL_mat3 = ret->WORLD_FROM_NORMAL_mat3;
+
+	lit_color_texture_program_pipeline.instanced.CLIP_FROM_WORLD_mat4 = ret->CLIP_FROM_WORLD_mat4;
+	lit_color_texture_program_pipeline.instanced.LIGHT_FROM_WORLD_mat4x3 = ret->LIGHT_FROM_WORLD_mat4x3;
+	lit_color_texture_program_pipeline.instanced.LIGHT_FROM_WORLD_NORMAL_mat3 = ret->LIGHT_FROM_WORLD_NORMAL_mat3;
+
+	return ret;
+});
+
+LitColorTextureProgram::LitColorTextureProgram(bool instanced) {
+	//instanced vertex shader: same as the one below, but object-to-world matrices come in per-instance:
+	std::string instanced_vertex_shader =
+		"#version 330\n"
+		"uniform mat4 CLIP_FROM_WORLD;\n"
+		"uniform mat4x3 LIGHT_FROM_WORLD;\n"
+		"uniform mat3 LIGHT_FROM_WORLD_NORMAL;\n"
+		"in mat4x3 WORLD_FROM_OBJECT;\n"
+		"in mat3 WORLD_FROM_NORMAL;\n"
+		"in vec4 Position;\n"
+		"in vec3 Normal;\n"
+		"in vec4 Color;\n"
+		"in vec2 TexCoord;\n"
+		"out vec3 position;\n"
+		"out vec3 normal;\n"
+		"out vec4 color;\n"
+		"out vec2 texCoord;\n"
+		"void main() {\n"
+		"	vec4 world_position = vec4(WORLD_FROM_OBJECT * Position, 1.0);\n"
+		"	gl_Position = CLIP_FROM_WORLD * world_position;\n"
+		"	position = LIGHT_FROM_WORLD * world_position;\n"
+		"	normal = LIGHT_FROM_WORLD_NORMAL * (WORLD_FROM_NORMAL * Normal);\n"
+		"	color = Color;\n"
+		"	texCoord = TexCoord;\n"
+		"}\n"
+	;
+
 	//Compile vertex and fragment shaders using the convenient 'gl_compile_program' helper function:
 	program = gl_compile_program(
 		//vertex shader:
+		instanced ? instanced_vertex_shader :
 		"#version 330\n"
-		"uniform mat4 CLIP_FROM_OBJECT;\n"
-		"uniform mat4x3 LIGHT_FROM_OBJECT;\n"
-		"uniform mat3 LIGHT_FROM_NORMAL;\n"
+		"layout(std140) uniform Object {\n"
+		"	mat4 CLIP_FROM_OBJECT;\n"
+		"	mat4x3 LIGHT_FROM_OBJECT;\n"
+		"	mat3 LIGHT_FROM_NORMAL;\n"
+		"	ivec4 OBJECT_LIGHTS[2];\n"
+		"	int OBJECT_LIGHT_COUNT;\n"
+		"};\n"
 		/*
 		notes: matrix * vector is transofrming the vector
 		e.g. clip_from_world * world from obj * object vector
@@ -77,13 +116,37 @@ LitColorTextureProgram::LitColorTextureProgram() {
 		"}\n"
 	,
 		//fragment shader:
+		// (lights come from the Lights block; each object uses the lights Scene::draw() picked for it,
+		//  while instances -- which share one draw call -- use all of the lights;
+		//  when lights are clustered, every fragment uses the lights in its cluster instead)
 		"#version 330\n"
+		+ std::string(instanced ? "#define INSTANCED\n" : "")
+		+ "#define MAX_LIGHTS " + std::to_string(Scene::MaxLights) + "\n"
 		"uniform sampler2D TEX;\n"
-		"uniform int LIGHT_TYPE;\n"
-		"uniform vec3 LIGHT_LOCATION;\n"
-		"uniform vec3 LIGHT_DIRECTION;\n"
-		"uniform vec3 LIGHT_ENERGY;\n"
-		"uniform float LIGHT_CUTOFF;\n"
+		"struct Light {\n"
+		"	vec4 position;\n" //xyz: position, w: type
+		"	vec4 direction;\n" //xyz: direction, w: spot cutoff
+		"	vec4 energy;\n"
+		"};\n"
+		"layout(std140) uniform Lights {\n"
+		"	ivec4 LIGHT_COUNT;\n"
+		"	ivec4 CLUSTER_DIMS;\n"
+		"	vec4 CLUSTER_FROM_WINDOW;\n"
+		"	vec4 CLUSTER_DEPTH;\n"
+		"	Light LIGHTS[MAX_LIGHTS];\n"
+		"};\n"
+		"uniform samplerBuffer CLUSTER_LIGHTS;\n"
+		"uniform usamplerBuffer CLUSTER_GRID;\n"
+		"uniform usamplerBuffer CLUSTER_INDICES;\n"
+		"#ifndef INSTANCED\n"
+		"layout(std140) uniform Object {\n"
+		"	mat4 CLIP_FROM_OBJECT;\n"
+		"	mat4x3 LIGHT_FROM_OBJECT;\n"
+		"	mat3 LIGHT_FROM_NORMAL;\n"
+		"	ivec4 OBJECT_LIGHTS[2];\n"
+		"	int OBJECT_LIGHT_COUNT;\n"
+		"};\n"
+		"#endif\n"
 		"in vec3 position;\n"
 		"in vec3 normal;\n"
 		"in vec4 color;\n"
@@ -92,30 +155,64 @@ LitColorTextureProgram::LitColorTextureProgram() {
 		"float random(vec2 st) { //from https://thebookofshaders.com/10/\n"
 		"	return fract(sin(dot(st, vec2(12.9898, 78.233)))*43758.5453123);\n"
 		"}\n"
-		"void main() {\n"
-		"	vec3 n = normalize(normal);\n"
-		"	vec3 e;\n"
 		/* notes:
 		computes light energy from various light types
 		*/
-		"	if (LIGHT_TYPE == 0) { //point light \n"
-		"		vec3 l = (LIGHT_LOCATION - position);\n"
+		"vec3 shade(Light light, vec3 n) {\n"
+		"	int type = int(light.position.w);\n"
+		"	if (type == 0) { //point light \n"
+		"		vec3 l = (light.position.xyz - position);\n"
 		"		float dis2 = dot(l,l);\n"
 		"		l = normalize(l);\n"
 		"		float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
-		"		e = nl * LIGHT_ENERGY;\n"
-		"	} else if (LIGHT_TYPE == 1) { //hemi light \n"
-		"		e = (dot(n,-LIGHT_DIRECTION) * 0.5 + 0.5) * LIGHT_ENERGY;\n"
-		"	} else if (LIGHT_TYPE == 2) { //spot light \n"
-		"		vec3 l = (LIGHT_LOCATION - position);\n"
+		"		return nl * light.energy.rgb;\n"
+		"	} else if (type == 1) { //hemi light \n"
+		"		return (dot(n,-light.direction.xyz) * 0.5 + 0.5) * light.energy.rgb;\n"
+		"	} else if (type == 2) { //spot light \n"
+		"		vec3 l = (light.position.xyz - position);\n"
 		"		float dis2 = dot(l,l);\n"
 		"		l = normalize(l);\n"
 		"		float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
-		"		float c = dot(l,-LIGHT_DIRECTION);\n"
-		"		nl *= smoothstep(LIGHT_CUTOFF,mix(LIGHT_CUTOFF,1.0,0.1), c);\n"
-		"		e = nl * LIGHT_ENERGY;\n"
-		"	} else { //(LIGHT_TYPE == 3) //directional light \n"
-		"		e = max(0.0, dot(n,-LIGHT_DIRECTION)) * LIGHT_ENERGY;\n"
+		"		float c = dot(l,-light.direction.xyz);\n"
+		"		float cutoff = light.direction.w;\n"
+		"		nl *= smoothstep(cutoff,mix(cutoff,1.0,0.1), c);\n"
+		"		return nl * light.energy.rgb;\n"
+		"	} else { //(type == 3) //directional light \n"
+		"		return max(0.0, dot(n,-light.direction.xyz)) * light.energy.rgb;\n"
+		"	}\n"
+		"}\n"
+		"void main() {\n"
+		"	vec3 n = normalize(normal);\n"
+		"	vec3 e = vec3(0.0);\n"
+		"	if (CLUSTER_DIMS.w != 0) {\n"
+		"		//hemisphere and directional lights:\n"
+		"		for (int i = 0; i < min(LIGHT_COUNT.x, MAX_LIGHTS); ++i) {\n"
+		"			e += shade(LIGHTS[i], n);\n"
+		"		}\n"
+		"		//...and the point and spot lights in this fragment's cluster:\n"
+		"		ivec3 c = ivec3(\n"
+		"			gl_FragCoord.xy * CLUSTER_FROM_WINDOW.xy + CLUSTER_FROM_WINDOW.zw,\n"
+		"			log(1.0 / gl_FragCoord.w) * CLUSTER_DEPTH.x + CLUSTER_DEPTH.y\n"
+		"		);\n"
+		"		c = clamp(c, ivec3(0), CLUSTER_DIMS.xyz - 1);\n"
+		"		uvec2 range = texelFetch(CLUSTER_GRID, c.x + CLUSTER_DIMS.x * (c.y + CLUSTER_DIMS.y * c.z)).xy;\n"
+		"		for (uint i = 0u; i < range.y; ++i) {\n"
+		"			int l = 3 * int(texelFetch(CLUSTER_INDICES, int(range.x + i)).x);\n"
+		"			e += shade(Light(texelFetch(CLUSTER_LIGHTS, l), texelFetch(CLUSTER_LIGHTS, l+1), texelFetch(CLUSTER_LIGHTS, l+2)), n);\n"
+		"		}\n"
+		"	} else {\n"
+		"#ifdef INSTANCED\n"
+		"		int count = min(LIGHT_COUNT.x, MAX_LIGHTS);\n"
+		"#else\n"
+		"		int count = OBJECT_LIGHT_COUNT;\n"
+		"#endif\n"
+		"		for (int i = 0; i < count; ++i) {\n"
+		"#ifdef INSTANCED\n"
+		"			e += shade(LIGHTS[i], n);\n"
+		"#else\n"
+		"			e += shade(LIGHTS[OBJECT_LIGHTS[i / 4][i % 4]], n);\n"
+		"#endif\n"
+		"		}\n"
 		"	}\n"
 		"	vec4 albedo = texture(TEX, texCoord) * color;\n"
 		"	fragColor = vec4(e*albedo.rgb, albedo.a);\n"
@@ -143,25 +240,39 @@ LitColorTextureProgram::LitColorTextureProgram() {
 	Color_vec4 = glGetAttribLocation(program, "Color");
 	TexCoord_vec2 = glGetAttribLocation(program, "TexCoord");
 
+	WORLD_FROM_OBJECT_mat4x3 = glGetAttribLocation(program, "WORLD_FROM_OBJECT");
+	WORLD_FROM_NORMAL_mat3 = glGetAttribLocation(program, "WORLD_FROM_NORMAL");
+
+	//look up the per-object uniform block and attach it to the binding point Scene::draw() uses:
+	OBJECT_block = glGetUniformBlockIndex(program, "Object");
+	if (OBJECT_block != -1U) glUniformBlockBinding(program, OBJECT_block, Scene::ObjectBlockBinding);
+
+	//...and the same for the block of scene lights:
+	LIGHTS_block = glGetUniformBlockIndex(program, "Lights");
+	if (LIGHTS_block != -1U) glUniformBlockBinding(program, LIGHTS_block, Scene::LightsBlockBinding);
+
 	//look up the locations of uniforms:
-	CLIP_FROM_OBJECT_mat4 = glGetUniformLocation(program, "CLIP_FROM_OBJECT");
-	LIGHT_FROM_OBJECT_mat4x3 = glGetUniformLocation(program, "LIGHT_FROM_OBJECT");
-	LIGHT_FROM_NORMAL_mat3 = glGetUniformLocation(program, "LIGHT_FROM_NORMAL");
+	CLIP_FROM_WORLD_mat4 = glGetUniformLocation(program, "CLIP_FROM_WORLD");
+	LIGHT_FROM_WORLD_mat4x3 = glGetUniformLocation(program, "LIGHT_FROM_WORLD");
+	LIGHT_FROM_WORLD_NORMAL_mat3 = glGetUniformLocation(program, "LIGHT_FROM_WORLD_NORMAL");
 
-	LIGHT_TYPE_int = glGetUniformLocation(program, "LIGHT_TYPE");
-	LIGHT_LOCATION_vec3 = glGetUniformLocation(program, "LIGHT_LOCATION");
-	LIGHT_DIRECTION_vec3 = glGetUniformLocation(program, "LIGHT_DIRECTION");
-	LIGHT_ENERGY_vec3 = glGetUniformLocation(program, "LIGHT_ENERGY");
-	LIGHT_CUTOFF_float = glGetUniformLocation(program, "LIGHT_CUTOFF");
 
 
 	GLuint TEX_sampler2D = glGetUniformLocation(program, "TEX");
+	GLuint CLUSTER_LIGHTS_samplerBuffer = glGetUniformLocation(program, "CLUSTER_LIGHTS");
+	GLuint CLUSTER_GRID_usamplerBuffer = glGetUniformLocation(program, "CLUSTER_GRID");
+	GLuint CLUSTER_INDICES_usamplerBuffer = glGetUniformLocation(program, "CLUSTER_INDICES");
 
 	//set TEX to always refer to texture binding zero:
 	glUseProgram(program); //bind program -- glUniform* calls refer to this program now
 
 	glUniform1i(TEX_sampler2D, 0); //set TEX to sample from GL_TEXTURE0
 
+	//...and the light cluster buffers to the units Scene::draw() binds them to:
+	glUniform1i(CLUSTER_LIGHTS_samplerBuffer, Scene::ClusterLightsUnit);
+	glUniform1i(CLUSTER_GRID_usamplerBuffer, Scene::ClusterGridUnit);
+	glUniform1i(CLUSTER_INDICES_usamplerBuffer, Scene::ClusterIndicesUnit);
+
 	glUseProgram(0); //unbind program -- glUniform* calls refer to ??? now
 }
 
@@ -5,8 +5,9 @@
 #include "Scene.hpp"
 
 //Shader program that draws transformed, lit, textured vertices tinted with vertex colors:
+// (the 'instanced' variant reads object-to-world matrices from per-instance attributes instead of uniforms)
 struct LitColorTextureProgram {
-	LitColorTextureProgram();
+	LitColorTextureProgram(bool instanced = false);
 	~LitColorTextureProgram();
 
 	GLuint program = 0;
@@ -17,24 +18,31 @@ struct LitColorTextureProgram {
 	GLuint Color_vec4 = -1U;
 	GLuint TexCoord_vec2 = -1U;
 
+	//Per-instance attribute locations (instanced variant only):
+	GLuint WORLD_FROM_OBJECT_mat4x3 = -1U;
+	GLuint WORLD_FROM_NORMAL_mat3 = -1U;
+
+	//Uniform block (per-object matrices; see Scene::ObjectBlock) index:
+	GLuint OBJECT_block = -1U;
+
 	//Uniform (per-invocation variable) locations:
-	GLuint CLIP_FROM_OBJECT_mat4 = -1U;
-	GLuint LIGHT_FROM_OBJECT_mat4x3 = -1U;
-	GLuint LIGHT_FROM_NORMAL_mat3 = -1U;
-
-	//lighting:
-	GLuint LIGHT_TYPE_int = -1U;
-	GLuint LIGHT_LOCATION_vec3 = -1U;
-	GLuint LIGHT_DIRECTION_vec3 = -1U;
-	GLuint LIGHT_ENERGY_vec3 = -1U;
-	GLuint LIGHT_CUTOFF_float = -1U;
+	//(instanced variant only):
+	GLuint CLIP_FROM_WORLD_mat4 = -1U;
+	GLuint LIGHT_FROM_WORLD_mat4x3 = -1U;
+	GLuint LIGHT_FROM_WORLD_NORMAL_mat3 = -1U;
+
+	//Uniform block (scene lights; see Scene::LightsBlock) index:
+	GLuint LIGHTS_block = -1U;
 	
 	//Textures:
 	//TEXTURE0 - texture that is accessed by TexCoord
 };
 
 extern Load< LitColorTextureProgram > lit_color_texture_program;
+extern Load< LitColorTextureProgram > lit_color_texture_program_instanced;
 
 //For convenient scene-graph setup, copy this object:
 // NOTE: by default, has texture bound to 1-pixel white texture -- so it's okay to use with vertex-color-only meshes.
+// NOTE: to allow instancing, also set pipeline.instanced.vao to a vao made for lit_color_texture_program_instanced
+//  with make_vao_for_program(..., { "WORLD_FROM_OBJECT", "WORLD_FROM_NORMAL" })
 extern Scene::Drawable::Pipeline lit_color_texture_program_pipeline;
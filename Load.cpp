@@ -1,32 +1,539 @@
 #include "Load.hpp"
 
-#include <array>
-#include <list>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <numeric>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 #include <cassert>
 
 namespace {
-	std::array< std::list< std::function< void() > >, MaxLoadTag > &get_load_lists() {
-		static std::array< std::list< std::function< void() > >, MaxLoadTag > load_lists;
-		return load_lists;
+	struct LoadFunction {
+		LoadTag tag = LoadTagDefault;
+		bool has_after = false; //runs after 'after' (otherwise: after every function in an earlier tag)
+		std::vector< void const * > after;
+		LoadThread thread = LoadThreadMain;
+		std::function< void() > fn;
+		std::function< void() > upload; //(for two-phase loads: runs on the main thread after 'fn')
+		void const *key = nullptr;
+
+		//scheduling:
+		uint32_t waiting = 0; //unfinished dependencies
+		bool prepared = false; //'fn' has finished; 'upload' is next
+		std::vector< uint32_t > dependents;
+
+		LoadTiming timing;
+	};
+
+	std::vector< LoadFunction > &get_load_functions() {
+		static std::vector< LoadFunction > load_functions;
+		return load_functions;
+	}
+
+	std::vector< LoadTiming > &get_load_timings() {
+		static std::vector< LoadTiming > load_timings;
+		return load_timings;
+	}
+
+	thread_local LoadTiming *current_timing = nullptr; //counters for the load function running on this thread
+
+	//state shared by the loading threads from start_load_functions() until loading finishes:
+	struct Loading {
+		std::vector< LoadFunction > &functions = get_load_functions();
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		std::mutex mutex;
+		std::condition_variable main_cv; //signalled when the main thread has something to do
+		std::condition_variable worker_cv; //signalled when workers have something to do
+
+		std::set< uint32_t > main_ready; //(sets, so ready functions run in the order they were added)
+		std::set< uint32_t > worker_ready;
+		uint32_t remaining = 0; //functions not yet finished
+		uint32_t tag_remaining[MaxLoadTag] = { }; //...by tag
+		uint32_t running = 0; //functions started but not yet finished
+		std::exception_ptr error; //first exception thrown by a load function
+		bool stop = false; //workers should exit
+
+		//OpenGL calls sent from workers:
+		struct GLCall {
+			std::function< void() > const *fn = nullptr;
+			LoadTiming *timing = nullptr; //(of the calling load function)
+			bool done = false;
+			std::exception_ptr error;
+		};
+		std::deque< GLCall * > gl_calls;
+		std::condition_variable gl_done_cv;
+
+		std::vector< std::thread > workers;
+
+		float ms_since_start() const {
+			return std::chrono::duration< float, std::milli >(std::chrono::steady_clock::now() - start).count();
+		}
+
+		//(called when function 'i' has no unfinished dependencies)
+		void make_ready(uint32_t i) {
+			LoadFunction &lf = functions[i];
+			if (lf.upload) {
+				//two-phase loads prepare right away; dependencies only hold back the upload:
+				if (lf.prepared) main_ready.emplace(i);
+			} else if (lf.thread == LoadThreadWorker) {
+				worker_ready.emplace(i);
+				worker_cv.notify_one();
+			} else {
+				main_ready.emplace(i);
+			}
+		}
+
+		//call function 'i' (or, if it has been prepared, its upload); lock is held on entry and exit:
+		void run(uint32_t i, std::unique_lock< std::mutex > &lock) {
+			LoadFunction &lf = functions[i];
+			bool upload = lf.prepared;
+			running += 1;
+			lock.unlock();
+			float before = ms_since_start();
+			if (!upload) lf.timing.start_ms = before;
+			std::exception_ptr err;
+			current_timing = &lf.timing;
+			try {
+				if (upload) lf.upload();
+				else lf.fn();
+			} catch (...) {
+				err = std::current_exception();
+			}
+			current_timing = nullptr;
+			float after = ms_since_start();
+			(upload ? lf.timing.upload_ms : lf.timing.work_ms) = after - before;
+			if (upload) lf.upload = nullptr; //(release captures)
+			else lf.fn = nullptr;
+			lock.lock();
+			running -= 1;
+			if (!err && lf.upload) {
+				//prepared; upload on the main thread once dependencies are done:
+				lf.prepared = true;
+				if (lf.waiting == 0) make_ready(i);
+				main_cv.notify_one();
+				return;
+			}
+			lf.timing.finish_ms = after;
+			remaining -= 1;
+			tag_remaining[lf.tag] -= 1;
+			if (err) {
+				if (!error) error = err;
+			} else {
+				for (uint32_t d : lf.dependents) {
+					if (--functions[d].waiting == 0) make_ready(d);
+				}
+			}
+			main_cv.notify_one();
+		}
+
+		//run main-thread work (OpenGL calls from workers, main-thread functions, uploads) until 'done()' or 'deadline';
+		// when there's nothing to do, waits for workers if 'block' is set (or returns if not); lock is held on entry and exit:
+		template< typename Done >
+		void service(std::unique_lock< std::mutex > &lock, Done const &done, std::chrono::steady_clock::time_point deadline, bool block) {
+			while (true) {
+				if (error) {
+					//stop starting functions; wait for running ones (which may still need OpenGL calls):
+					if (running == 0 && gl_calls.empty()) return;
+				} else if (done()) {
+					return;
+				}
+				if (!gl_calls.empty()) {
+					GLCall *call = gl_calls.front();
+					gl_calls.pop_front();
+					lock.unlock();
+					current_timing = call->timing;
+					try {
+						(*call->fn)();
+					} catch (...) {
+						call->error = std::current_exception();
+					}
+					current_timing = nullptr;
+					lock.lock();
+					call->done = true;
+					gl_done_cv.notify_all();
+				} else if (!error && !main_ready.empty()) {
+					uint32_t i = *main_ready.begin();
+					main_ready.erase(main_ready.begin());
+					run(i, lock);
+				} else if (block) {
+					main_cv.wait(lock);
+					continue;
+				} else {
+					return;
+				}
+				if (std::chrono::steady_clock::now() >= deadline) return;
+			}
+		}
+	};
+	Loading *loading = nullptr; //(only non-null while loading)
+	std::thread::id gl_thread;
+
+	//stop workers, record timings, and release loading state; rethrows the first load function error (if any):
+	void finish_loading(std::unique_lock< std::mutex > &lock) {
+		assert(loading);
+		loading->stop = true;
+		loading->worker_cv.notify_all();
+		lock.unlock();
+		for (auto &worker : loading->workers) {
+			worker.join();
+		}
+
+		std::exception_ptr error = loading->error;
+		auto &timings = get_load_timings();
+		for (auto const &lf : loading->functions) {
+			timings.emplace_back(lf.timing);
+		}
+		loading->functions.clear();
+		delete loading;
+		loading = nullptr;
+
+		if (error) std::rethrow_exception(error);
 	}
 }
 
-void add_load_function(LoadTag tag, std::function< void() > const &fn) {
-	auto &load_lists = get_load_lists();
-	assert(tag < load_lists.size());
-	load_lists[tag].emplace_back(fn);
+LoadName::LoadName(std::source_location const &where) {
+	std::string file = where.file_name();
+	size_t slash = file.find_last_of("/\\");
+	if (slash != std::string::npos) file = file.substr(slash + 1);
+	name = file + ":" + std::to_string(where.line());
 }
 
-void call_load_functions() {
+void add_load_function(LoadTag tag, std::function< void() > const &fn, void const *key, LoadName const &name) {
+	assert(tag < MaxLoadTag);
+	LoadFunction &lf = get_load_functions().emplace_back();
+	lf.tag = tag;
+	lf.fn = fn;
+	lf.key = key;
+	lf.timing.name = name.name;
+}
+
+void add_load_function(LoadTag tag, LoadAfter const &after, LoadThread thread, std::function< void() > const &fn, void const *key, LoadName const &name) {
+	assert(tag < MaxLoadTag);
+	LoadFunction &lf = get_load_functions().emplace_back();
+	lf.tag = tag;
+	lf.has_after = true;
+	lf.after = after.loads;
+	lf.thread = thread;
+	lf.fn = fn;
+	lf.key = key;
+	lf.timing.name = name.name;
+}
+
+void add_load_function(LoadTag tag, LoadAfter const &after, std::function< void() > const &prepare, std::function< void() > const &upload, void const *key, LoadName const &name) {
+	assert(tag < MaxLoadTag);
+	LoadFunction &lf = get_load_functions().emplace_back();
+	lf.tag = tag;
+	lf.has_after = true;
+	lf.after = after.loads;
+	lf.thread = LoadThreadWorker;
+	lf.fn = prepare;
+	lf.upload = upload;
+	lf.key = key;
+	lf.timing.name = name.name;
+}
+
+void load_on_gl_thread(std::function< void() > const &fn) {
+	if (!loading || std::this_thread::get_id() == gl_thread) {
+		fn();
+		return;
+	}
+	Loading::GLCall call;
+	call.fn = &fn;
+	call.timing = current_timing;
+	std::unique_lock< std::mutex > lock(loading->mutex);
+	loading->gl_calls.emplace_back(&call);
+	loading->main_cv.notify_one();
+	loading->gl_done_cv.wait(lock, [&](){ return call.done; });
+	if (call.error) std::rethrow_exception(call.error);
+}
+
+void start_load_functions() {
 	static bool has_been_called = false;
-	assert(!has_been_called && "call_load_functions should only be called *once*");
+	assert(!has_been_called && "start_load_functions (or call_load_functions) should only be called *once*");
 	has_been_called = true;
 
-	auto &load_lists = get_load_lists();
-	for (auto &fn_list : load_lists) {
-		while (!fn_list.empty()) {
-			(*fn_list.begin())(); //call first function in the list
-			fn_list.pop_front(); //remove from list
+	auto &functions = get_load_functions();
+	uint32_t count = uint32_t(functions.size());
+
+	//---- build dependency graph ----
+	std::unordered_map< void const *, uint32_t > by_key;
+	for (uint32_t i = 0; i < count; ++i) {
+		if (functions[i].key) by_key.emplace(functions[i].key, i);
+	}
+	for (uint32_t i = 0; i < count; ++i) {
+		LoadFunction &lf = functions[i];
+		lf.timing.tag = lf.tag;
+		lf.timing.thread = lf.thread;
+		lf.timing.two_phase = bool(lf.upload);
+		std::vector< uint32_t > deps;
+		if (lf.has_after) {
+			for (void const *key : lf.after) {
+				auto f = by_key.find(key);
+				if (f == by_key.end()) {
+					throw std::runtime_error("Load function depends on something that isn't a Load (or was never constructed).");
+				}
+				deps.emplace_back(f->second);
+			}
+		} else {
+			for (uint32_t j = 0; j < count; ++j) {
+				if (functions[j].tag < lf.tag) deps.emplace_back(j);
+			}
+		}
+		std::sort(deps.begin(), deps.end());
+		deps.erase(std::unique(deps.begin(), deps.end()), deps.end());
+		for (uint32_t d : deps) {
+			if (d == i) throw std::runtime_error("Load function depends on itself.");
+			functions[d].dependents.emplace_back(i);
+		}
+		lf.waiting = uint32_t(deps.size());
+	}
+
+	//check for cycles (Kahn's algorithm on a copy of the counts):
+	{
+		std::vector< uint32_t > waiting(count);
+		std::vector< uint32_t > ready;
+		for (uint32_t i = 0; i < count; ++i) {
+			waiting[i] = functions[i].waiting;
+			if (waiting[i] == 0) ready.emplace_back(i);
+		}
+		uint32_t visited = 0;
+		while (!ready.empty()) {
+			uint32_t i = ready.back();
+			ready.pop_back();
+			++visited;
+			for (uint32_t d : functions[i].dependents) {
+				if (--waiting[d] == 0) ready.emplace_back(d);
+			}
+		}
+		if (visited != count) {
+			throw std::runtime_error("Load functions have a dependency cycle.");
+		}
+	}
+
+	//---- start ----
+	gl_thread = std::this_thread::get_id();
+	loading = new Loading;
+	Loading &state = *loading;
+
+	state.remaining = count;
+	for (auto const &lf : functions) {
+		state.tag_remaining[lf.tag] += 1;
+	}
+	for (uint32_t i = 0; i < count; ++i) {
+		if (functions[i].upload) state.worker_ready.emplace(i);
+		else if (functions[i].waiting == 0) state.make_ready(i);
+	}
+
+	uint32_t worker_functions = 0;
+	for (auto const &lf : functions) {
+		if (lf.thread == LoadThreadWorker) ++worker_functions;
+	}
+	if (worker_functions > 0) {
+		//(at least two workers, even on one core, so one load's file reads can overlap another's parsing)
+		uint32_t threads = std::clamp(std::thread::hardware_concurrency(), 2u, 8u);
+		threads = std::min(threads, worker_functions);
+		for (uint32_t t = 0; t < threads; ++t) {
+			state.workers.emplace_back([&state](){
+				std::unique_lock< std::mutex > lock(state.mutex);
+				while (true) {
+					state.worker_cv.wait(lock, [&](){ return state.stop || (!state.error && !state.worker_ready.empty()); });
+					if (state.stop) break;
+					uint32_t i = *state.worker_ready.begin();
+					state.worker_ready.erase(state.worker_ready.begin());
+					state.run(i, lock);
+				}
+			});
+		}
+	}
+}
+
+bool update_load_functions(float budget) {
+	if (!loading) return true;
+	assert(std::this_thread::get_id() == gl_thread && "update_load_functions should be called from the thread that started loading");
+
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast< std::chrono::steady_clock::duration >(std::chrono::duration< float >(budget));
+	std::unique_lock< std::mutex > lock(loading->mutex);
+	loading->service(lock, [](){ return loading->remaining == 0; }, deadline, false);
+	//(after an error, keep servicing on later frames until running loads -- which may still be waiting on OpenGL calls -- finish)
+	if (loading->remaining == 0 || (loading->error && loading->running == 0 && loading->gl_calls.empty())) {
+		finish_loading(lock);
+		return true;
+	}
+	return false;
+}
+
+void finish_load_functions(LoadTag tag) {
+	if (!loading) return;
+	assert(std::this_thread::get_id() == gl_thread && "finish_load_functions should be called from the thread that started loading");
+
+	std::unique_lock< std::mutex > lock(loading->mutex);
+	loading->service(lock, [tag](){
+		for (uint32_t t = 0; t <= tag && t < MaxLoadTag; ++t) {
+			if (loading->tag_remaining[t] != 0) return false;
+		}
+		return true;
+	}, std::chrono::steady_clock::time_point::max(), true);
+	if (loading->remaining == 0 || loading->error) {
+		finish_loading(lock);
+	}
+}
+
+void abort_load_functions() {
+	if (!loading) return;
+	assert(std::this_thread::get_id() == gl_thread && "abort_load_functions should be called from the thread that started loading");
+
+	std::unique_lock< std::mutex > lock(loading->mutex);
+	//stop starting functions (as if one had failed), then let running ones -- and their OpenGL calls -- finish:
+	if (!loading->error) loading->error = std::make_exception_ptr(std::runtime_error("Loading was aborted."));
+	loading->worker_cv.notify_all();
+	loading->service(lock, [](){ return false; }, std::chrono::steady_clock::time_point::max(), true);
+	try {
+		finish_loading(lock);
+	} catch (...) {
+		//(errors from abandoned loads don't matter)
+	}
+}
+
+void call_load_functions() {
+	start_load_functions();
+	finish_load_functions(LoadTag(MaxLoadTag - 1));
+}
+
+LoadProgress load_progress() {
+	LoadProgress progress;
+	if (!loading) {
+		for (auto const &timing : get_load_timings()) {
+			if (timing.outside) continue;
+			progress.total += 1;
+			progress.elapsed_ms = std::max(progress.elapsed_ms, timing.finish_ms);
 		}
+		progress.finished = progress.total;
+		return progress;
+	}
+	std::unique_lock< std::mutex > lock(loading->mutex);
+	progress.total = uint32_t(loading->functions.size());
+	progress.finished = progress.total - loading->remaining;
+	progress.elapsed_ms = loading->ms_since_start();
+	return progress;
+}
+
+std::vector< LoadTiming > const &load_timings() {
+	return get_load_timings();
+}
+
+void load_count_bytes_mapped(uint64_t bytes) {
+	if (current_timing) current_timing->bytes_mapped += bytes;
+}
+
+void load_count_gl_objects(uint32_t count) {
+	if (current_timing) current_timing->gl_objects += count;
+}
+
+void add_load_timing(LoadName const &name, float work_ms) {
+	LoadTiming &timing = get_load_timings().emplace_back();
+	timing.name = name.name;
+	timing.outside = true;
+	timing.work_ms = work_ms;
+}
+
+namespace {
+	//load_timings() indices, most expensive (main-thread-blocking time counts double, since it also stalls frames) first:
+	std::vector< uint32_t > report_order() {
+		auto const &timings = get_load_timings();
+		auto cost = [](LoadTiming const &t) {
+			float main_ms = (t.thread == LoadThreadMain || t.outside ? t.work_ms : 0.0f) + t.upload_ms;
+			return t.work_ms + t.upload_ms + main_ms;
+		};
+		std::vector< uint32_t > order(timings.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+			return cost(timings[a]) > cost(timings[b]);
+		});
+		return order;
+	}
+	char const *tag_name(LoadTag tag) {
+		static char const *names[MaxLoadTag] = { "Early", "Default", "Late" };
+		return (tag < MaxLoadTag ? names[tag] : "?");
+	}
+}
+
+void write_load_report(std::ostream &to) {
+	auto const &timings = get_load_timings();
+	LoadProgress progress = load_progress();
+
+	std::ostringstream out;
+	out << std::fixed << std::setprecision(1);
+	out << "Loaded " << progress.total << " load functions in " << progress.elapsed_ms << "ms";
+	float main_ms = 0.0f, worker_ms = 0.0f;
+	uint64_t bytes = 0;
+	uint32_t gl_objects = 0;
+	for (auto const &t : timings) {
+		((t.thread == LoadThreadMain || t.outside) ? main_ms : worker_ms) += t.work_ms;
+		main_ms += t.upload_ms;
+		bytes += t.bytes_mapped;
+		gl_objects += t.gl_objects;
+	}
+	out << " (" << main_ms << "ms on the main thread, " << worker_ms << "ms on workers; "
+		<< bytes / 1024 << "KiB mapped; " << gl_objects << " GL objects):\n";
+	out << std::setw(9) << "total" << std::setw(9) << "work" << std::setw(9) << "upload"
+		<< std::setw(10) << "KiB map" << std::setw(5) << "GL"
+		<< "  " << std::setw(7) << "thread" << std::setw(8) << "tag" << "  name\n";
+	for (uint32_t i : report_order()) {
+		LoadTiming const &t = timings[i];
+		out << std::setw(9) << t.work_ms + t.upload_ms << std::setw(9) << t.work_ms;
+		if (t.two_phase) out << std::setw(9) << t.upload_ms;
+		else out << std::setw(9) << "-";
+		out << std::setw(10) << (t.bytes_mapped + 1023) / 1024 << std::setw(5) << t.gl_objects
+			<< "  " << std::setw(7) << (t.outside ? "static" : (t.thread == LoadThreadWorker ? "worker" : "main"))
+			<< std::setw(8) << (t.outside ? "-" : tag_name(t.tag))
+			<< "  " << t.name << "\n";
+	}
+	to << out.str();
+	to.flush();
+}
+
+void write_load_report_json(std::ostream &to) {
+	auto const &timings = get_load_timings();
+	auto quote = [](std::string const &str) {
+		std::string ret = "\"";
+		for (char c : str) {
+			if (c == '"' || c == '\\') ret += '\\';
+			if (uint8_t(c) < 0x20) ret += ' ';
+			else ret += c;
+		}
+		return ret + "\"";
+	};
+
+	std::ostringstream out;
+	out << "[\n";
+	bool first = true;
+	for (uint32_t i : report_order()) {
+		LoadTiming const &t = timings[i];
+		if (!first) out << ",\n";
+		first = false;
+		out << "\t{ \"name\": " << quote(t.name)
+			<< ", \"thread\": " << quote(t.outside ? "static" : (t.thread == LoadThreadWorker ? "worker" : "main"))
+			<< ", \"tag\": " << quote(t.outside ? "" : tag_name(t.tag))
+			<< ", \"start_ms\": " << t.start_ms
+			<< ", \"work_ms\": " << t.work_ms
+			<< ", \"upload_ms\": " << t.upload_ms
+			<< ", \"finish_ms\": " << t.finish_ms
+			<< ", \"bytes_mapped\": " << t.bytes_mapped
+			<< ", \"gl_objects\": " << t.gl_objects
+			<< " }";
 	}
+	out << "\n]\n";
+	to << out.str();
+	to.flush();
 }
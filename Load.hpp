@@ -20,10 +20,46 @@
  * These functions are grouped by 'tags', which allow some sequencing of calls.
  * (particularly, this is useful for loading large data blobs [e.g. Meshes] before looking up individual elements within them.)
  *
+ * Loads may instead list exactly which other loads they need (with LoadAfter), and may run on a worker thread:
+ *
+ * Load< MeshBuffer > level_meshes(LoadTagDefault, LoadAfter{ &lit_color_texture_program }, []() -> MeshBuffer const * {
+ *     MeshBuffer *ret = new MeshBuffer(data_path("level.pnct")); //reads + parses on a worker thread
+ *     load_on_gl_thread([&](){ level_vao = ret->make_vao_for_program(lit_color_texture_program->program); });
+ *     return ret;
+ * }, LoadThreadWorker);
+ *
+ * A load that lists its dependencies starts as soon as they finish (rather than waiting for every load in
+ * earlier tags), so independent loads overlap and startup takes about as long as the slowest chain of loads.
+ * Loads without a list still wait for all loads in earlier tags, and run on the thread that calls call_load_functions().
+ *
+ * Code running on a worker must send OpenGL calls to the context's thread with load_on_gl_thread().
+ *
+ * Loads may also be split into a 'prepare' function (worker thread; file reads, parsing, decoding -- no OpenGL)
+ * that returns CPU-side staging data, and an 'upload' function (main thread) that turns it into the loaded value:
+ *
+ * Load< MeshBuffer > level_meshes(LoadTagDefault, LoadAfter{ },
+ *     []() { return MeshBuffer::prepare(data_path("level.pnct")); },
+ *     [](MeshBuffer::Staging &staging) -> MeshBuffer const * { return new MeshBuffer(staging); }
+ * );
+ *
+ * Prepares start right away and run concurrently ('prepare' must not use other loads -- the LoadAfter list only
+ * holds back 'upload'); uploads run one at a time on the main thread (so they can be spread across frames).
+ *
+ * To keep drawing frames while loading, call start_load_functions() and then update_load_functions() once per frame
+ * (see LoadingMode) instead of call_load_functions().
+ *
  */
 
 #include <functional>
+#include <initializer_list>
+#include <memory>
+#include <optional>
+#include <iosfwd>
+#include <source_location>
+#include <string>
+#include <type_traits>
 #include <stdexcept>
+#include <vector>
 #include <cstdint>
 
 
@@ -34,15 +70,98 @@ enum LoadTag : uint32_t {
 	MaxLoadTag //<-- just used to track # of load tags
 };
 
+//Where a load function runs:
+enum LoadThread : uint32_t {
+	LoadThreadMain, //the thread that calls call_load_functions() (which has the OpenGL context)
+	LoadThreadWorker //a worker thread (use load_on_gl_thread() for OpenGL calls)
+};
+
+//The loads (Load< T > objects) that must finish before a load function runs:
+struct LoadAfter {
+	LoadAfter(std::initializer_list< void const * > loads_) : loads(loads_) { }
+	std::vector< void const * > loads;
+};
+
+//Name of a load function (in timings and reports); by default, where it was added (e.g., "PlayMode.cpp:23"):
+struct LoadName {
+	LoadName(std::source_location const &where = std::source_location::current());
+	LoadName(char const *name_) : name(name_) { }
+	LoadName(std::string const &name_) : name(name_) { }
+	std::string name;
+};
+
 //Add a function to an internal list of loading functions:
 // (only call *before* "call_load_functions()")
-void add_load_function(LoadTag tag, std::function< void() > const &fn);
+// 'key' identifies the function in other loads' LoadAfter lists (Load< T > uses its own address)
+void add_load_function(LoadTag tag, std::function< void() > const &fn, void const *key = nullptr, LoadName const &name = std::source_location::current());
+//...that runs after specific loads (instead of after all loads with earlier tags):
+void add_load_function(LoadTag tag, LoadAfter const &after, LoadThread thread, std::function< void() > const &fn, void const *key = nullptr, LoadName const &name = std::source_location::current());
+//...in two phases: 'prepare' runs on a worker thread, then 'upload' on the main thread:
+void add_load_function(LoadTag tag, LoadAfter const &after, std::function< void() > const &prepare, std::function< void() > const &upload, void const *key = nullptr, LoadName const &name = std::source_location::current());
 
 //Call all loading functions:
-// (loading functions may throw exceptions if they fail.)
+// (loading functions may throw exceptions if they fail; the first exception is rethrown here once running loads finish.)
 // (only call *once*)
 void call_load_functions();
 
+//...or load in the background while frames are drawn:
+// start_load_functions() starts worker threads (only call *once*; not together with call_load_functions());
+// update_load_functions() then does up to 'budget' seconds of main-thread work (uploads, OpenGL calls, main-thread functions)
+//  and returns true once everything is loaded (call it once per frame from the thread that started loading)
+// finish_load_functions() does main-thread work until all functions with tags up to 'tag' are done
+// (all three rethrow the first exception from a load function, once running loads finish)
+void start_load_functions();
+bool update_load_functions(float budget);
+void finish_load_functions(LoadTag tag);
+//abort_load_functions() stops loading early (e.g., when the window is closed during loading): no more functions start,
+// running ones finish (their OpenGL calls are serviced), and workers exit; errors are discarded.
+// call before tearing down the OpenGL context (does nothing if loading isn't in progress)
+void abort_load_functions();
+
+//Progress, e.g. for a loading screen:
+struct LoadProgress {
+	uint32_t total = 0;
+	uint32_t finished = 0;
+	float elapsed_ms = 0.0f; //since loading started
+};
+LoadProgress load_progress();
+
+//Per-function timing and resource use (filled in once loading is finished; in the order functions were added):
+// times are in milliseconds, relative to the start of loading
+struct LoadTiming {
+	std::string name;
+	LoadTag tag = LoadTagDefault;
+	LoadThread thread = LoadThreadMain;
+	bool two_phase = false;
+	bool outside = false; //work done outside of load functions (see add_load_timing)
+	float start_ms = 0.0f; //function (or prepare) started
+	float work_ms = 0.0f; //time in function (or prepare)
+	float upload_ms = 0.0f; //time in upload (two-phase loads)
+	float finish_ms = 0.0f; //function (or upload) finished
+	uint64_t bytes_mapped = 0; //see load_count_bytes_mapped
+	uint32_t gl_objects = 0; //see load_count_gl_objects
+};
+std::vector< LoadTiming > const &load_timings();
+
+//Loading code reports what it maps and creates, counted toward the load function running on the calling thread:
+// (including load_on_gl_thread calls made from it; ignored outside of load functions)
+// bytes mapped (MappedFile sizes, including pack entries) bound what was read: mapped pages are only read when touched
+void load_count_bytes_mapped(uint64_t bytes);
+void load_count_gl_objects(uint32_t count);
+
+//Record startup work that doesn't happen in a load function (e.g., during static initialization), so reports include it:
+void add_load_timing(LoadName const &name, float work_ms);
+
+//Report of load_timings(), most expensive first; as text...
+void write_load_report(std::ostream &to);
+//...or as JSON (an array with one object per entry):
+void write_load_report_json(std::ostream &to);
+
+//Run a function on the OpenGL context's thread and wait for it to finish:
+// (runs it immediately when called from that thread -- or when loading isn't in progress)
+// (exceptions are rethrown in the calling thread)
+void load_on_gl_thread(std::function< void() > const &fn);
+
 
 //work-around for MSVC not accepting this as a lambda:
 template< typename T >
@@ -51,13 +170,41 @@ T const *new_T() { return new T; }
 template< typename T >
 struct Load {
 	//Constructing a Load< T > adds the passed function to the list of functions to call:
-	Load(LoadTag tag, const std::function< T const *() > &load_fn = new_T< T >) : value(nullptr) {
+	// ('name' defaults to where the Load< T > is declared)
+	Load(LoadTag tag, const std::function< T const *() > &load_fn = new_T< T >, LoadName const &name = std::source_location::current()) : value(nullptr) {
 		add_load_function(tag, [this,load_fn](){
 			this->value = load_fn();
 			if (!(this->value)) {
 				throw std::runtime_error("Loading failed.");
 			}
-		});
+		}, this, name);
+	}
+
+	//...or, to run after specific loads (possibly on a worker thread):
+	Load(LoadTag tag, LoadAfter const &after, const std::function< T const *() > &load_fn, LoadThread thread = LoadThreadMain, LoadName const &name = std::source_location::current()) : value(nullptr) {
+		add_load_function(tag, after, thread, [this,load_fn](){
+			this->value = load_fn();
+			if (!(this->value)) {
+				throw std::runtime_error("Loading failed.");
+			}
+		}, this, name);
+	}
+
+	//...or in two phases, 'prepare' (on a worker thread) returning staging data that 'upload' (on the main thread) makes into a T:
+	template< typename Prepare, typename Upload >
+	requires std::is_invocable_r_v< T const *, Upload, std::invoke_result_t< Prepare > & >
+	Load(LoadTag tag, LoadAfter const &after, Prepare const &prepare_fn, Upload const &upload_fn, LoadName const &name = std::source_location::current()) : value(nullptr) {
+		using Staging = std::invoke_result_t< Prepare >;
+		auto staging = std::make_shared< std::optional< Staging > >();
+		add_load_function(tag, after, [staging,prepare_fn](){
+			staging->emplace(prepare_fn());
+		}, [this,staging,upload_fn](){
+			this->value = upload_fn(**staging);
+			staging->reset(); //(staging data is no longer needed)
+			if (!(this->value)) {
+				throw std::runtime_error("Loading failed.");
+			}
+		}, this, name);
 	}
 
 	//Make a "Load< T >" behave like a "T const *":
@@ -75,8 +222,11 @@ struct Load {
 template< >
 struct Load< void > {
 	//Constructing a Load< T > adds the passed function to the list of functions to call:
-	Load( LoadTag tag, const std::function< void() > &load_fn) {
-		add_load_function(tag, load_fn);
+	Load( LoadTag tag, const std::function< void() > &load_fn, LoadName const &name = std::source_location::current()) {
+		add_load_function(tag, load_fn, this, name);
+	}
+	Load( LoadTag tag, LoadAfter const &after, const std::function< void() > &load_fn, LoadThread thread = LoadThreadMain, LoadName const &name = std::source_location::current()) {
+		add_load_function(tag, after, thread, load_fn, this, name);
 	}
 };
 
@@ -0,0 +1,71 @@
+#include "LoadingMode.hpp"
+
+#include "DrawLines.hpp"
+#include "Load.hpp"
+#include "gl_errors.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+LoadingMode::LoadingMode(std::function< std::shared_ptr< Mode >() > const &make_next_) : make_next(make_next_) {
+}
+
+LoadingMode::~LoadingMode() {
+}
+
+void LoadingMode::update(float elapsed) {
+	if (!update_load_functions(budget)) return;
+
+	//report per-function timings:
+	write_load_report(std::cout);
+	if (!report_json.empty()) {
+		std::ofstream json(report_json, std::ios::binary);
+		write_load_report_json(json);
+		if (!json) std::cerr << "WARNING: failed to write load report to '" << report_json << "'." << std::endl;
+		else std::cout << "Wrote load report to '" << report_json << "'." << std::endl;
+	}
+
+	Mode::set_current(make_next());
+}
+
+void LoadingMode::draw(glm::uvec2 const &drawable_size) {
+	glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glDisable(GL_DEPTH_TEST);
+
+	LoadProgress progress = load_progress();
+	float fraction = (progress.total ? float(progress.finished) / float(progress.total) : 1.0f);
+
+	float aspect = float(drawable_size.x) / float(drawable_size.y);
+	DrawLines lines(glm::mat4(
+		1.0f / aspect, 0.0f, 0.0f, 0.0f,
+		0.0f, 1.0f, 0.0f, 0.0f,
+		0.0f, 0.0f, 1.0f, 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f
+	));
+
+	constexpr float H = 0.09f;
+	std::string text = "Loading " + std::to_string(progress.finished) + "/" + std::to_string(progress.total);
+	lines.draw_text(text,
+		glm::vec3(-0.6f, 0.1f, 0.0f),
+		glm::vec3(H, 0.0f, 0.0f), glm::vec3(0.0f, H, 0.0f),
+		glm::u8vec4(0xff, 0xff, 0xff, 0x00));
+
+	//progress bar -- outline, then filled with vertical lines:
+	glm::vec2 min(-0.6f,-0.05f), max(0.6f, 0.0f);
+	glm::u8vec4 color(0xff, 0xd0, 0x40, 0x00);
+	lines.draw(glm::vec3(min.x, min.y, 0.0f), glm::vec3(max.x, min.y, 0.0f), color);
+	lines.draw(glm::vec3(max.x, min.y, 0.0f), glm::vec3(max.x, max.y, 0.0f), color);
+	lines.draw(glm::vec3(max.x, max.y, 0.0f), glm::vec3(min.x, max.y, 0.0f), color);
+	lines.draw(glm::vec3(min.x, max.y, 0.0f), glm::vec3(min.x, min.y, 0.0f), color);
+	uint32_t fill = uint32_t(std::round(fraction * 200.0f));
+	for (uint32_t i = 0; i <= fill; ++i) {
+		float x = min.x + (max.x - min.x) * (i / 200.0f);
+		lines.draw(glm::vec3(x, min.y, 0.0f), glm::vec3(x, max.y, 0.0f), color);
+	}
+
+	GL_ERRORS();
+}
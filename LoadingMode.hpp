@@ -0,0 +1,36 @@
+#pragma once
+
+/*
+ * LoadingMode shows a progress bar while Load<> functions run in the background,
+ *  then switches to the Mode made by 'make_next' (e.g., PlayMode, which needs the loaded assets).
+ *
+ * Usage (in main):
+ *  start_load_functions();
+ *  finish_load_functions(LoadTagEarly); //DrawLines -- used by the progress bar -- is ready after the Early tag
+ *  Mode::set_current(std::make_shared< LoadingMode >([](){ return std::make_shared< PlayMode >(); }));
+ *
+ */
+
+#include "Mode.hpp"
+
+#include <functional>
+#include <memory>
+#include <string>
+
+struct LoadingMode : Mode {
+	LoadingMode(std::function< std::shared_ptr< Mode >() > const &make_next);
+	virtual ~LoadingMode();
+
+	//functions called by main loop:
+	virtual void update(float elapsed) override;
+	virtual void draw(glm::uvec2 const &drawable_size) override;
+
+	//main-thread time (seconds) to spend on loading each frame:
+	// (uploads and other main-thread work happen in between frames, so this bounds how long a frame can stall)
+	float budget = 0.008f;
+
+	//if set, the load report (see write_load_report_json) is also written to this file:
+	std::string report_json;
+
+	std::function< std::shared_ptr< Mode >() > make_next;
+};
@@ -22,6 +22,9 @@ const maek = init_maek();
 
 const NEST_LIBS = `../nest-libs/${maek.OS}`;
 
+//libraries for tools that run headless (no SDL, no OpenGL) -- passed as their LINK's "LINKLibs" option below:
+let headless_libs = [];
+
 //set compile flags (these can also be overridden per-task using the "options" parameter):
 if (maek.OS === "windows") {
 	maek.options.CPPFlags.push(
@@ -31,6 +34,7 @@ if (maek.OS === "windows") {
 		`/I${NEST_LIBS}/SDL3/include`,
 		`/I${NEST_LIBS}/glm/include`,
 		`/I${NEST_LIBS}/libpng/include`,
+		`/I${NEST_LIBS}/zlib/include`,
 		//#disable a few warnings:
 		`/wd4146`, //-1U is still unsigned
 		`/wd4297`, //unforunately SDLmain is nothrow
@@ -44,13 +48,18 @@ if (maek.OS === "windows") {
 		`/LIBPATH:${NEST_LIBS}/zlib/lib`, `zlib.lib`,
 		`/MANIFEST:EMBED`, `/MANIFESTINPUT:set-utf8-code-page.manifest`
 	);
+	headless_libs.push(
+		`/LIBPATH:${NEST_LIBS}/zlib/lib`, `zlib.lib`,
+		`/MANIFEST:EMBED`, `/MANIFESTINPUT:set-utf8-code-page.manifest`
+	);
 } else if (maek.OS === "linux") {
 	maek.options.CPPFlags.push(
 		`-O2`, //optimize
 		//include paths for nest libraries:
 		`-I${NEST_LIBS}/SDL3/include`, `-D_THREAD_SAFE`,
 		`-I${NEST_LIBS}/glm/include`,
-		`-I${NEST_LIBS}/libpng/include`
+		`-I${NEST_LIBS}/libpng/include`,
+		`-I${NEST_LIBS}/zlib/include`
 	);
 	maek.options.LINKLibs.push(
 		//linker flags for nest libraries:
@@ -58,13 +67,18 @@ if (maek.OS === "windows") {
 		`-L${NEST_LIBS}/libpng/lib`, `-lpng`,
 		`-L${NEST_LIBS}/zlib/lib`, `-lz`
 	);
+	headless_libs.push(
+		`-lm`, `-lpthread`,
+		`-L${NEST_LIBS}/zlib/lib`, `-lz`
+	);
 } else if (maek.OS === "macos") {
 	maek.options.CPPFlags.push(
 		`-O2`, //optimize
 		//include paths for nest libraries:
 		`-I${NEST_LIBS}/SDL3/include`, `-D_THREAD_SAFE`,
 		`-I${NEST_LIBS}/glm/include`,
-		`-I${NEST_LIBS}/libpng/include`
+		`-I${NEST_LIBS}/libpng/include`,
+		`-I${NEST_LIBS}/zlib/include`
 	);
 	maek.options.LINKLibs.push(
 		//linker flags for nest libraries:
@@ -90,6 +104,11 @@ if (maek.OS === "windows") {
 		`-L${NEST_LIBS}/libpng/lib`, `-lpng`,
 		`-L${NEST_LIBS}/zlib/lib`, `-lz`
 	);
+	headless_libs.push(
+		`-lpthread`,
+		`-lm`,
+		`-L${NEST_LIBS}/zlib/lib`, `-lz`
+	);
 }
 //use COPY to copy a file
 // 'COPY(from, to)'
@@ -117,23 +136,40 @@ if (maek.OS === 'windows') {
 const game_names = [
 	maek.CPP('PlayMode.cpp'),
 	maek.CPP('main.cpp'),
+	maek.CPP('LoadingMode.cpp'),
 	maek.CPP('LitColorTextureProgram.cpp')
 	//, maek.CPP('ColorTextureProgram.cpp')  //not used right now, but you might want it
 ];
 
-const common_names = [
+//code that needs no window or OpenGL context (so headless tools like cook-assets can link just this):
+const core_names = [
 	maek.CPP('data_path.cpp'),
+	maek.CPP('Mesh.cpp'),
+	maek.CPP('optimize_mesh.cpp'),
+	maek.CPP('MappedFile.cpp'),
+	maek.CPP('Pack.cpp'),
+	maek.CPP('read_write_chunk.cpp'),
+	maek.CPP('Load.cpp'),
+	maek.CPP('NameID.cpp')
+];
+
+const common_names = [
+	...core_names,
 	maek.CPP('PathFont.cpp'),
 	maek.CPP('PathFont-font.cpp'),
 	maek.CPP('DrawLines.cpp'),
 	maek.CPP('ColorProgram.cpp'),
 	maek.CPP('Scene.cpp'),
-	maek.CPP('Mesh.cpp'),
+	maek.CPP('WorldMatrixBatch.cpp'),
+	maek.CPP('BVH.cpp'),
+	maek.CPP('LightClusters.cpp'),
+	maek.CPP('Mesh-gl.cpp'),
+	maek.CPP('Texture.cpp'),
 	maek.CPP('load_save_png.cpp'),
 	maek.CPP('gl_compile_program.cpp'),
+	maek.CPP('gl_upload_buffer.cpp'),
 	maek.CPP('Mode.cpp'),
-	maek.CPP('GL.cpp'),
-	maek.CPP('Load.cpp')
+	maek.CPP('GL.cpp')
 ];
 
 const show_mesh_names = [
@@ -148,6 +184,22 @@ const show_scene_names = [
 	maek.CPP('ShowSceneMode.cpp')
 ];
 
+const bench_transforms_names = [
+	maek.CPP('bench-transforms.cpp')
+];
+
+const bench_clusters_names = [
+	maek.CPP('bench-clusters.cpp')
+];
+
+const bench_loading_names = [
+	maek.CPP('bench-loading.cpp')
+];
+
+const cook_assets_names = [
+	maek.CPP('cook-assets.cpp')
+];
+
 //the '[exeFile =] LINK(objFiles, exeFileBase, [, options])' links an array of objects into an executable:
 // objFiles: array of objects to link
 // exeFileBase: name of executable file to produce
@@ -155,9 +207,13 @@ const show_scene_names = [
 const game_exe = maek.LINK([...game_names, ...common_names], 'dist/game');
 const show_meshes_exe = maek.LINK([...show_mesh_names, ...common_names], 'scenes/show-meshes');
 const show_scene_exe = maek.LINK([...show_scene_names, ...common_names], 'scenes/show-scene');
+const bench_transforms_exe = maek.LINK([...bench_transforms_names, ...common_names], 'scenes/bench-transforms');
+const bench_clusters_exe = maek.LINK([...bench_clusters_names, ...common_names], 'scenes/bench-clusters');
+const bench_loading_exe = maek.LINK([...bench_loading_names, ...common_names], 'scenes/bench-loading');
+const cook_assets_exe = maek.LINK([...cook_assets_names, ...core_names], 'scenes/cook-assets', { LINKLibs: headless_libs });
 
 //set the default target to the game (and copy the readme files):
-maek.TARGETS = [game_exe, show_meshes_exe, show_scene_exe, ...copies];
+maek.TARGETS = [game_exe, show_meshes_exe, show_scene_exe, bench_transforms_exe, bench_clusters_exe, bench_loading_exe, cook_assets_exe, ...copies];
 
 //Note that tasks that produce ':abstract targets' are never cached.
 // This is similar to how .PHONY targets behave in make.
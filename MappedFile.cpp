@@ -0,0 +1,120 @@
+#include "MappedFile.hpp"
+#include "Load.hpp"
+#include "Pack.hpp"
+
+#include <stdexcept>
+#include <utility>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(std::string const &filename_, bool search_packs) : filename(filename_) {
+	if (search_packs) {
+		std::string_view name;
+		if (std::shared_ptr< Pack const > found = Pack::find(filename, &name)) {
+			std::span< char const > contents;
+			found->open(name, &contents, &storage);
+			pack = found;
+			data = (contents.empty() ? nullptr : contents.data());
+			size = contents.size();
+			load_count_bytes_mapped(size);
+			return;
+		}
+	}
+
+	#if defined(_WIN32)
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("Failed to open '" + filename + "' for mapping.");
+	}
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size)) {
+		CloseHandle(file);
+		throw std::runtime_error("Failed to get size of '" + filename + "'.");
+	}
+	size = size_t(file_size.QuadPart);
+	if (size != 0) {
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping) {
+			data = reinterpret_cast< char const * >(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		}
+	}
+	CloseHandle(file); //(the mapping keeps the file open)
+	if (size != 0 && !data) {
+		if (mapping) CloseHandle(mapping);
+		mapping = nullptr;
+		throw std::runtime_error("Failed to map '" + filename + "'.");
+	}
+	#else
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		throw std::runtime_error("Failed to open '" + filename + "' for mapping.");
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		throw std::runtime_error("Failed to get size of '" + filename + "'.");
+	}
+	size = size_t(st.st_size);
+	if (size != 0) {
+		void *ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (ptr == MAP_FAILED) {
+			close(fd);
+			throw std::runtime_error("Failed to map '" + filename + "'.");
+		}
+		data = reinterpret_cast< char const * >(ptr);
+	}
+	close(fd); //(the mapping keeps the file open)
+	#endif
+
+	load_count_bytes_mapped(size);
+}
+
+MappedFile::~MappedFile() {
+	unmap();
+}
+
+MappedFile::MappedFile(MappedFile &&other) {
+	*this = std::move(other);
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) {
+	if (this != &other) {
+		unmap();
+		filename = std::move(other.filename);
+		data = std::exchange(other.data, nullptr);
+		size = std::exchange(other.size, 0);
+		pack = std::move(other.pack);
+		storage = std::move(other.storage);
+		#if defined(_WIN32)
+		mapping = std::exchange(other.mapping, nullptr);
+		#endif
+	}
+	return *this;
+}
+
+void MappedFile::unmap() {
+	if (pack) {
+		//(data belongs to the pack -- or to storage)
+		pack.reset();
+		storage.reset();
+		data = nullptr;
+		size = 0;
+		return;
+	}
+	#if defined(_WIN32)
+	if (data) UnmapViewOfFile(data);
+	if (mapping) CloseHandle(mapping);
+	mapping = nullptr;
+	#else
+	if (data) munmap(const_cast< char * >(data), size);
+	#endif
+	data = nullptr;
+	size = 0;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+/*
+ * MappedFile maps a whole file into memory (read-only).
+ *
+ * Loading through a mapping avoids copying file contents into intermediate buffers:
+ *  data can be handed straight to, e.g., glBufferData, and pages the OS has cached are shared.
+ *
+ * Files in mounted packs (see Pack.hpp) are found there first: their data points into the pack's
+ *  mapping (or, for compressed entries, into a decompressed copy the MappedFile owns).
+ *
+ * See ChunkReader (in read_write_chunk.hpp) for reading chunks from a mapped file.
+ *
+ */
+
+#include <istream>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <cstddef>
+
+struct MappedFile {
+	//map a file (or find it in a mounted pack, unless 'search_packs' is false); throws on failure:
+	MappedFile(std::string const &filename, bool search_packs = true);
+	~MappedFile();
+
+	//the mapping is released when the MappedFile is destroyed, so it isn't copyable (but may be moved):
+	MappedFile(MappedFile const &) = delete;
+	MappedFile &operator=(MappedFile const &) = delete;
+	MappedFile(MappedFile &&);
+	MappedFile &operator=(MappedFile &&);
+
+	std::string filename;
+	char const *data = nullptr; //(nullptr for empty files)
+	size_t size = 0;
+
+	//internals:
+	void unmap();
+	std::shared_ptr< void const > pack; //(for files in packs: keeps the pack -- and so the data -- around)
+	std::unique_ptr< char[] > storage; //(for compressed files in packs: the decompressed data)
+	#if defined(_WIN32)
+	void *mapping = nullptr; //file mapping HANDLE
+	#endif
+};
+
+//std::istream over a range of memory (e.g., part of a MappedFile), for code that reads from streams:
+struct MemoryStream : std::istream {
+	MemoryStream(char const *begin, char const *end) : std::istream(&buf), buf(begin, end) { }
+
+	struct Buf : std::streambuf {
+		Buf(char const *begin, char const *end) {
+			//(std::streambuf wants mutable pointers, but input-only buffers never write through them)
+			setg(const_cast< char * >(begin), const_cast< char * >(begin), const_cast< char * >(end));
+		}
+	} buf;
+};
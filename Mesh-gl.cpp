@@ -0,0 +1,88 @@
+//MeshBuffer's OpenGL side -- creating buffers and vertex array objects.
+// (kept apart from Mesh.cpp so that tools that only prepare and write mesh files, like cook-assets, link without OpenGL)
+
+#include "Mesh.hpp"
+#include "Load.hpp"
+#include "gl_upload_buffer.hpp"
+
+#include <cassert>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+MeshBuffer::MeshBuffer(std::string const &filename) : MeshBuffer(prepare(filename)) {
+}
+
+MeshBuffer::MeshBuffer(Staging const &staging) {
+	meshes = staging.meshes;
+	Position = staging.Position;
+	Normal = staging.Normal;
+	Color = staging.Color;
+	TexCoord = staging.TexCoord;
+
+	//upload data:
+	// (OpenGL calls go to the OpenGL context's thread -- this may be called from a loader worker thread;
+	//  large buffers are streamed in slices, so a worker's upload is spread across frames -- see gl_upload_buffer.hpp)
+	load_on_gl_thread([&](){
+		glGenBuffers(1, &buffer);
+		load_count_gl_objects(1);
+		if (!staging.indices.empty()) {
+			glGenBuffers(1, &index_buffer);
+			load_count_gl_objects(1);
+		}
+	});
+	gl_upload_buffer(buffer, staging.vertices);
+	//(index data is uploaded through copy bindings too: element array bindings belong to vertex array objects)
+	if (!staging.indices.empty()) gl_upload_buffer(index_buffer, staging.indices);
+}
+
+GLuint MeshBuffer::make_vao_for_program(GLuint program, std::vector< std::string > const &per_instance) const {
+	//create a new vertex array object:
+	GLuint vao = 0;
+	glGenVertexArrays(1, &vao);
+	load_count_gl_objects(1);
+	glBindVertexArray(vao);
+
+	//Try to bind all attributes in this buffer:
+	std::set< GLuint > bound;
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	auto bind_attribute = [&](char const *name, MeshBuffer::Attrib const &attrib) {
+		if (attrib.size == 0) return; //don't bind empty attribs
+		GLint location = glGetAttribLocation(program, name);
+		if (location == -1) return; //can't bind missing attribs
+		glVertexAttribPointer(location, attrib.size, attrib.type, attrib.normalized, attrib.stride, (GLbyte *)0 + attrib.offset);
+		glEnableVertexAttribArray(location);
+		bound.insert(location);
+	};
+	bind_attribute("Position", Position);
+	bind_attribute("Normal", Normal);
+	bind_attribute("Color", Color);
+	bind_attribute("TexCoord", TexCoord);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	//(the element array binding is part of the vertex array object's state, so unbind the vao first)
+	if (index_buffer != 0) glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+	glBindVertexArray(0);
+
+	//per-instance attributes are bound later (by whoever owns the instance data):
+	std::set< std::string > skip(per_instance.begin(), per_instance.end());
+
+	//Check that all active attributes were bound:
+	GLint active = 0;
+	glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &active);
+	assert(active >= 0 && "Doesn't makes sense to have negative active attributes.");
+	for (GLuint i = 0; i < GLuint(active); ++i) {
+		GLchar name[100];
+		GLint size = 0;
+		GLenum type = 0;
+		glGetActiveAttrib(program, i, 100, NULL, &size, &type, name);
+		name[99] = '\0';
+		if (skip.count(name)) continue;
+		GLint location = glGetAttribLocation(program, name);
+		if (!bound.count(GLuint(location))) {
+			throw std::runtime_error("ERROR: active attribute '" + std::string(name) + "' in program is not bound.");
+		}
+	}
+
+	return vao;
+}
@@ -1,23 +1,70 @@
 #include "Mesh.hpp"
 #include "read_write_chunk.hpp"
+#include "MappedFile.hpp"
+#include "optimize_mesh.hpp"
 
 #include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
 
 #include <stdexcept>
-#include <fstream>
 #include <iostream>
+#include <iomanip>
+#include <sstream>
 #include <vector>
+#include <algorithm>
 #include <string>
-#include <set>
+#include <unordered_map>
 #include <cstddef>
+#include <cmath>
+#include <cstring>
 
-MeshBuffer::MeshBuffer(std::string const &filename) {
-	glGenBuffers(1, &buffer);
+//SSE is part of the baseline on x86-64 (gcc/clang define __SSE2__; MSVC defines _M_X64):
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MESH_SSE 1
+#include <xmmintrin.h>
+#endif
 
-	std::ifstream file(filename, std::ios::binary);
-
-	GLuint total = 0;
+//bounding box of 'count' positions spaced 'stride' bytes apart (expands *min / *max);
+// returns false if any position has a NaN coordinate (those are left out of the box).
+// NOTE: reads 16 bytes at each position, so there must be at least one more float after each one.
+static bool position_bounds(char const *first, size_t stride, size_t count, glm::vec3 *min, glm::vec3 *max) {
+	#ifdef MESH_SSE
+	//one unaligned load per vertex, ignoring the fourth lane:
+	__m128 lo = _mm_setr_ps(min->x, min->y, min->z, 0.0f);
+	__m128 hi = _mm_setr_ps(max->x, max->y, max->z, 0.0f);
+	__m128 nan = _mm_setzero_ps();
+	for (size_t i = 0; i < count; ++i) {
+		__m128 p = _mm_loadu_ps(reinterpret_cast< float const * >(first + i * stride));
+		nan = _mm_or_ps(nan, _mm_cmpunord_ps(p, p));
+		//(min/max return their second argument when either is NaN, so NaNs don't leak into the box)
+		lo = _mm_min_ps(p, lo);
+		hi = _mm_max_ps(p, hi);
+	}
+	alignas(16) float out[4];
+	_mm_store_ps(out, lo);
+	*min = glm::vec3(out[0], out[1], out[2]);
+	_mm_store_ps(out, hi);
+	*max = glm::vec3(out[0], out[1], out[2]);
+	return (_mm_movemask_ps(nan) & 0x7) == 0;
+	#else
+	bool ok = true;
+	for (size_t i = 0; i < count; ++i) {
+		glm::vec3 p;
+		std::memcpy(&p, first + i * stride, sizeof(p));
+		if (std::isnan(p.x) || std::isnan(p.y) || std::isnan(p.z)) {
+			ok = false;
+			continue;
+		}
+		*min = glm::min(*min, p);
+		*max = glm::max(*max, p);
+	}
+	return ok;
+	#endif
+}
 
+//vertex formats in .pnct files:
+namespace {
+	//"pnct" chunk:
 	struct Vertex {
 		glm::vec3 Position;
 		glm::vec3 Normal;
@@ -25,127 +72,596 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 		glm::vec2 TexCoord;
 	};
 	static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
-	std::vector< Vertex > data;
 
-	//read + upload data chunk:
+	//"pncq" chunk (written after MeshBuffer::quantize):
+	struct QuantizedVertex {
+		glm::u16vec3 Position; //unsigned normalized, relative to the mesh's bounding box
+		uint16_t padding; //(keeps Normal four-byte aligned)
+		uint32_t Normal; //signed normalized, as GL_INT_2_10_10_10_REV
+		glm::u8vec4 Color;
+		uint32_t TexCoord; //two half floats
+	};
+	static_assert(sizeof(QuantizedVertex) == 2*3+2+4+4*1+4, "QuantizedVertex is packed.");
+
+	//"bnd0" chunk (with "pncq", and in files written by MeshBuffer::write): bounding box of each index entry's vertices, which quantized positions are relative to:
+	struct MeshBounds {
+		glm::vec3 min, max;
+	};
+	static_assert(sizeof(MeshBounds) == 6*4, "MeshBounds is packed.");
+
+	void set_attribs(MeshBuffer::Staging *staging, bool quantized) {
+		if (quantized) {
+			staging->Position = MeshBuffer::Attrib(3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(QuantizedVertex), offsetof(QuantizedVertex, Position));
+			staging->Normal = MeshBuffer::Attrib(4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(QuantizedVertex), offsetof(QuantizedVertex, Normal));
+			staging->Color = MeshBuffer::Attrib(4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(QuantizedVertex), offsetof(QuantizedVertex, Color));
+			staging->TexCoord = MeshBuffer::Attrib(2, GL_HALF_FLOAT, GL_FALSE, sizeof(QuantizedVertex), offsetof(QuantizedVertex, TexCoord));
+		} else {
+			staging->Position = MeshBuffer::Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Position));
+			staging->Normal = MeshBuffer::Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Normal));
+			staging->Color = MeshBuffer::Attrib(4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), offsetof(Vertex, Color));
+			staging->TexCoord = MeshBuffer::Attrib(2, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, TexCoord));
+		}
+	}
+	//does a staging buffer have exactly the attribs set_attribs would give it?
+	bool has_attribs(MeshBuffer::Staging const &staging, bool quantized) {
+		MeshBuffer::Staging expected;
+		set_attribs(&expected, quantized);
+		auto same = [](MeshBuffer::Attrib const &a, MeshBuffer::Attrib const &b) {
+			return a.size == b.size && a.type == b.type && a.normalized == b.normalized && a.stride == b.stride && a.offset == b.offset;
+		};
+		return same(staging.Position, expected.Position) && same(staging.Normal, expected.Normal)
+		    && same(staging.Color, expected.Color) && same(staging.TexCoord, expected.TexCoord);
+	}
+
+	//range of vertices used by a mesh:
+	std::pair< GLuint, GLuint > vertex_range(Mesh const &mesh) {
+		if (mesh.index_type != 0) return std::make_pair(GLuint(mesh.base_vertex), GLuint(mesh.base_vertex) + mesh.vertex_count);
+		else return std::make_pair(mesh.start, mesh.start + mesh.count);
+	}
+
+	//meshes in a staging buffer, in order of their vertices:
+	std::vector< std::pair< NameID, Mesh > > meshes_in_order(MeshBuffer::Staging const &staging) {
+		std::vector< std::pair< NameID, Mesh > > meshes;
+		meshes.reserve(staging.meshes.size());
+		for (auto const &slot : staging.meshes) {
+			meshes.emplace_back(slot.name, slot.value);
+		}
+		std::stable_sort(meshes.begin(), meshes.end(), [](auto const &a, auto const &b) {
+			return vertex_range(a.second) < vertex_range(b.second);
+		});
+		return meshes;
+	}
+}
+
+MeshBuffer::Staging MeshBuffer::prepare(std::string const &filename) {
+	Staging staging;
+	staging.filename = filename;
+
+	//chunks are read in place from the mapped file (no intermediate copies):
+	// (in any order, so files with a chunk directory may store them in any order)
+	staging.file = std::make_unique< MappedFile >(filename);
+	staging.reader = std::make_unique< ChunkReader >(*staging.file);
+	ChunkReader const &reader = *staging.reader;
+
+	GLuint total = 0;
+
+	std::span< Vertex const > data;
+	bool quantized = false;
+	std::span< MeshBounds const > bounds; //(stored bounds of each mesh, if used; otherwise bounds are computed from the vertices)
+
+	//read data chunk (uploaded later, by the MeshBuffer(Staging) constructor):
 	if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".pnct") {
-		read_chunk(file, "pnct", &data);
+		if (reader.find("pncq")) {
+			std::span< QuantizedVertex const > vertices = reader.read< QuantizedVertex >("pncq");
+			staging.vertices = std::span< char const >(reinterpret_cast< char const * >(vertices.data()), vertices.size_bytes());
+			total = GLuint(vertices.size());
+			bounds = reader.read< MeshBounds >("bnd0");
+			set_attribs(&staging, true);
+			quantized = true;
+		} else {
+			data = reader.read< Vertex >("pnct");
+			staging.vertices = std::span< char const >(reinterpret_cast< char const * >(data.data()), data.size() * sizeof(Vertex));
 
-		//upload data:
-		//notes: bind first, then unbind
-		glBindBuffer(GL_ARRAY_BUFFER, buffer);
-		glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(Vertex), data.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+			total = GLuint(data.size()); //store total for later checks on index
 
-		total = GLuint(data.size()); //store total for later checks on index
+			//store attrib locations:
+			set_attribs(&staging, false);
 
-		//store attrib locations:
-		Position = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Position));
-		Normal = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Normal));
-		Color = Attrib(4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), offsetof(Vertex, Color));
-		TexCoord = Attrib(2, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, TexCoord));
+			//stored bounds (written by MeshBuffer::write) are only used when checksums tie them to these vertices:
+			// (a directory-less file -- or one read without verify -- might have a stale "bnd0")
+			ChunkReader::Entry const *pnct = reader.find("pnct");
+			ChunkReader::Entry const *bnd0 = reader.find("bnd0");
+			if (reader.verify && pnct->has_crc32 && bnd0 && bnd0->has_crc32) {
+				bounds = reader.read< MeshBounds >("bnd0");
+			}
+		}
 	} else {
 		throw std::runtime_error("Unknown file type '" + filename + "'");
 	}
 
-	std::vector< char > strings;
-	read_chunk(file, "str0", &strings);
+	std::span< char const > strings = reader.read< char >("str0");
+
+	//check an index entry's name and vertex range, compute bounds, and add the mesh:
+	uint32_t entries = 0;
+	auto add_mesh = [&](uint32_t name_begin, uint32_t name_end, uint32_t vertex_begin, uint32_t vertex_end, Mesh mesh) {
+		uint32_t entry = entries++;
+		if (!(name_begin <= name_end && name_end <= strings.size())) {
+			throw std::runtime_error("index entry has out-of-range name begin/end");
+		}
+		if (!(vertex_begin <= vertex_end && vertex_end <= total)) {
+			throw std::runtime_error("index entry has out-of-range vertex start/count");
+		}
+		std::string_view name(strings.data() + name_begin, name_end - name_begin);
+		if (quantized || !bounds.empty()) {
+			if (entry >= bounds.size()) {
+				throw std::runtime_error("index entry has no bounds");
+			}
+			mesh.min = bounds[entry].min;
+			mesh.max = bounds[entry].max;
+			if (quantized) {
+				//quantized positions are fractions of the stored bounds:
+				mesh.position_offset = mesh.min;
+				mesh.position_scale = glm::max(mesh.max - mesh.min, glm::vec3(0.0f));
+			}
+		} else {
+			//bounds (and a check for bad positions) in one pass over the mapped vertices:
+			// (Position is followed by Normal, so reading 16 bytes at each Position is fine)
+			static_assert(offsetof(Vertex, Position) + 16 <= sizeof(Vertex), "can read 16 bytes at Position");
+			if (!position_bounds(reinterpret_cast< char const * >(data.data()) + vertex_begin * sizeof(Vertex) + offsetof(Vertex, Position), sizeof(Vertex), vertex_end - vertex_begin, &mesh.min, &mesh.max)) {
+				std::cerr << "WARNING: mesh '" << name << "' in filename '" << filename << "' has NaN vertex positions." << std::endl;
+			}
+		}
+		bool inserted = staging.meshes.insert(NameID(name), mesh).second;
+		if (!inserted) {
+			std::cerr << "WARNING: mesh name '" << name << "' in filename '" << filename << "' collides with existing mesh." << std::endl;
+		}
+	};
 
-	{ //read index chunk, add to meshes:
+	if (reader.find("idx1")) { //indexed file: read index chunk, index data, add to meshes:
+		//each mesh is a range of indices (into "ix16" or "ix32") that refer to a range of vertices:
+		// (indices are relative to the mesh's vertex_begin, so 16 bits is enough for meshes of up to 65536 vertices)
 		struct IndexEntry {
 			uint32_t name_begin, name_end;
 			uint32_t vertex_begin, vertex_end;
+			uint32_t index_begin, index_end;
 		};
-		static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
+		static_assert(sizeof(IndexEntry) == 24, "Index entry should be packed");
 
-		std::vector< IndexEntry > index;
-		read_chunk(file, "idx0", &index);
+		std::span< IndexEntry const > index = reader.read< IndexEntry >("idx1");
+
+		std::span< uint16_t const > indices16;
+		std::span< uint32_t const > indices32;
+		GLenum index_type;
+		size_t index_total;
+		if (reader.find("ix16")) {
+			indices16 = reader.read< uint16_t >("ix16");
+			staging.indices = std::span< char const >(reinterpret_cast< char const * >(indices16.data()), indices16.size_bytes());
+			index_type = GL_UNSIGNED_SHORT;
+			index_total = indices16.size();
+		} else {
+			indices32 = reader.read< uint32_t >("ix32");
+			staging.indices = std::span< char const >(reinterpret_cast< char const * >(indices32.data()), indices32.size_bytes());
+			index_type = GL_UNSIGNED_INT;
+			index_total = indices32.size();
+		}
 
 		for (auto const &entry : index) {
-			if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
-				throw std::runtime_error("index entry has out-of-range name begin/end");
+			if (!(entry.index_begin <= entry.index_end && entry.index_end <= index_total)) {
+				throw std::runtime_error("index entry has out-of-range index start/count");
 			}
-			if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= total)) {
-				throw std::runtime_error("index entry has out-of-range vertex start/count");
+			//every index must refer to one of the mesh's own vertices:
+			uint32_t vertex_count = entry.vertex_end - entry.vertex_begin; //(range is checked by add_mesh)
+			auto in_range = [&](auto const &indices) {
+				for (uint32_t i = entry.index_begin; i < entry.index_end; ++i) {
+					if (indices[i] >= vertex_count) return false;
+				}
+				return true;
+			};
+			if (entry.vertex_begin > entry.vertex_end || !(index_type == GL_UNSIGNED_SHORT ? in_range(indices16) : in_range(indices32))) {
+				throw std::runtime_error("index entry has out-of-range indices");
 			}
-			std::string name(&strings[0] + entry.name_begin, &strings[0] + entry.name_end);
+
+			Mesh mesh;
+			mesh.type = GL_TRIANGLES;
+			mesh.start = entry.index_begin;
+			mesh.count = entry.index_end - entry.index_begin;
+			mesh.index_type = index_type;
+			mesh.base_vertex = GLint(entry.vertex_begin);
+			mesh.vertex_count = vertex_count;
+			add_mesh(entry.name_begin, entry.name_end, entry.vertex_begin, entry.vertex_end, mesh);
+		}
+	} else { //read index chunk, add to meshes:
+		struct IndexEntry {
+			uint32_t name_begin, name_end;
+			uint32_t vertex_begin, vertex_end;
+		};
+		static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
+
+		std::span< IndexEntry const > index = reader.read< IndexEntry >("idx0");
+
+		for (auto const &entry : index) {
 			Mesh mesh;
 			mesh.type = GL_TRIANGLES;
 			mesh.start = entry.vertex_begin;
 			mesh.count = entry.vertex_end - entry.vertex_begin;
-			for (uint32_t v = entry.vertex_begin; v < entry.vertex_end; ++v) {
-				mesh.min = glm::min(mesh.min, data[v].Position);
-				mesh.max = glm::max(mesh.max, data[v].Position);
-			}
-			bool inserted = meshes.insert(std::make_pair(name, mesh)).second;
-			if (!inserted) {
-				std::cerr << "WARNING: mesh name '" + name + "' in filename '" + filename + "' collides with existing mesh." << std::endl;
-			}
+			add_mesh(entry.name_begin, entry.name_end, entry.vertex_begin, entry.vertex_end, mesh);
 		}
 	}
 
-	if (file.peek() != EOF) {
+	if (reader.trailing) {
 		std::cerr << "WARNING: trailing data in mesh file '" << filename << "'" << std::endl;
 	}
 
 	/* //DEBUG:
 	std::cout << "File '" << filename << "' contained meshes";
-	for (auto const &m : meshes) {
-		if (&m.second == &meshes.rbegin()->second && meshes.size() > 1) std::cout << " and";
-		std::cout << " '" << m.first << "'";
-		if (&m.second != &meshes.rbegin()->second) std::cout << ",";
+	for (auto const &m : staging.meshes) {
+		std::cout << " '" << m.name.str() << "'";
 	}
 	std::cout << std::endl;
 	*/
+
+	return staging;
+}
+
+void MeshBuffer::optimize(Staging *staging_, std::ostream *report) {
+	assert(staging_);
+	Staging &staging = *staging_;
+
+	if (staging.Position.size != 3 || staging.Position.type != GL_FLOAT) {
+		throw std::runtime_error("Can't optimize meshes in '" + staging.filename + "': positions aren't three floats.");
+	}
+	size_t stride = size_t(staging.Position.stride);
+
+	//meshes in file order (so the rewritten data is in the same order):
+	std::vector< std::pair< NameID, Mesh > > meshes = meshes_in_order(staging);
+
+	std::ostringstream out;
+	out << std::fixed << std::setprecision(2);
+	out << "Optimized meshes in '" << staging.filename << "' (ACMR and ATVR for a 16-entry FIFO vertex cache):\n";
+	VertexCacheStats total_before, total_after;
+
+	std::vector< char > vertices;
+	std::vector< uint32_t > indices;
+	std::vector< std::pair< NameID, Mesh > > optimized;
+	optimized.reserve(meshes.size());
+	uint32_t max_vertex_count = 0;
+	for (auto &[name, mesh] : meshes) {
+		if (mesh.type != GL_TRIANGLES) {
+			throw std::runtime_error("Can't optimize mesh '" + std::string(name.str()) + "': not a triangle list.");
+		}
+
+		//this mesh's vertices (first[order[i] * stride]) and indices into them:
+		char const *first;
+		std::vector< uint32_t > order;
+		std::vector< uint32_t > local;
+		VertexCacheStats before;
+		if (mesh.index_type == 0) {
+			first = staging.vertices.data() + mesh.start * stride;
+			order = weld_vertices(first, stride, mesh.count, &local);
+			//(drawn un-indexed, every vertex is transformed)
+			before.triangles = mesh.count / 3;
+			before.vertices = uint32_t(order.size());
+			before.transforms = mesh.count;
+		} else {
+			first = staging.vertices.data() + mesh.base_vertex * stride;
+			order.resize(mesh.vertex_count);
+			for (uint32_t i = 0; i < mesh.vertex_count; ++i) order[i] = i;
+			local.resize(mesh.count);
+			for (uint32_t i = 0; i < mesh.count; ++i) {
+				if (mesh.index_type == GL_UNSIGNED_SHORT) local[i] = reinterpret_cast< uint16_t const * >(staging.indices.data())[mesh.start + i];
+				else local[i] = reinterpret_cast< uint32_t const * >(staging.indices.data())[mesh.start + i];
+			}
+			before = analyze_vertex_cache(local, mesh.vertex_count);
+		}
+		if (local.size() % 3 != 0) {
+			throw std::runtime_error("Can't optimize mesh '" + std::string(name.str()) + "': vertex count isn't a multiple of three.");
+		}
+
+		std::vector< glm::vec3 > positions(order.size());
+		for (uint32_t i = 0; i < order.size(); ++i) {
+			std::memcpy(&positions[i], first + order[i] * stride + staging.Position.offset, sizeof(glm::vec3));
+		}
+
+		optimize_vertex_cache(local, uint32_t(order.size()));
+		optimize_overdraw(local, positions);
+		std::vector< uint32_t > fetch = optimize_vertex_fetch(local, uint32_t(order.size()));
+		VertexCacheStats after = analyze_vertex_cache(local, uint32_t(fetch.size()));
+
+		Mesh result = mesh;
+		result.start = GLuint(indices.size());
+		result.count = GLuint(local.size());
+		result.base_vertex = GLint(vertices.size() / stride);
+		result.vertex_count = GLuint(fetch.size());
+		max_vertex_count = std::max(max_vertex_count, result.vertex_count);
+		optimized.emplace_back(name, result);
+
+		for (uint32_t f : fetch) {
+			char const *vertex = first + order[f] * stride;
+			vertices.insert(vertices.end(), vertex, vertex + stride);
+		}
+		indices.insert(indices.end(), local.begin(), local.end());
+
+		out << "  '" << name.str() << "': " << before.triangles << " triangles, " << before.vertices << " vertices; ACMR "
+			<< before.acmr() << " -> " << after.acmr() << ", ATVR " << before.atvr() << " -> " << after.atvr() << "\n";
+		total_before.triangles += before.triangles; total_before.vertices += before.vertices; total_before.transforms += before.transforms;
+		total_after.triangles += after.triangles; total_after.vertices += after.vertices; total_after.transforms += after.transforms;
+	}
+	out << "  (all): " << total_before.triangles << " triangles, " << total_before.vertices << " vertices; ACMR "
+		<< total_before.acmr() << " -> " << total_after.acmr() << ", ATVR " << total_before.atvr() << " -> " << total_after.atvr() << "\n";
+
+	//indices are relative to each mesh's first vertex, so 16 bits suffice unless some mesh is very large:
+	GLenum index_type = (max_vertex_count <= 0x10000 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT);
+	std::vector< char > index_storage(indices.size() * (index_type == GL_UNSIGNED_SHORT ? 2 : 4));
+	if (index_type == GL_UNSIGNED_SHORT) {
+		for (size_t i = 0; i < indices.size(); ++i) {
+			uint16_t index = uint16_t(indices[i]);
+			std::memcpy(index_storage.data() + 2 * i, &index, 2);
+		}
+	} else {
+		std::memcpy(index_storage.data(), indices.data(), index_storage.size());
+	}
+	staging.meshes = NameMap< Mesh >();
+	for (auto &[name, mesh] : optimized) {
+		mesh.index_type = index_type;
+		staging.meshes.insert(name, mesh);
+	}
+	staging.vertex_storage = std::move(vertices);
+	staging.index_storage = std::move(index_storage);
+	staging.vertices = std::span< char const >(staging.vertex_storage.data(), staging.vertex_storage.size());
+	staging.indices = std::span< char const >(staging.index_storage.data(), staging.index_storage.size());
+	//(the file is no longer needed)
+	staging.reader.reset();
+	staging.file.reset();
+
+	if (report) *report << out.str();
 }
 
-const Mesh &MeshBuffer::lookup(std::string const &name) const {
-	auto f = meshes.find(name);
-	if (f == meshes.end()) {
-		throw std::runtime_error("Looking up mesh '" + name + "' that doesn't exist.");
+void MeshBuffer::quantize(Staging *staging_, std::ostream *report) {
+	assert(staging_);
+	Staging &staging = *staging_;
+
+	if (!has_attribs(staging, false)) {
+		throw std::runtime_error("Can't quantize meshes in '" + staging.filename + "': vertices aren't in the .pnct format.");
+	}
+	if (staging.vertices.size() % sizeof(Vertex) != 0) {
+		throw std::runtime_error("Can't quantize meshes in '" + staging.filename + "': vertex data is not a whole number of vertices.");
+	}
+	uint32_t total = uint32_t(staging.vertices.size() / sizeof(Vertex));
+
+	std::vector< std::pair< NameID, Mesh > > meshes = meshes_in_order(staging);
+
+	//each vertex is quantized relative to its mesh's bounds, so meshes can't share vertices:
+	// (unless they share all of them -- as merge_duplicates() leaves them -- and so have the same bounds)
+	for (size_t i = 1; i < meshes.size(); ++i) {
+		auto range = vertex_range(meshes[i].second), previous = vertex_range(meshes[i-1].second);
+		if (range.first < previous.second && range != previous) {
+			throw std::runtime_error("Can't quantize meshes in '" + staging.filename + "': meshes '" + std::string(meshes[i-1].first.str()) + "' and '" + std::string(meshes[i].first.str()) + "' share vertices.");
+		}
+	}
+
+	std::ostringstream out;
+	out << "Quantized meshes in '" << staging.filename << "' (largest errors; position error also as a fraction of bounding box diagonal):\n";
+	float all_position_error = 0.0f, all_normal_error = 0.0f, all_texcoord_error = 0.0f;
+
+	std::vector< char > storage(total * sizeof(QuantizedVertex), 0);
+	for (uint32_t i = 0; i < total; ++i) {
+		//(vertices not in any mesh keep zero positions)
+		Vertex v;
+		std::memcpy(&v, staging.vertices.data() + i * sizeof(Vertex), sizeof(Vertex));
+		QuantizedVertex q;
+		q.Position = glm::u16vec3(0);
+		q.padding = 0;
+		q.Normal = glm::packSnorm3x10_1x2(glm::vec4(v.Normal, 0.0f));
+		q.Color = v.Color;
+		q.TexCoord = glm::packHalf2x16(v.TexCoord);
+		std::memcpy(storage.data() + i * sizeof(QuantizedVertex), &q, sizeof(QuantizedVertex));
+	}
+
+	staging.meshes = NameMap< Mesh >();
+	for (auto &[name, mesh] : meshes) {
+		auto [begin, end] = vertex_range(mesh);
+		if (end > total) {
+			throw std::runtime_error("Can't quantize mesh '" + std::string(name.str()) + "': vertex range is out of the buffer.");
+		}
+
+		//(meshes with no -- or only NaN -- positions have empty bounds, and all their positions become the offset)
+		glm::vec3 extent = glm::max(mesh.max - mesh.min, glm::vec3(0.0f));
+		if (!(mesh.min.x <= mesh.max.x && mesh.min.y <= mesh.max.y && mesh.min.z <= mesh.max.z)) {
+			mesh.min = mesh.max = glm::vec3(0.0f);
+			extent = glm::vec3(0.0f);
+		}
+		mesh.position_offset = mesh.min;
+		mesh.position_scale = extent;
+
+		float position_error = 0.0f, normal_error = 0.0f, texcoord_error = 0.0f;
+		for (uint32_t i = begin; i < end; ++i) {
+			Vertex v;
+			std::memcpy(&v, staging.vertices.data() + i * sizeof(Vertex), sizeof(Vertex));
+			QuantizedVertex q;
+			std::memcpy(&q, storage.data() + i * sizeof(QuantizedVertex), sizeof(QuantizedVertex));
+
+			for (uint32_t c = 0; c < 3; ++c) {
+				float f = (extent[c] > 0.0f ? (v.Position[c] - mesh.min[c]) / extent[c] : 0.0f);
+				if (!(f >= 0.0f)) f = 0.0f; //(also catches NaN)
+				q.Position[c] = uint16_t(std::round(std::min(f, 1.0f) * 65535.0f));
+				if (!std::isnan(v.Position[c])) {
+					float decoded = mesh.position_offset[c] + mesh.position_scale[c] * (q.Position[c] / 65535.0f);
+					position_error = std::max(position_error, std::abs(decoded - v.Position[c]));
+				}
+			}
+			float length = glm::length(v.Normal);
+			if (length > 0.0f) {
+				glm::vec3 decoded = glm::vec3(glm::unpackSnorm3x10_1x2(q.Normal));
+				if (glm::length(decoded) > 0.0f) {
+					float cos_angle = glm::clamp(glm::dot(v.Normal / length, glm::normalize(decoded)), -1.0f, 1.0f);
+					normal_error = std::max(normal_error, glm::degrees(std::acos(cos_angle)));
+				} else {
+					normal_error = 180.0f;
+				}
+			}
+			glm::vec2 decoded_texcoord = glm::unpackHalf2x16(q.TexCoord);
+			texcoord_error = std::max(texcoord_error, glm::max(std::abs(decoded_texcoord.x - v.TexCoord.x), std::abs(decoded_texcoord.y - v.TexCoord.y)));
+
+			std::memcpy(storage.data() + i * sizeof(QuantizedVertex), &q, sizeof(QuantizedVertex));
+		}
+
+		float diagonal = glm::length(extent);
+		out << "  '" << name.str() << "': position " << position_error << " (" << (diagonal > 0.0f ? position_error / diagonal : 0.0f)
+			<< "), normal " << normal_error << " degrees, texcoord " << texcoord_error << "\n";
+		all_position_error = std::max(all_position_error, position_error);
+		all_normal_error = std::max(all_normal_error, normal_error);
+		all_texcoord_error = std::max(all_texcoord_error, texcoord_error);
+
+		staging.meshes.insert(name, mesh);
 	}
-	return f->second;
+	out << "  (all): position " << all_position_error << ", normal " << all_normal_error << " degrees, texcoord " << all_texcoord_error
+		<< "; " << staging.vertices.size() << " -> " << storage.size() << " bytes of vertices\n";
+
+	staging.vertex_storage = std::move(storage);
+	staging.vertices = std::span< char const >(staging.vertex_storage.data(), staging.vertex_storage.size());
+	set_attribs(&staging, true);
+
+	if (report) *report << out.str();
 }
 
-GLuint MeshBuffer::make_vao_for_program(GLuint program) const {
-	//create a new vertex array object:
-	GLuint vao = 0;
-	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
-
-	//Try to bind all attributes in this buffer:
-	std::set< GLuint > bound;
-	glBindBuffer(GL_ARRAY_BUFFER, buffer);
-	auto bind_attribute = [&](char const *name, MeshBuffer::Attrib const &attrib) {
-		if (attrib.size == 0) return; //don't bind empty attribs
-		GLint location = glGetAttribLocation(program, name);
-		if (location == -1) return; //can't bind missing attribs
-		glVertexAttribPointer(location, attrib.size, attrib.type, attrib.normalized, attrib.stride, (GLbyte *)0 + attrib.offset);
-		glEnableVertexAttribArray(location);
-		bound.insert(location);
+void MeshBuffer::merge_duplicates(Staging *staging_, std::ostream *report) {
+	assert(staging_);
+	Staging &staging = *staging_;
+
+	size_t stride = size_t(staging.Position.stride);
+	if (stride == 0 || staging.vertices.size() % stride != 0) {
+		throw std::runtime_error("Can't merge meshes in '" + staging.filename + "': vertex data is not a whole number of vertices.");
+	}
+	size_t total = staging.vertices.size() / stride;
+
+	std::vector< std::pair< NameID, Mesh > > meshes = meshes_in_order(staging);
+
+	//a mesh's contents -- its vertices, indices, and (for quantized vertices) how to decode them -- as bytes:
+	auto contents = [&](Mesh const &mesh) {
+		auto [begin, end] = vertex_range(mesh);
+		if (end > total) {
+			throw std::runtime_error("Can't merge meshes in '" + staging.filename + "': vertex range is out of the buffer.");
+		}
+		std::string ret(staging.vertices.data() + begin * stride, (end - begin) * stride);
+		if (mesh.index_type != 0) {
+			size_t size = (mesh.index_type == GL_UNSIGNED_SHORT ? 2 : 4);
+			if ((mesh.start + mesh.count) * size > staging.indices.size()) {
+				throw std::runtime_error("Can't merge meshes in '" + staging.filename + "': index range is out of the buffer.");
+			}
+			ret.append(staging.indices.data() + mesh.start * size, mesh.count * size);
+		}
+		auto append = [&ret](auto const &value) {
+			ret.append(reinterpret_cast< char const * >(&value), sizeof(value));
+		};
+		append(mesh.type);
+		append(mesh.index_type);
+		append(mesh.position_offset);
+		append(mesh.position_scale);
+		return ret;
 	};
-	bind_attribute("Position", Position);
-	bind_attribute("Normal", Normal);
-	bind_attribute("Color", Color);
-	bind_attribute("TexCoord", TexCoord);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindVertexArray(0);
-
-	//Check that all active attributes were bound:
-	GLint active = 0;
-	glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &active);
-	assert(active >= 0 && "Doesn't makes sense to have negative active attributes.");
-	for (GLuint i = 0; i < GLuint(active); ++i) {
-		GLchar name[100];
-		GLint size = 0;
-		GLenum type = 0;
-		glGetActiveAttrib(program, i, 100, NULL, &size, &type, name);
-		name[99] = '\0';
-		GLint location = glGetAttribLocation(program, name);
-		if (!bound.count(GLuint(location))) {
-			throw std::runtime_error("ERROR: active attribute '" + std::string(name) + "' in program is not bound.");
-		}
-	}
-
-	return vao;
+
+	//copy each distinct mesh's data (in order) into new storage; duplicates point at the first copy:
+	std::vector< char > vertex_storage, index_storage;
+	std::unordered_map< std::string, Mesh > distinct;
+	uint32_t merged = 0;
+	size_t merged_bytes = 0;
+	for (auto &[name, mesh] : meshes) {
+		auto [begin, end] = vertex_range(mesh);
+		auto f = distinct.emplace(contents(mesh), Mesh());
+		if (!f.second) {
+			Mesh const &first = f.first->second;
+			mesh.start = first.start;
+			mesh.base_vertex = first.base_vertex;
+			merged += 1;
+			merged_bytes += (end - begin) * stride + (mesh.index_type == 0 ? 0 : mesh.count * (mesh.index_type == GL_UNSIGNED_SHORT ? 2 : 4));
+			continue;
+		}
+		GLuint vertex_begin = GLuint(vertex_storage.size() / stride);
+		vertex_storage.insert(vertex_storage.end(), staging.vertices.begin() + begin * stride, staging.vertices.begin() + end * stride);
+		if (mesh.index_type != 0) {
+			size_t size = (mesh.index_type == GL_UNSIGNED_SHORT ? 2 : 4);
+			GLuint index_begin = GLuint(index_storage.size() / size);
+			index_storage.insert(index_storage.end(), staging.indices.begin() + mesh.start * size, staging.indices.begin() + (mesh.start + mesh.count) * size);
+			mesh.start = index_begin;
+			mesh.base_vertex = GLint(vertex_begin);
+		} else {
+			mesh.start = vertex_begin;
+		}
+		f.first->second = mesh;
+	}
+
+	if (report) {
+		*report << "Merged " << merged << " duplicate meshes (of " << meshes.size() << ") in '" << staging.filename << "', saving " << merged_bytes << " bytes.\n";
+	}
+	if (merged == 0) return;
+
+	staging.meshes = NameMap< Mesh >();
+	for (auto const &[name, mesh] : meshes) {
+		staging.meshes.insert(name, mesh);
+	}
+	staging.vertex_storage = std::move(vertex_storage);
+	staging.vertices = std::span< char const >(staging.vertex_storage.data(), staging.vertex_storage.size());
+	if (!staging.indices.empty()) {
+		staging.index_storage = std::move(index_storage);
+		staging.indices = std::span< char const >(staging.index_storage.data(), staging.index_storage.size());
+	}
+}
+
+void MeshBuffer::write(Staging const &staging, std::ostream *to, bool compress) {
+	assert(to);
+
+	bool quantized = has_attribs(staging, true);
+	if (!quantized && !has_attribs(staging, false)) {
+		throw std::runtime_error("Can't write meshes from '" + staging.filename + "': vertices aren't in a .pnct format.");
+	}
+
+	std::vector< std::pair< NameID, Mesh > > meshes = meshes_in_order(staging);
+	bool indexed = !staging.indices.empty();
+	GLenum index_type = 0;
+	for (auto const &[name, mesh] : meshes) {
+		if (mesh.type != GL_TRIANGLES || (mesh.index_type != 0) != indexed || (index_type != 0 && mesh.index_type != index_type)) {
+			throw std::runtime_error("Can't write mesh '" + std::string(name.str()) + "': .pnct files hold triangle lists that are either all indexed (with one index type) or not.");
+		}
+		index_type = mesh.index_type;
+	}
+
+	ChunkWriter writer; //(chunk data aligned, so it can be used in place when loaded)
+
+	writer.add(quantized ? "pncq" : "pnct", std::vector< char >(staging.vertices.begin(), staging.vertices.end()), compress);
+
+	std::vector< char > strings;
+	std::vector< uint32_t > index; //(IndexEntry layouts from prepare(): six words per entry if indexed, otherwise four)
+	std::vector< MeshBounds > bounds; //(written for all files: quantized positions are relative to them; prepare() uses them in place of a pass over float vertices)
+	for (auto const &[name, mesh] : meshes) {
+		uint32_t name_begin = uint32_t(strings.size());
+		strings.insert(strings.end(), name.str().begin(), name.str().end());
+		auto [vertex_begin, vertex_end] = vertex_range(mesh);
+		index.insert(index.end(), { name_begin, uint32_t(strings.size()), vertex_begin, vertex_end });
+		if (indexed) index.insert(index.end(), { mesh.start, mesh.start + mesh.count });
+		bounds.emplace_back(MeshBounds{ mesh.min, mesh.max });
+	}
+	writer.add("str0", strings);
+	writer.add(indexed ? "idx1" : "idx0", index);
+	if (indexed) {
+		writer.add(index_type == GL_UNSIGNED_SHORT ? "ix16" : "ix32", std::vector< char >(staging.indices.begin(), staging.indices.end()), compress);
+	}
+	writer.add("bnd0", bounds);
+
+	writer.write(to);
+}
+
+const Mesh &MeshBuffer::lookup(std::string_view name) const {
+	Mesh const *mesh = meshes.find(name);
+	if (!mesh) {
+		throw std::runtime_error("Looking up mesh '" + std::string(name) + "' that doesn't exist.");
+	}
+	return *mesh;
+}
+
+const Mesh &MeshBuffer::lookup(NameID name) const {
+	Mesh const *mesh = meshes.find(name);
+	if (!mesh) {
+		throw std::runtime_error("Looking up mesh '" + std::string(name.str()) + "' that doesn't exist.");
+	}
+	return *mesh;
 }
@@ -1,27 +1,48 @@
 #pragma once
 
 /*
- * In this code, "Mesh" is a range of vertices that should be sent through
- *  the OpenGL pipeline together.
+ * In this code, "Mesh" is a range of vertices (or of indices into a range of
+ *  vertices) that should be sent through the OpenGL pipeline together.
  * A "MeshBuffer" holds a collection of such meshes (loaded from a file) in
- *  a single OpenGL array buffer. Individual meshes can be looked up by name
- *  using the MeshBuffer::lookup() function.
+ *  a single OpenGL array buffer (plus, for indexed files, an index buffer).
+ *  Individual meshes can be looked up by name using the MeshBuffer::lookup() function.
+ *
+ * MeshBuffers can be loaded in two phases (see Load.hpp):
+ *  MeshBuffer::prepare() reads and checks a file on any thread, and
+ *  the MeshBuffer(Staging) constructor uploads the result on the OpenGL thread.
  *
  */
 
 #include "GL.hpp"
+#include "MappedFile.hpp"
+#include "NameMap.hpp"
+#include "read_write_chunk.hpp"
 #include <glm/glm.hpp>
-#include <map>
+#include <iosfwd>
 #include <limits>
+#include <memory>
+#include <span>
 #include <string>
+#include <string_view>
+#include <vector>
 
 
 struct Mesh {
 	//Meshes are vertex ranges (and primitive types) in their MeshBuffer:
 
 	GLenum type = GL_TRIANGLES; //type of primitives in mesh
-	GLuint start = 0; //index of first vertex
-	GLuint count = 0; //count of vertices
+	GLuint start = 0; //index of first vertex (indexed meshes: of first index)
+	GLuint count = 0; //count of vertices (indexed meshes: of indices)
+
+	//...or, for meshes from indexed files, index ranges (drawn with glDrawRangeElementsBaseVertex):
+	GLenum index_type = 0; //GL_UNSIGNED_SHORT or GL_UNSIGNED_INT for indexed meshes; 0 for vertex ranges (drawn with glDrawArrays)
+	GLint base_vertex = 0; //first vertex of the mesh (indices are relative to this)
+	GLuint vertex_count = 0; //count of vertices the indices refer to
+
+	//meshes with quantized positions store them relative to their bounding box;
+	// object-space position == position_offset + position_scale * Position attribute:
+	glm::vec3 position_offset = glm::vec3(0.0f);
+	glm::vec3 position_scale = glm::vec3(1.0f);
 
 	//Bounding box.
 	//useful for debug visualization and (perhaps, eventually) collision detection:
@@ -30,25 +51,57 @@ struct Mesh {
 };
 
 struct MeshBuffer {
-	//construct from a file:
+	struct Staging;
+
+	//construct from a file (same as MeshBuffer(prepare(filename))):
 	// note: will throw if file fails to read.
+	// note: may be called from a LoadThreadWorker load function (the upload goes through load_on_gl_thread)
 	MeshBuffer(std::string const &filename);
 
-	//look up a particular mesh by name:
+	//two-phase loading -- read + check a file (no OpenGL calls; safe on any thread):
+	// note: will throw if file fails to read.
+	static Staging prepare(std::string const &filename);
+	//...(optionally) reorder every mesh's triangles and vertices for the GPU's vertex cache, overdraw, and vertex fetch
+	//  (see optimize_mesh.hpp; no OpenGL calls either). Un-indexed meshes become indexed.
+	//  if 'report' is given, writes each mesh's vertex cache statistics (ACMR/ATVR) before and after:
+	static void optimize(Staging *staging, std::ostream *report = nullptr);
+	//...(optionally) convert vertices to a compact (20-byte) format: positions as 16-bit fractions of each mesh's
+	//  bounding box, normals as 10:10:10 signed normalized integers, texture coordinates as half floats.
+	//  (callers must copy Mesh::position_offset/position_scale into drawables -- see Scene::Drawable::Pipeline)
+	//  if 'report' is given, writes each mesh's largest quantization errors:
+	static void quantize(Staging *staging, std::ostream *report = nullptr);
+	//...(optionally) make meshes with identical contents share one copy of their vertices and indices:
+	//  if 'report' is given, writes how many meshes were merged:
+	static void merge_duplicates(Staging *staging, std::ostream *report = nullptr);
+	//...(optionally) save the result as a .pnct file (e.g., from an offline tool -- see cook-assets.cpp):
+	//  ('compress' stores the vertex and index chunks compressed -- smaller files, but prepare() must decompress them)
+	static void write(Staging const &staging, std::ostream *to, bool compress = false);
+	//...then create the vertex buffer (OpenGL calls: sent to the main thread with load_on_gl_thread if needed):
+	//  (large buffers are streamed in slices -- see gl_upload_buffer.hpp -- so, called from a worker thread, the upload
+	//   is spread over several frames of update_load_functions; called on the main thread, it finishes before returning)
+	explicit MeshBuffer(Staging const &staging);
+
+	//look up a particular mesh by name (or by interned name, which is faster -- see Scene::upload):
 	// note: will throw if mesh not found.
-	const Mesh &lookup(std::string const &name) const;
+	const Mesh &lookup(std::string_view name) const;
+	const Mesh &lookup(NameID name) const;
 	
 	//build a vertex array object that links this vbo to attributes to a program:
+	// note: makes OpenGL calls, so call on the OpenGL context's thread
 	// note: will throw if program defines attributes not contained in this buffer
-	GLuint make_vao_for_program(GLuint program) const;
+	//  (other than those listed in 'per_instance', which the caller will point at an instance buffer -- see Scene::Drawable::Pipeline::Instanced)
+	GLuint make_vao_for_program(GLuint program, std::vector< std::string > const &per_instance = {}) const;
 
 	//This is the OpenGL vertex buffer object containing the mesh data:
 	GLuint buffer = 0;
+	//...and the buffer object containing indices (for indexed files; otherwise zero):
+	// (make_vao_for_program() binds this as the vertex array's GL_ELEMENT_ARRAY_BUFFER)
+	GLuint index_buffer = 0;
 
 	//-- internals ---
 
 	//used by the lookup() function:
-	std::map< std::string, Mesh > meshes;
+	NameMap< Mesh > meshes;
 
 	//These 'Attrib' structures describe the location of various attributes within the buffer (in exactly format wanted by glVertexAttribPointer). They are set when the file is loaded and are used by the "make_vao_for_program" call:
 	struct Attrib {
@@ -67,4 +120,20 @@ struct MeshBuffer {
 	Attrib Normal;
 	Attrib Color;
 	Attrib TexCoord;
+
+	//CPU-side result of prepare():
+	struct Staging {
+		std::string filename;
+		std::unique_ptr< MappedFile > file;
+		std::unique_ptr< ChunkReader > reader; //(owns copies of any misaligned chunks)
+		std::span< char const > vertices; //vertex data to upload (in the mapped file or the reader)
+		std::span< char const > indices; //index data to upload (empty for files without indices)
+		std::vector< char > vertex_storage, index_storage; //(data rewritten by optimize() or quantize(); vertices and indices point here)
+
+		NameMap< Mesh > meshes;
+		Attrib Position;
+		Attrib Normal;
+		Attrib Color;
+		Attrib TexCoord;
+	};
 };
@@ -0,0 +1,84 @@
+#include "NameID.hpp"
+
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+	struct Names {
+		std::shared_mutex mutex;
+		//names are stored in fixed-size blocks that are never moved, so str() views stay valid:
+		static constexpr uint32_t BlockSize = 1024;
+		struct Entry {
+			std::string str;
+			uint32_t hash = 0;
+		};
+		std::vector< std::unique_ptr< Entry[] > > blocks;
+		uint32_t count = 0;
+
+		struct Hash {
+			size_t operator()(std::string_view str) const { return name_hash(str); }
+		};
+		std::unordered_map< std::string_view, uint32_t, Hash > ids; //(keys view entries' strings)
+
+		Entry const &entry(uint32_t id) const {
+			return blocks[id / BlockSize][id % BlockSize];
+		}
+	};
+	Names &get_names() {
+		static Names names;
+		return names;
+	}
+}
+
+NameID::NameID(std::string_view name) {
+	Names &names = get_names();
+	{ //usually already interned:
+		std::shared_lock< std::shared_mutex > lock(names.mutex);
+		auto f = names.ids.find(name);
+		if (f != names.ids.end()) {
+			id = f->second;
+			return;
+		}
+	}
+	std::unique_lock< std::shared_mutex > lock(names.mutex);
+	auto f = names.ids.find(name); //(another thread may have added it in the meantime)
+	if (f != names.ids.end()) {
+		id = f->second;
+		return;
+	}
+	if (names.count % Names::BlockSize == 0) {
+		names.blocks.emplace_back(new Names::Entry[Names::BlockSize]);
+	}
+	id = names.count++;
+	Names::Entry &entry = names.blocks.back()[id % Names::BlockSize];
+	entry.str = std::string(name);
+	entry.hash = name_hash(name);
+	names.ids.emplace(entry.str, id);
+}
+
+NameID NameID::find(std::string_view name) {
+	Names &names = get_names();
+	std::shared_lock< std::shared_mutex > lock(names.mutex);
+	NameID ret;
+	auto f = names.ids.find(name);
+	if (f != names.ids.end()) ret.id = f->second;
+	return ret;
+}
+
+std::string_view NameID::str() const {
+	if (id == -1U) return std::string_view();
+	Names &names = get_names();
+	std::shared_lock< std::shared_mutex > lock(names.mutex);
+	return names.entry(id).str;
+}
+
+uint32_t NameID::hash() const {
+	if (id == -1U) return name_hash(std::string_view());
+	Names &names = get_names();
+	std::shared_lock< std::shared_mutex > lock(names.mutex);
+	return names.entry(id).hash;
+}
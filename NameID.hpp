@@ -0,0 +1,44 @@
+#pragma once
+
+/*
+ * NameID is an interned name: every distinct string gets a small integer id (and one stored copy),
+ * so names can be compared, hashed, and used as keys as integers.
+ *
+ * NameID name("Cube"); //interns "Cube" (if needed)
+ * name.str(); //"Cube" (stays valid for the life of the program)
+ * NameID::find("Cube"); //same id, or an empty NameID if "Cube" was never interned
+ *
+ * Interning is thread-safe (loads run on several threads).
+ *
+ * See NameMap.hpp for a hash table keyed by NameIDs.
+ *
+ */
+
+#include <compare>
+#include <string_view>
+#include <cstdint>
+
+//hash used for names (FNV-1a):
+inline uint32_t name_hash(std::string_view str) {
+	uint32_t h = 2166136261u;
+	for (char c : str) {
+		h = (h ^ uint8_t(c)) * 16777619u;
+	}
+	return h;
+}
+
+struct NameID {
+	NameID() = default; //(empty; no name)
+	explicit NameID(std::string_view name); //intern 'name'
+
+	//look up an already-interned name (empty NameID if it never was):
+	static NameID find(std::string_view name);
+
+	std::string_view str() const; //("" for an empty NameID)
+	uint32_t hash() const; //(== name_hash(str()))
+
+	explicit operator bool() const { return id != -1U; }
+	auto operator<=>(NameID const &) const = default;
+
+	uint32_t id = -1U;
+};
@@ -0,0 +1,112 @@
+#pragma once
+
+/*
+ * NameMap< T > is a flat (open-addressing, linear probing) hash table from NameIDs to T's.
+ *
+ * Lookups by NameID compare integers; lookups by std::string_view (no temporary std::string, no interning)
+ * compare each slot's stored hash first and only then the name itself, so either is a short scan of one array.
+ *
+ * Iteration visits entries in table order (not sorted).
+ * There is no erase (tables are built once, as files are loaded).
+ *
+ */
+
+#include "NameID.hpp"
+
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <cassert>
+#include <cstdint>
+
+template< typename T >
+struct NameMap {
+	struct Slot {
+		NameID name; //(empty for unused slots)
+		uint32_t hash = 0;
+		std::string_view str; //(name.str(), kept here so string lookups don't need the interning table)
+		T value = T();
+	};
+
+	//add an entry; returns the entry's value and whether it was added (false: 'name' was already present):
+	std::pair< T *, bool > insert(NameID name, T const &value) {
+		assert(name && "NameMap keys are non-empty names");
+		if ((count + 1) * 4 > slots.size() * 3) grow(); //(keep load factor under 3/4)
+		uint32_t hash = name.hash();
+		uint32_t mask = uint32_t(slots.size()) - 1;
+		for (uint32_t i = hash & mask; ; i = (i + 1) & mask) {
+			Slot &slot = slots[i];
+			if (!slot.name) {
+				slot.name = name;
+				slot.hash = hash;
+				slot.str = name.str();
+				slot.value = value;
+				count += 1;
+				return std::make_pair(&slot.value, true);
+			}
+			if (slot.name == name) return std::make_pair(&slot.value, false);
+		}
+	}
+
+	//find an entry (nullptr if not present):
+	T const *find(NameID name) const {
+		if (!name || count == 0) return nullptr;
+		uint32_t mask = uint32_t(slots.size()) - 1;
+		for (uint32_t i = name.hash() & mask; ; i = (i + 1) & mask) {
+			Slot const &slot = slots[i];
+			if (!slot.name) return nullptr;
+			if (slot.name == name) return &slot.value;
+		}
+	}
+	T const *find(std::string_view str) const {
+		if (count == 0) return nullptr;
+		uint32_t hash = name_hash(str);
+		uint32_t mask = uint32_t(slots.size()) - 1;
+		for (uint32_t i = hash & mask; ; i = (i + 1) & mask) {
+			Slot const &slot = slots[i];
+			if (!slot.name) return nullptr;
+			if (slot.hash == hash && slot.str == str) return &slot.value;
+		}
+	}
+
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+
+	//iteration over used slots (slot.name, slot.value):
+	struct const_iterator {
+		Slot const *at;
+		Slot const *end;
+		Slot const &operator*() const { return *at; }
+		Slot const *operator->() const { return at; }
+		const_iterator &operator++() {
+			do { ++at; } while (at != end && !at->name);
+			return *this;
+		}
+		bool operator==(const_iterator const &other) const { return at == other.at; }
+		bool operator!=(const_iterator const &other) const { return at != other.at; }
+	};
+	const_iterator begin() const {
+		const_iterator ret{ slots.data(), slots.data() + slots.size() };
+		if (ret.at != ret.end && !ret.at->name) ++ret;
+		return ret;
+	}
+	const_iterator end() const {
+		return const_iterator{ slots.data() + slots.size(), slots.data() + slots.size() };
+	}
+
+	//internals:
+	std::vector< Slot > slots; //(size is zero or a power of two)
+	size_t count = 0;
+
+	void grow() {
+		std::vector< Slot > old = std::move(slots);
+		slots.assign(old.empty() ? 16 : old.size() * 2, Slot());
+		uint32_t mask = uint32_t(slots.size()) - 1;
+		for (Slot &from : old) {
+			if (!from.name) continue;
+			uint32_t i = from.hash & mask;
+			while (slots[i].name) i = (i + 1) & mask;
+			slots[i] = std::move(from);
+		}
+	}
+};
@@ -0,0 +1,157 @@
+#include "Pack.hpp"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+
+Pack::Pack(std::string const &filename_) : filename(filename_), file(filename_, false) {
+	size_t slash = filename.find_last_of("/\\");
+	directory = (slash == std::string::npos ? "" : filename.substr(0, slash + 1));
+
+	ChunkReader reader(file);
+	//(entry data is checked per-entry as it is opened -- not here -- so mounting a pack doesn't touch every page of it)
+	ChunkReader::Entry const *data = reader.find("pkd0");
+	if (!data || data->compressed) {
+		throw std::runtime_error("Pack '" + filename + "' has no (uncompressed) data chunk.");
+	}
+	blob = std::span< char const >(data->data, data->size);
+
+	//(the directory says chunks are aligned, so these point straight into the mapping)
+	names = reader.read< char >("pkn0");
+	std::span< Entry const > index = reader.read< Entry >("pke0");
+	if (reader.copies.size() != 0) {
+		throw std::runtime_error("Pack '" + filename + "' has misaligned chunks.");
+	}
+
+	for (auto const &entry : index) {
+		if (!(entry.name_begin <= entry.name_end && entry.name_end <= names.size())) {
+			throw std::runtime_error("Pack '" + filename + "' has an entry with out-of-range name begin/end.");
+		}
+		if (!(entry.data_begin <= entry.data_end && entry.data_end <= blob.size())) {
+			throw std::runtime_error("Pack '" + filename + "' has an entry with out-of-range data begin/end.");
+		}
+		if (entry.compression != Stored && entry.compression != Deflate) {
+			throw std::runtime_error("Pack '" + filename + "' has an entry with unknown compression (" + std::to_string(entry.compression) + ").");
+		}
+		if (entry.compression == Stored && entry.data_end - entry.data_begin != entry.size) {
+			throw std::runtime_error("Pack '" + filename + "' has a stored entry with the wrong size.");
+		}
+		std::string_view name(names.data() + entry.name_begin, entry.name_end - entry.name_begin);
+		if (!entries.insert(NameID(name), entry).second) {
+			throw std::runtime_error("Pack '" + filename + "' has more than one entry named '" + std::string(name) + "'.");
+		}
+	}
+
+	if (reader.trailing) {
+		std::cerr << "WARNING: trailing data in pack file '" << filename << "'" << std::endl;
+	}
+}
+
+bool Pack::open(std::string_view name, std::span< char const > *data, std::unique_ptr< char[] > *storage) const {
+	assert(data);
+	assert(storage);
+
+	Entry const *entry = entries.find(name);
+	if (!entry) return false;
+
+	std::span< char const > stored = blob.subspan(entry->data_begin, entry->data_end - entry->data_begin);
+	if (entry->compression == Stored) {
+		*data = stored;
+	} else { assert(entry->compression == Deflate);
+		storage->reset(new char[std::max< uint32_t >(1, entry->size)]);
+		uLongf size = entry->size;
+		if (uncompress(reinterpret_cast< Bytef * >(storage->get()), &size, reinterpret_cast< Bytef const * >(stored.data()), uLong(stored.size())) != Z_OK || size != entry->size) {
+			throw std::runtime_error("Failed to decompress '" + std::string(name) + "' from pack '" + filename + "'.");
+		}
+		*data = std::span< char const >(storage->get(), entry->size);
+	}
+
+	if (verify && chunk_crc32(data->data(), data->size()) != entry->crc32) {
+		throw std::runtime_error("Checksum mismatch for '" + std::string(name) + "' in pack '" + filename + "'.");
+	}
+	return true;
+}
+
+//mounted packs, oldest first:
+static std::mutex mounted_mutex;
+static std::vector< std::shared_ptr< Pack const > > mounted;
+
+void Pack::mount(std::string const &filename) {
+	auto pack = std::make_shared< Pack const >(filename);
+	std::lock_guard< std::mutex > lock(mounted_mutex);
+	mounted.erase(std::remove_if(mounted.begin(), mounted.end(), [&](auto const &p) { return p->filename == filename; }), mounted.end());
+	mounted.emplace_back(std::move(pack));
+}
+
+void Pack::unmount(std::string const &filename) {
+	std::lock_guard< std::mutex > lock(mounted_mutex);
+	mounted.erase(std::remove_if(mounted.begin(), mounted.end(), [&](auto const &p) { return p->filename == filename; }), mounted.end());
+}
+
+std::shared_ptr< Pack const > Pack::find(std::string const &path, std::string_view *name) {
+	assert(name);
+	std::lock_guard< std::mutex > lock(mounted_mutex);
+	for (auto p = mounted.rbegin(); p != mounted.rend(); ++p) {
+		Pack const &pack = **p;
+		if (path.size() <= pack.directory.size() || path.compare(0, pack.directory.size(), pack.directory) != 0) continue;
+		std::string_view rest = std::string_view(path).substr(pack.directory.size());
+		if (pack.entries.find(rest)) {
+			*name = rest;
+			return *p;
+		}
+	}
+	return nullptr;
+}
+
+void PackWriter::write(std::ostream *to) const {
+	assert(to);
+
+	std::vector< char > names;
+	std::vector< Pack::Entry > entries;
+	std::vector< char > blob;
+	std::set< std::string > seen;
+	for (auto const &file : files) {
+		if (!seen.emplace(file.name).second) {
+			throw std::runtime_error("Pack would have more than one entry named '" + file.name + "'.");
+		}
+
+		Pack::Entry &entry = entries.emplace_back();
+		entry.name_begin = uint32_t(names.size());
+		names.insert(names.end(), file.name.begin(), file.name.end());
+		entry.name_end = uint32_t(names.size());
+
+		entry.size = uint32_t(file.data.size());
+		entry.crc32 = chunk_crc32(file.data.data(), file.data.size());
+		entry.reserved = 0;
+
+		std::vector< char > compressed;
+		if (file.compress) {
+			uLongf size = compressBound(uLong(file.data.size()));
+			compressed.resize(size);
+			if (compress2(reinterpret_cast< Bytef * >(compressed.data()), &size, reinterpret_cast< Bytef const * >(file.data.data()), uLong(file.data.size()), Z_BEST_COMPRESSION) != Z_OK) {
+				throw std::runtime_error("Failed to compress '" + file.name + "' for pack.");
+			}
+			compressed.resize(size);
+		}
+		bool deflated = (file.compress && compressed.size() < file.data.size());
+		std::vector< char > const &stored = (deflated ? compressed : file.data);
+		entry.compression = (deflated ? Pack::Deflate : Pack::Stored);
+
+		//(aligned, as chunk files are, so packed chunk files can still be read in place)
+		blob.resize((blob.size() + 15) / 16 * 16, '\0');
+		entry.data_begin = uint32_t(blob.size());
+		blob.insert(blob.end(), stored.begin(), stored.end());
+		entry.data_end = uint32_t(blob.size());
+	}
+
+	ChunkWriter writer;
+	writer.alignment = 16;
+	writer.add("pkn0", names);
+	writer.add("pke0", entries);
+	writer.add("pkd0", blob);
+	writer.write(to);
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+/*
+ * A Pack is one file holding many data files ("entries"), each found by name -- a small virtual filesystem.
+ *
+ * Packs are mounted at the directory they are in: once 'dist/assets.pack' is mounted, a MappedFile
+ *  opened on 'dist/ropegame.pnct' gets the pack's 'ropegame.pnct' entry (if there is one) instead of
+ *  the loose file. So code that opens data_path(...) files -- MeshBuffer::prepare, Scene::prepare,
+ *  load_png -- loads from packs without changes, and loose files still work for anything not packed.
+ *
+ * A mounted pack is mapped once, so opening an entry needs no system calls at all (and entries that
+ *  are loaded together sit together on disk).
+ * Entries may be stored compressed (zlib deflate); those are decompressed into memory when opened.
+ *
+ * Packs are built by PackWriter (see cook-assets.cpp --pack).
+ *
+ * Pack files are chunk files (see read_write_chunk.hpp) with 16-byte-aligned chunks:
+ *  "pkn0" entry names (chars)
+ *  "pke0" entries (Pack::Entry; names and data are ranges of the other two chunks)
+ *  "pkd0" entry data (each entry's data 16-byte aligned, so chunk files inside packs keep their alignment)
+ *
+ */
+
+#include "MappedFile.hpp"
+#include "NameMap.hpp"
+#include "read_write_chunk.hpp"
+
+#include <iosfwd>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+struct Pack {
+	//open + check a pack file; throws on failure:
+	Pack(std::string const &filename);
+
+	enum Compression : uint32_t {
+		Stored = 0,
+		Deflate = 1,
+	};
+
+	struct Entry {
+		uint32_t name_begin, name_end; //range of "pkn0"
+		uint32_t data_begin, data_end; //range of "pkd0" (as stored)
+		uint32_t size; //size once decompressed
+		uint32_t compression; //a Compression value
+		uint32_t crc32; //of the decompressed data
+		uint32_t reserved;
+	};
+	static_assert(sizeof(Entry) == 32, "Pack::Entry is packed.");
+
+	//get an entry's contents (false if there is no such entry); throws if the entry is damaged:
+	// *data points into the pack's mapping (or, for compressed entries, into *storage)
+	bool open(std::string_view name, std::span< char const > *data, std::unique_ptr< char[] > *storage) const;
+
+	std::string filename;
+	std::string directory; //entries appear as files in this directory ("" or ending with a '/')
+	bool verify = true; //check crc32s in open()
+
+	//--- mounting ---
+
+	//mount a pack (replacing any pack already mounted from the same file); throws if it can't be opened:
+	static void mount(std::string const &filename);
+	//unmount a pack (files already opened from it stay valid):
+	static void unmount(std::string const &filename);
+
+	//find a mounted pack with an entry for 'path' (newest mounts first); sets *name to the entry name:
+	static std::shared_ptr< Pack const > find(std::string const &path, std::string_view *name);
+
+	//--- internals ---
+	MappedFile file;
+	std::span< char const > names;
+	std::span< char const > blob;
+	NameMap< Entry > entries;
+};
+
+//build a pack file:
+struct PackWriter {
+	struct File {
+		std::string name;
+		std::vector< char > data;
+		bool compress = false; //(stored as-is anyway if compression doesn't make it smaller)
+	};
+	std::vector< File > files; //written in this order (put files that are loaded together next to each other)
+
+	void add(std::string const &name, std::vector< char > const &data, bool compress = false) {
+		files.emplace_back(File{ name, data, compress });
+	}
+
+	//write the pack (throws on duplicate names):
+	void write(std::ostream *to) const;
+};
@@ -2,7 +2,9 @@
 // this adapted-for-15-466 code is released into the public domain.
 
 #include "PathFont.hpp"
+#include "Load.hpp"
 
+#include <chrono>
 #include <iostream>
 
 PathFont::PathFont(uint32_t glyphs_,
@@ -14,6 +16,8 @@ PathFont::PathFont(uint32_t glyphs_,
 		glyph_char_starts(glyph_char_starts_), chars(chars_),
 		glyph_coord_starts(glyph_coord_starts_), coords(coords_) {
 
+	//(fonts are usually built during static initialization, so time the glyph map for startup reports)
+	auto before = std::chrono::steady_clock::now();
 	for (uint32_t i = 0; i < glyphs; ++i) {
 		std::string str(reinterpret_cast< const char * >(chars + glyph_char_starts[i]), reinterpret_cast< const char * >(chars + glyph_char_starts[i+1]));
 		auto res = glyph_map.insert(std::make_pair(str, i));
@@ -21,4 +25,6 @@ PathFont::PathFont(uint32_t glyphs_,
 			std::cerr << "WARNING: ignoring duplicate glyph for '" << str << "'." << std::endl;
 		}
 	}
+	add_load_timing("PathFont glyph map (" + std::to_string(glyphs) + " glyphs)",
+		std::chrono::duration< float, std::milli >(std::chrono::steady_clock::now() - before).count());
 }
@@ -16,30 +16,57 @@ static constexpr glm::vec3 WORLD_Y = glm::vec3(0.0f, 1.0f, 0.0f);
 static constexpr glm::vec3 WORLD_Z = glm::vec3(0.0f, 0.0f, 1.0f);
 
 GLuint rope_meshes_for_lit_color_texture_program = 0;
-
-Load<MeshBuffer> rope_meshes(LoadTagDefault, []() -> MeshBuffer const *
-							 {
+GLuint rope_meshes_for_lit_color_texture_program_instanced = 0;
+
+//rope_meshes is read, parsed, and uploaded on a loader worker thread right away (alongside shader compiles)
+// (its vertex data is streamed to the GPU in slices -- see gl_upload_buffer.hpp -- so the upload is spread across frames);
+//its vertex arrays are made once it and the programs they use have loaded;
+//rope_scene is read + parsed on a worker alongside them, then uploaded on the main thread once the vertex arrays exist:
+Load<MeshBuffer> rope_meshes(LoadTagDefault, LoadAfter{},
+	[]() -> MeshBuffer const *
+	{
     // NOTE: adjust path if your Makefile writes elsewhere:
-    MeshBuffer const *ret = new MeshBuffer(data_path("ropegame.pnct"));
+    return new MeshBuffer(data_path("ropegame.pnct")); }, LoadThreadWorker, "rope_meshes (ropegame.pnct)");
+
+Load<void> rope_meshes_vaos(LoadTagDefault, LoadAfter{&rope_meshes, &lit_color_texture_program, &lit_color_texture_program_instanced},
+	[]()
+	{
     rope_meshes_for_lit_color_texture_program =
-        ret->make_vao_for_program(lit_color_texture_program->program);
-    return ret; });
+        rope_meshes->make_vao_for_program(lit_color_texture_program->program);
+    rope_meshes_for_lit_color_texture_program_instanced =
+        rope_meshes->make_vao_for_program(lit_color_texture_program_instanced->program, {"WORLD_FROM_OBJECT", "WORLD_FROM_NORMAL"}); },
+	LoadThreadMain, "rope_meshes vertex arrays");
 
-Load<Scene> rope_scene(LoadTagDefault, []() -> Scene const *
-					   {
+Load<Scene> rope_scene(LoadTagDefault, LoadAfter{&rope_meshes, &rope_meshes_vaos},
+	[]()
+	{
     // If you don't export a .scene yet, see the "No .scene file" option below.
-    return new Scene(data_path("ropegame.scene"),
-        [&](Scene &scene, Scene::Transform *transform, std::string const &mesh_name) {
+    auto scene = std::make_unique<Scene>();
+    Scene::Staging staging = scene->prepare(data_path("ropegame.scene"));
+    return std::make_pair(std::move(scene), std::move(staging)); },
+	[](std::pair<std::unique_ptr<Scene>, Scene::Staging> &prepared) -> Scene const *
+	{
+    prepared.first->upload(prepared.second,
+        [&](Scene &scene, Scene::Transform *transform, NameID mesh_name) {
             Mesh const &mesh = rope_meshes->lookup(mesh_name);
 
             Scene::Drawable &dr = scene.drawables.emplace_back(transform);
             dr.pipeline = lit_color_texture_program_pipeline;
             dr.pipeline.vao   = rope_meshes_for_lit_color_texture_program;
+            dr.pipeline.instanced.vao = rope_meshes_for_lit_color_texture_program_instanced;
             dr.pipeline.type  = mesh.type;
             dr.pipeline.start = mesh.start;
             dr.pipeline.count = mesh.count;
+            dr.pipeline.index_type = mesh.index_type;
+            dr.pipeline.base_vertex = mesh.base_vertex;
+            dr.pipeline.vertex_count = mesh.vertex_count;
+            dr.pipeline.position_scale = mesh.position_scale;
+            dr.pipeline.position_offset = mesh.position_offset;
+            dr.min = mesh.min;
+            dr.max = mesh.max;
         }
-    ); });
+    );
+    return prepared.first.release(); }, "rope_scene (ropegame.scene)");
 
 PlayMode::PlayMode() : scene(*rope_scene)
 {
@@ -79,6 +106,16 @@ PlayMode::PlayMode() : scene(*rope_scene)
 	jump_v0 = 0.5f * jump_g * jump_T;
 	jump_vz = jump_v0;
 	jump_z = 0.0f;
+
+	// lights come from the scene; if it has none, add the overhead hemisphere light the game was tuned with:
+	if (scene.lights.empty())
+	{
+		Scene::Transform &sky = scene.transforms.emplace_back();
+		sky.name = "Sky"; // identity rotation, so it shines along -z (down)
+		Scene::Light &light = scene.lights.emplace_back(&sky);
+		light.type = Scene::Light::Hemisphere;
+		light.energy = glm::vec3(1.0f, 1.0f, 0.95f);
+	}
 }
 
 PlayMode::~PlayMode()
@@ -284,13 +321,7 @@ void PlayMode::draw(glm::uvec2 const &drawable_size)
 	// update camera aspect ratio for drawable:
 	camera->aspect = float(drawable_size.x) / float(drawable_size.y);
 
-	// set up light type and position for lit_color_texture_program:
-	// TODO: consider using the Light(s) in the scene to do this
-	glUseProgram(lit_color_texture_program->program);
-	glUniform1i(lit_color_texture_program->LIGHT_TYPE_int, 1);
-	glUniform3fv(lit_color_texture_program->LIGHT_DIRECTION_vec3, 1, glm::value_ptr(glm::vec3(0.0f, 0.0f, -1.0f)));
-	glUniform3fv(lit_color_texture_program->LIGHT_ENERGY_vec3, 1, glm::value_ptr(glm::vec3(1.0f, 1.0f, 0.95f)));
-	glUseProgram(0);
+	// (lighting comes from scene.lights -- Scene::draw uploads them for lit_color_texture_program)
 
 	glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
 	glClearDepth(1.0f); // 1.0 is actually the default value to clear the depth buffer to, but FYI you can change it.
@@ -1,11 +1,15 @@
 #include "Scene.hpp"
 
+#include "BVH.hpp"
+
 #include "gl_errors.hpp"
 #include "read_write_chunk.hpp"
+#include "MappedFile.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
-#include <fstream>
+#include <algorithm>
+#include <cstring>
 
 //-------------------------
 
@@ -56,18 +60,129 @@ glm::mat4x3 Scene::Transform::make_local_from_parent() const {
 	);
 }
 
-glm::mat4x3 Scene::Transform::make_world_from_local() const {
+//globally unique stamps (so a transform re-created at the same address can't look up-to-date):
+static uint64_t next_generation = 0;
+static uint64_t next_sweep = 0;
+
+void Scene::Transform::update_world_cache() const {
+	if (parent) parent->update_world_cache();
+	refresh_world_cache();
+}
+
+void Scene::Transform::refresh_world_cache() const {
+	WorldCache &cache = world_cache;
+	if (cache.generation != 0
+	 && cache.position == position
+	 && cache.rotation == rotation
+	 && cache.scale == scale
+	 && cache.parent == parent
+	 && (!parent || cache.parent_generation == parent->world_cache.generation)) {
+		return; //nothing changed since last computed
+	}
+
+	cache.position = position;
+	cache.rotation = rotation;
+	cache.scale = scale;
+	cache.parent = parent;
 	if (!parent) {
-		return make_parent_from_local();
+		cache.parent_generation = 0;
+		cache.world_from_local = make_parent_from_local();
 	} else {
-		return parent->make_world_from_local() * glm::mat4(make_parent_from_local()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+		cache.parent_generation = parent->world_cache.generation;
+		cache.world_from_local = parent->world_cache.world_from_local * glm::mat4(make_parent_from_local()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
 	}
+	cache.generation = ++next_generation;
+}
+
+glm::mat4x3 Scene::Transform::make_world_from_local() const {
+	update_world_cache();
+	return world_cache.world_from_local;
 }
+
 glm::mat4x3 Scene::Transform::make_local_from_world() const {
-	if (!parent) {
-		return make_local_from_parent();
-	} else {
-		return make_local_from_parent() * glm::mat4(parent->make_local_from_world()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+	update_world_cache();
+	if (world_cache.inverse_generation != world_cache.generation) {
+		if (!parent) {
+			world_cache.local_from_world = make_local_from_parent();
+		} else {
+			world_cache.local_from_world = make_local_from_parent() * glm::mat4(parent->make_local_from_world()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+		}
+		world_cache.inverse_generation = world_cache.generation;
+	}
+	return world_cache.local_from_world;
+}
+
+void Scene::update_world_matrices() const {
+	uint64_t sweep = ++next_sweep;
+	world_sweep = sweep;
+
+	//Gather every transform whose world matrix is out of date into a structure-of-arrays batch:
+	// (transforms are visited in storage order, which load() makes parent-first)
+	world_batch.clear();
+	world_batch_transforms.clear();
+
+	auto ti = transforms.begin();
+	for (; ti != transforms.end(); ++ti) {
+		Transform const &t = *ti;
+		Transform const *parent = t.parent;
+		Transform::WorldCache &cache = t.world_cache;
+
+		//parent not visited yet? then 'transforms' isn't parent-first; handle the rest below:
+		if (parent && parent->world_cache.sweep != sweep) break;
+
+		bool parent_recomputed = (parent && parent->world_cache.batch_index >= 0);
+		bool changed = parent_recomputed
+			|| cache.generation == 0
+			|| cache.position != t.position
+			|| cache.rotation != t.rotation
+			|| cache.scale != t.scale
+			|| cache.parent != parent
+			|| (parent && cache.parent_generation != parent->world_cache.generation);
+
+		cache.sweep = sweep;
+		if (!changed) {
+			cache.batch_index = -1;
+			continue;
+		}
+
+		uint32_t index;
+		if (parent_recomputed) {
+			index = world_batch.add(t.position, t.rotation, t.scale, parent->world_cache.batch_index);
+		} else if (parent) {
+			index = world_batch.add(t.position, t.rotation, t.scale, parent->world_cache.world_from_local);
+		} else {
+			index = world_batch.add(t.position, t.rotation, t.scale);
+		}
+		cache.batch_index = int32_t(index);
+		world_batch_transforms.emplace_back(&t);
+
+		//update cache bookkeeping now (world_from_local itself is filled in after the batch is computed):
+		cache.position = t.position;
+		cache.rotation = t.rotation;
+		cache.scale = t.scale;
+		cache.parent = parent;
+		cache.parent_generation = (parent ? parent->world_cache.generation : 0);
+		cache.generation = ++next_generation;
+	}
+
+	//Compute the batch and scatter results back to the transforms:
+	world_batch.compute();
+	assert(world_batch_transforms.size() == world_batch.size());
+	for (uint32_t i = 0; i < world_batch.size(); ++i) {
+		world_batch_transforms[i]->world_cache.world_from_local = world_batch.world_from_local(i);
+	}
+
+	//Any remaining transforms (only if some parent came after its child) are handled one-by-one:
+	if (ti != transforms.end()) {
+		std::function< void(Transform const &) > visit = [&](Transform const &t) {
+			if (t.world_cache.sweep == sweep) return;
+			if (t.parent) visit(*t.parent);
+			t.refresh_world_cache();
+			t.world_cache.sweep = sweep;
+		};
+		for (; ti != transforms.end(); ++ti) {
+			visit(*ti);
+		}
 	}
 }
 
@@ -80,6 +195,139 @@ glm::mat4 Scene::Camera::make_projection() const {
 //-------------------------
 
 
+char *Scene::ObjectBlockRing::map(uint32_t count) {
+	if (buffer == 0) {
+		glGenBuffers(1, &buffer);
+		GLint alignment = 0;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		alignment = std::max(alignment, 1);
+		stride = (GLsizeiptr(sizeof(Scene::ObjectBlock)) + alignment - 1) / alignment * alignment;
+	}
+
+	segment = (segment + 1) % Segments;
+	if (fences[segment]) {
+		while (glClientWaitSync(fences[segment], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) { }
+		glDeleteSync(fences[segment]);
+		fences[segment] = 0;
+	}
+
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+
+	GLsizeiptr needed = stride * count;
+	if (needed > segment_size) {
+		//grow (by doubling, so this happens rarely); new storage means no old fences apply:
+		segment_size = std::max(segment_size, 64 * stride);
+		while (segment_size < needed) segment_size *= 2;
+		glBufferData(GL_UNIFORM_BUFFER, Segments * segment_size, nullptr, GL_STREAM_DRAW);
+		for (auto &fence : fences) {
+			if (fence) glDeleteSync(fence);
+			fence = 0;
+		}
+	}
+
+	void *ptr = glMapBufferRange(GL_UNIFORM_BUFFER, offset(0), needed, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (!ptr) {
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		throw std::runtime_error("Failed to map per-object uniform buffer.");
+	}
+	return reinterpret_cast< char * >(ptr);
+}
+
+void Scene::ObjectBlockRing::unmap() {
+	glUnmapBuffer(GL_UNIFORM_BUFFER);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void Scene::ObjectBlockRing::fence() {
+	assert(fences[segment] == 0);
+	fences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void Scene::ObjectBlockRing::release() {
+	for (auto &fence : fences) {
+		if (fence) glDeleteSync(fence);
+		fence = 0;
+	}
+	if (buffer != 0) glDeleteBuffers(1, &buffer);
+	buffer = 0;
+	stride = 0;
+	segment_size = 0;
+}
+
+void Scene::ClusterBuffers::upload(uint32_t i, GLenum format, void const *data, size_t size) {
+	if (buffers[i] == 0) {
+		glGenBuffers(1, &buffers[i]);
+		glGenTextures(1, &textures[i]);
+	}
+	glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+	//(never empty, so the texture always has storage)
+	glBufferData(GL_TEXTURE_BUFFER, std::max< size_t >(size, 16), nullptr, GL_STREAM_DRAW);
+	if (size) glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+	glTexBuffer(GL_TEXTURE_BUFFER, format, buffers[i]);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+void Scene::ClusterBuffers::bind() {
+	for (uint32_t i = 0; i < Count; ++i) {
+		glActiveTexture(GL_TEXTURE0 + units[i]);
+		glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+	}
+}
+
+void Scene::ClusterBuffers::unbind() {
+	for (uint32_t i = 0; i < Count; ++i) {
+		glActiveTexture(GL_TEXTURE0 + units[i]);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+	}
+}
+
+void Scene::ClusterBuffers::release() {
+	for (uint32_t i = 0; i < Count; ++i) {
+		if (textures[i] != 0) glDeleteTextures(1, &textures[i]);
+		if (buffers[i] != 0) glDeleteBuffers(1, &buffers[i]);
+		textures[i] = 0;
+		buffers[i] = 0;
+	}
+}
+
+bool Scene::outside_frustum(glm::mat4 const &clip_from_box, glm::vec3 const &min, glm::vec3 const &max) {
+	//transform the eight corners of the box to clip space:
+	// (as one corner plus multiples of the matrix columns)
+	glm::vec4 corner = clip_from_box * glm::vec4(min, 1.0f);
+	glm::vec4 dx = clip_from_box[0] * (max.x - min.x);
+	glm::vec4 dy = clip_from_box[1] * (max.y - min.y);
+	glm::vec4 dz = clip_from_box[2] * (max.z - min.z);
+
+	//the box is outside if all corners are on the outside of the same clipping plane:
+	uint32_t all_outside = 0x3f;
+	for (uint32_t i = 0; i < 8; ++i) {
+		glm::vec4 c = corner;
+		if (i & 1) c += dx;
+		if (i & 2) c += dy;
+		if (i & 4) c += dz;
+		uint32_t outside = 0;
+		if (c.x < -c.w) outside |= 0x01;
+		if (c.x >  c.w) outside |= 0x02;
+		if (c.y < -c.w) outside |= 0x04;
+		if (c.y >  c.w) outside |= 0x08;
+		if (c.z < -c.w) outside |= 0x10;
+		if (c.z >  c.w) outside |= 0x20;
+		all_outside &= outside;
+		if (all_outside == 0) return false;
+	}
+	return true;
+}
+
+float Scene::cluster_radius(Light const &light) const {
+	if (light.distance > 0.0f) return light.distance;
+	//energy falls off as 1/max(1,d^2) (see LitColorTextureProgram), so solve energy / d^2 == light_cutoff:
+	float brightest = std::max(light.energy.r, std::max(light.energy.g, light.energy.b));
+	return std::max(1.0f, std::sqrt(std::max(0.0f, brightest) / light_cutoff));
+}
+
 void Scene::draw(Camera const &camera) const {
 	assert(camera.transform);
 	glm::mat4 clip_from_world = camera.make_projection() * glm::mat4(camera.transform->make_local_from_world());
@@ -89,76 +337,455 @@ void Scene::draw(Camera const &camera) const {
 
 void Scene::draw(glm::mat4 const &clip_from_world, glm::mat4x3 const &light_from_world) const {
 
-	//Iterate through all drawables, sending each one to OpenGL:
-	for (auto const &drawable : drawables) {
+	//Compute all world matrices in one pass (instead of walking the hierarchy once per drawable):
+	update_world_matrices();
+
+	//(transforms in this scene were just updated; objects attached to some other scene's transforms get the full check)
+	auto get_world_from_local = [this](Transform const &transform) -> glm::mat4x3 const & {
+		if (transform.world_cache.sweep != world_sweep) transform.update_world_cache();
+		return transform.world_cache.world_from_local;
+	};
+	//the object-to-world matrix is used for all per-object matrices:
+	auto get_world_from_object = [&get_world_from_local](Drawable const &drawable) -> glm::mat4x3 const & {
+		assert(drawable.transform); //drawables *must* have a transform
+		return get_world_from_local(*drawable.transform);
+	};
+	//quantized meshes store positions relative to their bounds; fold that into the matrices that transform positions:
+	// (normal matrices keep using world_from_object, since normals are stored in object space)
+	auto dequantize = [](glm::mat4x3 const &world_from_object, Drawable::Pipeline const &pipeline) -> glm::mat4x3 {
+		if (pipeline.position_scale == glm::vec3(1.0f) && pipeline.position_offset == glm::vec3(0.0f)) return world_from_object;
+		return glm::mat4x3(
+			world_from_object[0] * pipeline.position_scale.x,
+			world_from_object[1] * pipeline.position_scale.y,
+			world_from_object[2] * pipeline.position_scale.z,
+			world_from_object * glm::vec4(pipeline.position_offset, 1.0f)
+		);
+	};
+
+	draw_stats = DrawStats();
+
+	//Build the render queue, sorted by pipeline state so that changes are rare:
+	draw_queue.clear();
+	draw_queue.reserve(drawables.size());
+	auto enqueue = [&](Drawable const &drawable, bool test_bounds) {
 		//Reference to drawable's pipeline for convenience:
 		Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
 
 		//skip any drawables without a shader program set:
-		if (pipeline.program == 0) continue;
+		if (pipeline.program == 0) return;
 		//skip any drawables that don't reference any vertex array:
-		if (pipeline.vao == 0) continue;
+		if (pipeline.vao == 0) return;
 		//skip any drawables that don't contain any vertices:
-		if (pipeline.count == 0) continue;
+		if (pipeline.count == 0) return;
+
+		//skip any drawables that are outside the view:
+		if (test_bounds && drawable.has_bounds()) {
+			draw_stats.tested += 1;
+			glm::mat4 clip_from_object = clip_from_world * glm::mat4(get_world_from_object(drawable));
+			if (outside_frustum(clip_from_object, drawable.min, drawable.max)) {
+				draw_stats.culled += 1;
+				return;
+			}
+		}
+
+		DrawItem &item = draw_queue.emplace_back();
+		item.key.program = pipeline.program;
+		item.key.vao = pipeline.vao;
+		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+			item.key.textures[i] = pipeline.textures[i].texture;
+		}
+		item.key.type = pipeline.type;
+		//(custom uniforms are per-drawable, so drawables that set them can't be instanced)
+		if (instancing && pipeline.instanced.program != 0 && pipeline.instanced.vao != 0 && !pipeline.set_uniforms) {
+			item.key.instanced_program = pipeline.instanced.program;
+		}
+		item.key.start = pipeline.start;
+		item.key.count = pipeline.count;
+		item.key.index_type = pipeline.index_type;
+		item.key.base_vertex = pipeline.base_vertex;
+		item.drawable = &drawable;
+	};
+	if (frustum_culling && bvh) {
+		//the hierarchy does the culling:
+		bvh->update(*this);
+		visible_drawables.clear();
+		bvh->cull(clip_from_world, &visible_drawables, &draw_stats);
+		for (Drawable const *drawable : visible_drawables) {
+			enqueue(*drawable, false);
+		}
+	} else {
+		for (auto const &drawable : drawables) {
+			enqueue(drawable, frustum_culling);
+		}
+	}
+	//(stable, so drawables with identical state keep their relative order)
+	std::stable_sort(draw_queue.begin(), draw_queue.end(), [](DrawItem const &a, DrawItem const &b) {
+		return a.key < b.key;
+	});
+
+	draw_stats.drawn = uint32_t(draw_queue.size());
+
+	//Split the queue into batches; runs of identical (instanceable) drawables become instanced batches:
+	draw_batches.clear();
+	instance_data.clear();
+	for (uint32_t begin = 0; begin < draw_queue.size(); /* later */) {
+		uint32_t end = begin + 1;
+		while (end < draw_queue.size() && draw_queue[end].key == draw_queue[begin].key) ++end;
+
+		DrawBatch &batch = draw_batches.emplace_back();
+		batch.begin = begin;
+		batch.end = end;
+		if (draw_queue[begin].key.instanced_program != 0 && end - begin >= std::max(1u, min_instances)) {
+			batch.first_instance = uint32_t(instance_data.size());
+			for (uint32_t i = begin; i < end; ++i) {
+				glm::mat4x3 const &world_from_object = get_world_from_object(*draw_queue[i].drawable);
+				InstanceData &instance = instance_data.emplace_back();
+				instance.world_from_object = dequantize(world_from_object, draw_queue[i].drawable->pipeline);
+				instance.world_from_normal = glm::inverse(glm::transpose(glm::mat3(world_from_object)));
+			}
+		}
 
+		begin = end;
+	}
 
-		//Set shader program:
-		glUseProgram(pipeline.program);
+	//Upload per-instance data (all batches at once; each batch points its attributes at its own range):
+	if (!instance_data.empty()) {
+		if (instance_buffer == 0) glGenBuffers(1, &instance_buffer);
+		glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+		glBufferData(GL_ARRAY_BUFFER, instance_data.size() * sizeof(InstanceData), instance_data.data(), GL_STREAM_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
 
-		//Set attribute sources:
-		glBindVertexArray(pipeline.vao);
+	//Pack lights (if any drawable's pipeline uses them) into the Lights block:
+	bool use_lights = false;
+	for (auto const &item : draw_queue) {
+		if (item.drawable->pipeline.LIGHTS_block != -1U) {
+			use_lights = true;
+			break;
+		}
+	}
+	bool clustered = use_lights && light_clusters;
+	if (use_lights) {
+		light_ranges.clear();
+		cluster_lights.clear();
+		cluster_spheres.clear();
+		uint32_t count = 0;
+		for (auto const &light : lights) {
+			assert(light.transform); //lights *must* have a transform
+			glm::mat4x3 const &world_from_light = get_world_from_local(*light.transform);
+
+			glm::vec3 position = world_from_light[3];
+			glm::vec3 direction = -world_from_light[2]; //(lights point along their -z axis)
+
+			float type = 0.0f;
+			float range = light.distance; //(for picking; negative means "always in range")
+			if (light.type == Light::Point) {
+				type = 0.0f;
+			} else if (light.type == Light::Hemisphere) {
+				type = 1.0f;
+				range = -1.0f;
+			} else if (light.type == Light::Spot) {
+				type = 2.0f;
+			} else { assert(light.type == Light::Directional);
+				type = 3.0f;
+				range = -1.0f;
+			}
 
-		//Configure program uniforms:
+			PackedLight packed;
+			packed.position = glm::vec4(light_from_world * glm::vec4(position, 1.0f), type);
+			packed.direction = glm::vec4(glm::normalize(light_from_world * glm::vec4(direction, 0.0f)), std::cos(0.5f * light.spot_fov));
+			packed.energy = glm::vec4(light.energy, 0.0f);
 
-		//the object-to-world matrix is used in all three of these uniforms:
-		assert(drawable.transform); //drawables *must* have a transform
-		glm::mat4x3 world_from_object = drawable.transform->make_world_from_local();
+			if (clustered && range >= 0.0f) {
+				//point and spot lights go to the clusters they reach:
+				cluster_lights.emplace_back(packed);
+				cluster_spheres.emplace_back(LightClusters::Light{position, cluster_radius(light)});
+				continue;
+			}
 
-		//CLIP_FROM_OBJECT takes vertices from object space to clip space:
-		if (pipeline.CLIP_FROM_OBJECT_mat4 != -1U) {
-			glm::mat4 clip_from_object = clip_from_world * glm::mat4(world_from_object);
-			glUniformMatrix4fv(pipeline.CLIP_FROM_OBJECT_mat4, 1, GL_FALSE, glm::value_ptr(clip_from_object));
+			if (count == MaxLights) continue;
+			lights_block.LIGHTS[count] = packed;
+			light_ranges.emplace_back(position, range);
+			++count;
 		}
+		lights_block.LIGHT_COUNT = glm::ivec4(count, 0, 0, 0);
+
+		if (clustered) {
+			light_clusters->assign(clip_from_world, cluster_spheres);
 
-		//the object-to-light matrix is used in the next two uniforms:
-		glm::mat4x3 light_from_object = light_from_world * glm::mat4(world_from_object);
+			//clusters cover the viewport:
+			GLint viewport[4] = { 0, 0, 1, 1 };
+			glGetIntegerv(GL_VIEWPORT, viewport);
+			glm::vec2 scale = glm::vec2(light_clusters->dims) / glm::max(glm::vec2(viewport[2], viewport[3]), glm::vec2(1.0f));
 
-		//CLIP_FROM_OBJECT takes vertices from object space to light space:
-		if (pipeline.LIGHT_FROM_OBJECT_mat4x3 != -1U) {
-			glUniformMatrix4x3fv(pipeline.LIGHT_FROM_OBJECT_mat4x3, 1, GL_FALSE, glm::value_ptr(light_from_object));
+			glm::uvec3 const &dims = light_clusters->dims;
+			lights_block.CLUSTER_DIMS = glm::ivec4(dims.x, dims.y, dims.z, 1);
+			lights_block.CLUSTER_FROM_WINDOW = glm::vec4(scale.x, scale.y, -viewport[0] * scale.x, -viewport[1] * scale.y);
+			lights_block.CLUSTER_DEPTH = glm::vec4(light_clusters->depth_scale, light_clusters->depth_bias, 0.0f, 0.0f);
+
+			cluster_buffers.upload(0, GL_RGBA32F, cluster_lights.data(), cluster_lights.size() * sizeof(PackedLight));
+			cluster_buffers.upload(1, GL_RG32UI, light_clusters->grid.data(), light_clusters->grid.size() * sizeof(glm::uvec2));
+			cluster_buffers.upload(2, GL_R32UI, light_clusters->indices.data(), light_clusters->indices.size() * sizeof(uint32_t));
+			cluster_buffers.bind();
+		} else {
+			lights_block.CLUSTER_DIMS = glm::ivec4(0);
+			lights_block.CLUSTER_FROM_WINDOW = glm::vec4(0.0f);
+			lights_block.CLUSTER_DEPTH = glm::vec4(0.0f);
 		}
 
-		//LIGHT_FROM_NORMAL takes normals from object space to light space:
-		if (pipeline.LIGHT_FROM_NORMAL_mat3 != -1U) {
-			glm::mat3 light_from_normal = glm::inverse(glm::transpose(glm::mat3(light_from_object)));
-			glUniformMatrix3fv(pipeline.LIGHT_FROM_NORMAL_mat3, 1, GL_FALSE, glm::value_ptr(light_from_normal));
+		//(the whole block is uploaded, since GL wants the bound buffer to cover the declared array)
+		if (lights_buffer == 0) glGenBuffers(1, &lights_buffer);
+		glBindBuffer(GL_UNIFORM_BUFFER, lights_buffer);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(LightsBlock), &lights_block, GL_STREAM_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		glBindBufferBase(GL_UNIFORM_BUFFER, LightsBlockBinding, lights_buffer);
+	}
+
+	//pick the (up to MaxObjectLights) lights closest to a drawable's bounds:
+	auto pick_lights = [&](Drawable const &drawable, glm::mat4x3 const &world_from_object, ObjectBlock *block) {
+		glm::vec3 center = world_from_object[3];
+		float radius = 0.0f;
+		if (drawable.has_bounds()) {
+			glm::vec3 extent = 0.5f * (drawable.max - drawable.min);
+			center = world_from_object * glm::vec4(0.5f * (drawable.min + drawable.max), 1.0f);
+			radius = glm::length(
+				  glm::abs(world_from_object[0]) * extent.x
+				+ glm::abs(world_from_object[1]) * extent.y
+				+ glm::abs(world_from_object[2]) * extent.z
+			);
 		}
 
-		//set any requested custom uniforms:
-		if (pipeline.set_uniforms) pipeline.set_uniforms();
+		light_order.clear();
+		for (uint32_t l = 0; l < light_ranges.size(); ++l) {
+			float range = light_ranges[l].w;
+			if (range < 0.0f) {
+				light_order.emplace_back(-1.0f, int32_t(l));
+				continue;
+			}
+			float distance = std::max(0.0f, glm::length(glm::vec3(light_ranges[l]) - center) - radius);
+			if (range > 0.0f && distance > range) continue;
+			light_order.emplace_back(distance, int32_t(l));
+		}
+		uint32_t count = std::min< uint32_t >(uint32_t(light_order.size()), MaxObjectLights);
+		std::partial_sort(light_order.begin(), light_order.begin() + count, light_order.end());
 
-		//set up textures:
+		for (uint32_t i = 0; i < MaxObjectLights; ++i) {
+			block->OBJECT_LIGHTS[i / 4][i % 4] = (i < count ? light_order[i].second : 0);
+		}
+		block->OBJECT_LIGHT_COUNT = glm::ivec4(count, 0, 0, 0);
+	};
+
+	//Write per-object blocks (for drawables whose pipelines use them) in the order they will be drawn:
+	uint32_t object_blocks = 0;
+	for (auto const &batch : draw_batches) {
+		if (batch.first_instance != -1U) continue;
+		for (uint32_t i = batch.begin; i < batch.end; ++i) {
+			if (draw_queue[i].drawable->pipeline.OBJECT_block != -1U) ++object_blocks;
+		}
+	}
+	if (object_blocks) {
+		char *blocks = object_block_ring.map(object_blocks);
+		uint32_t b = 0;
+		for (auto const &batch : draw_batches) {
+			if (batch.first_instance != -1U) continue;
+			for (uint32_t i = batch.begin; i < batch.end; ++i) {
+				Drawable const &drawable = *draw_queue[i].drawable;
+				if (drawable.pipeline.OBJECT_block == -1U) continue;
+
+				glm::mat4x3 const &world_from_object = get_world_from_object(drawable);
+				glm::mat4x3 light_from_object = light_from_world * glm::mat4(world_from_object);
+				glm::mat3 light_from_normal = glm::inverse(glm::transpose(glm::mat3(light_from_object)));
+				glm::mat4x3 world_from_vertex = dequantize(world_from_object, drawable.pipeline);
+
+				ObjectBlock block;
+				block.CLIP_FROM_OBJECT = clip_from_world * glm::mat4(world_from_vertex);
+				glm::mat4x3 light_from_vertex = light_from_world * glm::mat4(world_from_vertex);
+				for (uint32_t c = 0; c < 4; ++c) block.LIGHT_FROM_OBJECT[c] = glm::vec4(light_from_vertex[c], 0.0f);
+				for (uint32_t c = 0; c < 3; ++c) block.LIGHT_FROM_NORMAL[c] = glm::vec4(light_from_normal[c], 0.0f);
+				if (drawable.pipeline.LIGHTS_block != -1U && !clustered) {
+					pick_lights(drawable, world_from_object, &block);
+				} else {
+					block.OBJECT_LIGHTS[0] = block.OBJECT_LIGHTS[1] = glm::ivec4(0);
+					block.OBJECT_LIGHT_COUNT = glm::ivec4(0);
+				}
+				std::memcpy(blocks + b * object_block_ring.stride, &block, sizeof(block));
+				++b;
+			}
+		}
+		assert(b == object_blocks);
+		object_block_ring.unmap();
+	}
+	uint32_t next_object_block = 0;
+
+	//State currently bound (so only differences need to be sent to OpenGL):
+	GLuint bound_program = 0;
+	GLuint bound_vao = 0;
+	Drawable::Pipeline::TextureInfo bound_textures[Drawable::Pipeline::TextureCount];
+	uint32_t active_texture = -1U; //(unknown)
+
+	auto bind_program = [&](GLuint program) {
+		if (program != bound_program) {
+			glUseProgram(program);
+			bound_program = program;
+		}
+	};
+	auto bind_vao = [&](GLuint vao) {
+		if (vao != bound_vao) {
+			glBindVertexArray(vao);
+			bound_vao = vao;
+		}
+	};
+	//(a zero texture means "nothing bound", so un-bind whatever the previous drawable left there)
+	auto bind_textures = [&](Drawable::Pipeline const &pipeline) {
 		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-			if (pipeline.textures[i].texture != 0) {
+			Drawable::Pipeline::TextureInfo const &want = pipeline.textures[i];
+			Drawable::Pipeline::TextureInfo &bound = bound_textures[i];
+			if (want.texture == 0 ? bound.texture == 0 : (want.texture == bound.texture && want.target == bound.target)) continue;
+			if (active_texture != i) {
 				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, pipeline.textures[i].texture);
+				active_texture = i;
+			}
+			if (bound.texture != 0 && (want.texture == 0 || bound.target != want.target)) {
+				glBindTexture(bound.target, 0);
+			}
+			if (want.texture != 0) {
+				glBindTexture(want.target, want.texture);
 			}
+			bound = want;
 		}
+	};
 
-		//draw the object:
-		glDrawArrays(pipeline.type, pipeline.start, pipeline.count);
+	//offset of an indexed pipeline's first index in its element array buffer:
+	auto first_index = [](Drawable::Pipeline const &pipeline) {
+		return (GLbyte const *)0 + pipeline.start * (pipeline.index_type == GL_UNSIGNED_SHORT ? 2 : 4);
+	};
 
-		//un-bind textures:
-		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-			if (pipeline.textures[i].texture != 0) {
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, 0);
+	//normals in world space to normals in light space (used by instanced batches):
+	glm::mat3 light_from_world_normal = glm::inverse(glm::transpose(glm::mat3(light_from_world)));
+
+	//Send each batch to OpenGL:
+	for (auto const &batch : draw_batches) {
+		if (batch.first_instance != -1U) {
+			//---- instanced batch: one draw call for every drawable in the batch ----
+			Scene::Drawable::Pipeline const &pipeline = draw_queue[batch.begin].drawable->pipeline;
+			Scene::Drawable::Pipeline::Instanced const &instanced = pipeline.instanced;
+
+			bind_program(instanced.program);
+			bind_vao(instanced.vao);
+
+			//point per-instance attributes at this batch's part of the instance buffer:
+			glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+			GLbyte const *base = (GLbyte const *)0 + batch.first_instance * sizeof(InstanceData);
+			auto instance_attribute = [&](GLuint location, uint32_t columns, size_t offset) {
+				if (location == -1U) return;
+				for (uint32_t c = 0; c < columns; ++c) {
+					glVertexAttribPointer(location + c, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), base + offset + c * sizeof(glm::vec3));
+					glEnableVertexAttribArray(location + c);
+					glVertexAttribDivisor(location + c, 1);
+				}
+			};
+			instance_attribute(instanced.WORLD_FROM_OBJECT_mat4x3, 4, 0);
+			instance_attribute(instanced.WORLD_FROM_NORMAL_mat3, 3, sizeof(glm::mat4x3));
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+			if (instanced.CLIP_FROM_WORLD_mat4 != -1U) {
+				glUniformMatrix4fv(instanced.CLIP_FROM_WORLD_mat4, 1, GL_FALSE, glm::value_ptr(clip_from_world));
+			}
+			if (instanced.LIGHT_FROM_WORLD_mat4x3 != -1U) {
+				glUniformMatrix4x3fv(instanced.LIGHT_FROM_WORLD_mat4x3, 1, GL_FALSE, glm::value_ptr(light_from_world));
+			}
+			if (instanced.LIGHT_FROM_WORLD_NORMAL_mat3 != -1U) {
+				glUniformMatrix3fv(instanced.LIGHT_FROM_WORLD_NORMAL_mat3, 1, GL_FALSE, glm::value_ptr(light_from_world_normal));
 			}
+
+			bind_textures(pipeline);
+
+			if (pipeline.index_type != 0) {
+				glDrawElementsInstancedBaseVertex(pipeline.type, pipeline.count, pipeline.index_type, first_index(pipeline), batch.end - batch.begin, pipeline.base_vertex);
+			} else {
+				glDrawArraysInstanced(pipeline.type, pipeline.start, pipeline.count, batch.end - batch.begin);
+			}
+			draw_stats.draw_calls += 1;
+			continue;
 		}
-		glActiveTexture(GL_TEXTURE0);
 
+		//---- regular batch: draw each drawable on its own ----
+		for (uint32_t i = batch.begin; i < batch.end; ++i) {
+			Drawable const &drawable = *draw_queue[i].drawable;
+			Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
+
+			//Set shader program:
+			bind_program(pipeline.program);
+
+			//Set attribute sources:
+			bind_vao(pipeline.vao);
+
+			//Configure program uniforms:
+
+			if (pipeline.OBJECT_block != -1U) {
+				//per-object matrices were written to the uniform buffer above:
+				glBindBufferRange(GL_UNIFORM_BUFFER, ObjectBlockBinding, object_block_ring.buffer, object_block_ring.offset(next_object_block), sizeof(ObjectBlock));
+				++next_object_block;
+			} else {
+				//the object-to-world matrix is used in all three of these uniforms:
+				glm::mat4x3 const &world_from_object = get_world_from_object(drawable);
+				//(positions of quantized meshes need dequantizing first)
+				glm::mat4x3 world_from_vertex = dequantize(world_from_object, pipeline);
+
+				//CLIP_FROM_OBJECT takes vertices from object space to clip space:
+				if (pipeline.CLIP_FROM_OBJECT_mat4 != -1U) {
+					glm::mat4 clip_from_object = clip_from_world * glm::mat4(world_from_vertex);
+					glUniformMatrix4fv(pipeline.CLIP_FROM_OBJECT_mat4, 1, GL_FALSE, glm::value_ptr(clip_from_object));
+				}
+
+				//the object-to-light matrix is used in the next two uniforms:
+				glm::mat4x3 light_from_object = light_from_world * glm::mat4(world_from_object);
+
+				//CLIP_FROM_OBJECT takes vertices from object space to light space:
+				if (pipeline.LIGHT_FROM_OBJECT_mat4x3 != -1U) {
+					glm::mat4x3 light_from_vertex = light_from_world * glm::mat4(world_from_vertex);
+					glUniformMatrix4x3fv(pipeline.LIGHT_FROM_OBJECT_mat4x3, 1, GL_FALSE, glm::value_ptr(light_from_vertex));
+				}
+
+				//LIGHT_FROM_NORMAL takes normals from object space to light space:
+				if (pipeline.LIGHT_FROM_NORMAL_mat3 != -1U) {
+					glm::mat3 light_from_normal = glm::inverse(glm::transpose(glm::mat3(light_from_object)));
+					glUniformMatrix3fv(pipeline.LIGHT_FROM_NORMAL_mat3, 1, GL_FALSE, glm::value_ptr(light_from_normal));
+				}
+			}
+
+			//set any requested custom uniforms:
+			if (pipeline.set_uniforms) pipeline.set_uniforms();
+
+			//set up textures:
+			bind_textures(pipeline);
+
+			//draw the object:
+			if (pipeline.index_type != 0) {
+				glDrawRangeElementsBaseVertex(pipeline.type, 0, pipeline.vertex_count - 1, pipeline.count, pipeline.index_type, first_index(pipeline), pipeline.base_vertex);
+			} else {
+				glDrawArrays(pipeline.type, pipeline.start, pipeline.count);
+			}
+			draw_stats.draw_calls += 1;
+		}
 	}
 
+	//(the GPU is done with this segment of the object block ring once these commands complete)
+	if (object_blocks) {
+		assert(next_object_block == object_blocks);
+		object_block_ring.fence();
+	}
+
+	//un-bind textures:
+	for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+		if (bound_textures[i].texture != 0) {
+			glActiveTexture(GL_TEXTURE0 + i);
+			glBindTexture(bound_textures[i].target, 0);
+		}
+	}
+	if (clustered) cluster_buffers.unbind();
+	glActiveTexture(GL_TEXTURE0);
+
 	glUseProgram(0);
 	glBindVertexArray(0);
 
@@ -168,11 +795,39 @@ void Scene::draw(glm::mat4 const &clip_from_world, glm::mat4x3 const &light_from
 
 void Scene::load(std::string const &filename,
 	std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable) {
+	upload(prepare(filename), on_drawable);
+}
+
+void Scene::load(std::string const &filename,
+	std::function< void(Scene &, Transform *, NameID) > const &on_drawable) {
+	upload(prepare(filename), on_drawable);
+}
+
+void Scene::upload(Staging const &staging,
+	std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable) {
+	if (!on_drawable) return;
+	for (auto const &[transform, name] : staging.meshes) {
+		on_drawable(*this, transform, std::string(name.str()));
+	}
+}
+
+void Scene::upload(Staging const &staging,
+	std::function< void(Scene &, Transform *, NameID) > const &on_drawable) {
+	if (!on_drawable) return;
+	for (auto const &[transform, name] : staging.meshes) {
+		on_drawable(*this, transform, name);
+	}
+}
+
+Scene::Staging Scene::prepare(std::string const &filename) {
+	Staging staging;
+	staging.filename = filename;
 
-	std::ifstream file(filename, std::ios::binary);
+	//chunks are read in place from the mapped file (no intermediate copies):
+	MappedFile file(filename);
+	ChunkReader reader(file);
 
-	std::vector< char > names;
-	read_chunk(file, "str0", &names);
+	std::span< char const > names = reader.read< char >("str0");
 
 	struct HierarchyEntry {
 		uint32_t parent;
@@ -183,8 +838,7 @@ void Scene::load(std::string const &filename,
 		glm::vec3 scale;
 	};
 	static_assert(sizeof(HierarchyEntry) == 4 + 4 + 4 + 4*3 + 4*4 + 4*3, "HierarchyEntry is packed.");
-	std::vector< HierarchyEntry > hierarchy;
-	read_chunk(file, "xfh0", &hierarchy);
+	std::span< HierarchyEntry const > hierarchy = reader.read< HierarchyEntry >("xfh0");
 
 	struct MeshEntry {
 		uint32_t transform;
@@ -192,8 +846,7 @@ void Scene::load(std::string const &filename,
 		uint32_t name_end;
 	};
 	static_assert(sizeof(MeshEntry) == 4 + 4 + 4, "MeshEntry is packed.");
-	std::vector< MeshEntry > meshes;
-	read_chunk(file, "msh0", &meshes);
+	std::span< MeshEntry const > meshes = reader.read< MeshEntry >("msh0");
 
 	struct CameraEntry {
 		uint32_t transform;
@@ -202,8 +855,7 @@ void Scene::load(std::string const &filename,
 		float clip_near, clip_far;
 	};
 	static_assert(sizeof(CameraEntry) == 4 + 4 + 4 + 4 + 4, "CameraEntry is packed.");
-	std::vector< CameraEntry > loaded_cameras;
-	read_chunk(file, "cam0", &loaded_cameras);
+	std::span< CameraEntry const > loaded_cameras = reader.read< CameraEntry >("cam0");
 
 	struct LightEntry {
 		uint32_t transform;
@@ -214,8 +866,7 @@ void Scene::load(std::string const &filename,
 		float fov;
 	};
 	static_assert(sizeof(LightEntry) == 4 + 1 + 3 + 4 + 4 + 4, "LightEntry is packed.");
-	std::vector< LightEntry > loaded_lights;
-	read_chunk(file, "lmp0", &loaded_lights);
+	std::span< LightEntry const > loaded_lights = reader.read< LightEntry >("lmp0");
 
 
 	//--------------------------------
@@ -248,6 +899,8 @@ void Scene::load(std::string const &filename,
 	}
 	assert(hierarchy_transforms.size() == hierarchy.size());
 
+	//mesh entries often share names, so intern each name (by its range in the string table) only once:
+	std::unordered_map< uint64_t, NameID > mesh_names;
 	for (auto const &m : meshes) {
 		if (m.transform >= hierarchy_transforms.size()) {
 			throw std::runtime_error("scene file '" + filename + "' contains mesh entry with invalid transform index (" + std::to_string(m.transform) + ")");
@@ -255,12 +908,13 @@ void Scene::load(std::string const &filename,
 		if (!(m.name_begin <= m.name_end && m.name_end <= names.size())) {
 			throw std::runtime_error("scene file '" + filename + "' contains mesh entry with invalid name indices");
 		}
-		std::string name = std::string(names.begin() + m.name_begin, names.begin() + m.name_end);
-
-		if (on_drawable) {
-			on_drawable(*this, hierarchy_transforms[m.transform], name);
+		auto f = mesh_names.emplace((uint64_t(m.name_begin) << 32) | m.name_end, NameID());
+		if (f.second) {
+			f.first->second = NameID(std::string_view(names.data() + m.name_begin, m.name_end - m.name_begin));
 		}
 
+		//(drawables are made by upload())
+		staging.meshes.emplace_back(hierarchy_transforms[m.transform], f.first->second);
 	}
 
 	for (auto const &c : loaded_cameras) {
@@ -299,17 +953,36 @@ void Scene::load(std::string const &filename,
 		light->type = static_cast<Light::Type>(l.type);
 		light->energy = glm::vec3(l.color) / 255.0f * l.energy;
 		light->spot_fov = l.fov / 180.0f * 3.1415926f; //FOV is stored in degrees; convert to radians.
+		light->distance = l.distance;
 	}
 
 	//load any extra that a subclass wants:
-	load_extra(file, names, hierarchy_transforms);
+	// (from a stream of every chunk read above didn't use, in file order -- chunks in files with a directory may be in
+	//  any order and have padding between them, so they are copied out rather than streamed from the mapped file)
+	std::vector< char > extra;
+	for (auto const &entry : reader.entries) {
+		bool used = false;
+		for (char const *magic : { "str0", "xfh0", "msh0", "cam0", "lmp0" }) {
+			if (&entry == reader.find(magic)) used = true;
+		}
+		if (used) continue;
+		if (reader.verify && entry.has_crc32 && chunk_crc32(entry.data, entry.size) != entry.crc32) {
+			throw std::runtime_error("Checksum mismatch in chunk '" + entry.magic + "'");
+		}
+		//(as stored -- compressed chunks keep their flag, which read_chunk() understands)
+		uint32_t size = entry.size | (entry.compressed ? ChunkCompressed : 0);
+		extra.insert(extra.end(), entry.magic.begin(), entry.magic.end());
+		extra.insert(extra.end(), reinterpret_cast< char const * >(&size), reinterpret_cast< char const * >(&size) + 4);
+		extra.insert(extra.end(), entry.data, entry.data + entry.size);
+	}
+	MemoryStream rest(extra.data(), extra.data() + extra.size());
+	load_extra(rest, std::vector< char >(names.begin(), names.end()), hierarchy_transforms);
 
-	if (file.peek() != EOF) {
+	if (reader.trailing) {
 		std::cerr << "WARNING: trailing data in scene file '" << filename << "'" << std::endl;
 	}
 
-
-
+	return staging;
 }
 
 //-------------------------
@@ -322,6 +995,19 @@ Scene::Scene(Scene const &other) {
 	set(other);
 }
 
+Scene::~Scene() {
+	object_block_ring.release();
+	cluster_buffers.release();
+	if (instance_buffer != 0) {
+		glDeleteBuffers(1, &instance_buffer);
+		instance_buffer = 0;
+	}
+	if (lights_buffer != 0) {
+		glDeleteBuffers(1, &lights_buffer);
+		lights_buffer = 0;
+	}
+}
+
 Scene &Scene::operator=(Scene const &other) {
 	set(other);
 	return *this;
@@ -369,6 +1055,9 @@ void Scene::set(Scene const &other, std::unordered_map< Transform const *, Trans
 		c.transform = transform_to_transform.at(c.transform);
 	}
 
+	//a hierarchy built over other's drawables doesn't apply to these ones:
+	bvh = nullptr;
+
 	//copy other's lights, updating transform pointers:
 	lights = other.lights;
 	for (auto &l : lights) {
@@ -11,16 +11,23 @@
  */
 
 #include "GL.hpp"
+#include "ChunkList.hpp"
+#include "WorldMatrixBatch.hpp"
+#include "LightClusters.hpp"
+#include "NameID.hpp"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 
-#include <list>
 #include <memory>
 #include <functional>
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <compare>
+#include <limits>
+
+struct BVH;
 
 struct Scene {
 	struct Transform {
@@ -40,9 +47,41 @@ struct Scene {
 		glm::mat4x3 make_parent_from_local() const;
 		glm::mat4x3 make_local_from_parent() const;
 		// ..relative to the world:
+		// (these are served from 'world_cache' below, so calling them many times per frame is cheap)
 		glm::mat4x3 make_world_from_local() const;
 		glm::mat4x3 make_local_from_world() const;
 
+		//Cached world matrices:
+		// The cache remembers the position/rotation/scale/parent it was built from and is rebuilt
+		// (lazily, on the next make_*_world* call) when any of these -- or any ancestor's -- change.
+		// This means code can keep assigning to position/rotation/scale/parent directly.
+		// NOTE: the cache is updated from const functions, so don't query one hierarchy from several threads at once.
+		struct WorldCache {
+			//local values world_from_local was computed from:
+			glm::vec3 position = glm::vec3(0.0f);
+			glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+			glm::vec3 scale = glm::vec3(1.0f);
+			Transform const *parent = nullptr;
+			uint64_t parent_generation = 0; //parent's generation when world_from_local was computed
+
+			//generation stamp; changes (to a globally unique value) whenever world_from_local is recomputed:
+			uint64_t generation = 0; //(0 means 'never computed')
+			uint64_t inverse_generation = 0; //generation at which local_from_world was computed
+			uint64_t sweep = 0; //last Scene::update_world_matrices() pass that visited this transform
+			int32_t batch_index = -1; //index in that pass's WorldMatrixBatch (or -1 if not recomputed in that pass)
+
+			glm::mat4x3 world_from_local = glm::mat4x3(1.0f);
+			glm::mat4x3 local_from_world = glm::mat4x3(1.0f);
+		};
+		mutable WorldCache world_cache;
+
+		//bring world_cache.world_from_local up to date (updating ancestors first):
+		void update_world_cache() const;
+		//bring world_cache.world_from_local up to date, assuming parent's cache is already current:
+		void refresh_world_cache() const;
+		//force the cache to be rebuilt on next use (e.g., if you suspect it is stale for some reason):
+		void mark_dirty() const { world_cache.generation = 0; }
+
 		//since hierarchy is tracked through pointers, copy-constructing a transform  is not advised:
 		Transform(Transform const &) = delete;
 		//if we delete some constructors, we need to let the compiler know that the default constructor is still okay:
@@ -54,6 +93,13 @@ struct Scene {
 		Drawable(Transform *transform_) : transform(transform_) { assert(transform); }
 		Transform * transform;
 
+		//(optional) object-space bounding box, used by draw() to skip drawables that are off-screen:
+		// (the default -- min > max -- means "no bounds", and the drawable is never culled)
+		// typically copied from the Mesh's min/max
+		glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+		glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+		bool has_bounds() const { return min.x <= max.x && min.y <= max.y && min.z <= max.z; }
+
 		//Contains all the data needed to run the OpenGL pipeline:
 		struct Pipeline {
 			GLuint program = 0; //shader program; passed to glUseProgram
@@ -65,11 +111,27 @@ struct Scene {
 			GLuint start = 0; //first vertex to draw; passed to glDrawArrays
 			GLuint count = 0; //number of vertices to draw; passed to glDrawArrays
 
+			//...or, to draw 'count' indices starting at index 'start' from the vao's element array buffer (see Mesh):
+			GLenum index_type = 0; //GL_UNSIGNED_SHORT or GL_UNSIGNED_INT; if set, draw() uses glDrawRangeElementsBaseVertex instead of glDrawArrays
+			GLint base_vertex = 0; //added to every index
+			GLuint vertex_count = 0; //indices are in [0, vertex_count)
+
+			//vertex positions are scaled, then offset, by these before the object-to-world transform:
+			// (meshes with quantized positions need this -- copy from Mesh::position_scale and Mesh::position_offset)
+			glm::vec3 position_scale = glm::vec3(1.0f);
+			glm::vec3 position_offset = glm::vec3(0.0f);
+
 			//uniforms:
 			GLuint CLIP_FROM_OBJECT_mat4 = -1U; //uniform location for object to clip space matrix
 			GLuint LIGHT_FROM_OBJECT_mat4x3 = -1U; //uniform location for object to light space (== world space) matrix
 			GLuint LIGHT_FROM_NORMAL_mat3 = -1U; //uniform location for normal to light space (== world space) matrix
 
+			//...or, instead of the three uniforms above, a per-object uniform block (see Scene::ObjectBlock):
+			GLuint OBJECT_block = -1U; //uniform block index; if set, draw() binds this drawable's range of a shared uniform buffer
+
+			//scene lights (see Scene::LightsBlock):
+			GLuint LIGHTS_block = -1U; //uniform block index; if set, draw() uploads the scene's lights and picks lights for this drawable
+
 			std::function< void() > set_uniforms; //(optional) function to set any other useful uniforms
 
 			//texture objects to bind for the first TextureCount textures:
@@ -78,6 +140,23 @@ struct Scene {
 				GLuint texture = 0;
 				GLenum target = GL_TEXTURE_2D;
 			} textures[TextureCount];
+
+			//(optional) instanced version of this pipeline:
+			// when several drawables share program, vao, textures, and vertex range (and have no set_uniforms),
+			// Scene::draw() draws them all in one glDrawArraysInstanced (or, if indexed, glDrawElementsInstancedBaseVertex) call using this program + vao instead.
+			struct Instanced {
+				GLuint program = 0; //shader program that reads per-instance matrices from attributes
+				GLuint vao = 0; //attrib->buffer mapping for per-vertex attributes; per-instance attributes are pointed at the scene's instance buffer by draw()
+
+				//per-instance attributes (locations of first column):
+				GLuint WORLD_FROM_OBJECT_mat4x3 = -1U; //object to world space matrix
+				GLuint WORLD_FROM_NORMAL_mat3 = -1U; //normal to world space matrix
+
+				//uniforms:
+				GLuint CLIP_FROM_WORLD_mat4 = -1U; //world to clip space matrix
+				GLuint LIGHT_FROM_WORLD_mat4x3 = -1U; //world to light space matrix
+				GLuint LIGHT_FROM_WORLD_NORMAL_mat3 = -1U; //world-space normal to light space matrix
+			} instanced;
 		} pipeline;
 	};
 
@@ -114,33 +193,260 @@ struct Scene {
 
 		//Spotlight specific:
 		float spot_fov = glm::radians(45.0f); //spot cone fov (in radians)
+
+		//Point/spot lights: distance beyond which the light is ignored (0 means "no limit"):
+		float distance = 0.0f;
 	};
 
 	//Scenes, of course, may have many of the above objects:
-	std::list< Transform > transforms;
-	std::list< Drawable > drawables;
-	std::list< Camera > cameras;
-	std::list< Light > lights;
+	// (ChunkList works like std::list -- pointers to elements stay valid as elements are added --
+	//  but stores elements contiguously, so sweeping over them is cache-friendly.)
+	ChunkList< Transform > transforms; //NOTE: keep parents before children (as load() does) for the fastest update_world_matrices()
+	ChunkList< Drawable > drawables;
+	ChunkList< Camera > cameras;
+	ChunkList< Light > lights;
+
+	//bring the cached world matrices of every transform up to date in one linear sweep:
+	// (called by draw(); works with any ordering of 'transforms', but parent-before-child is fastest)
+	// changed transforms are gathered into a structure-of-arrays batch and computed with SIMD.
+	void update_world_matrices() const;
+	mutable uint64_t world_sweep = 0; //stamp of the most recent update_world_matrices() pass over this scene
+	mutable WorldMatrixBatch world_batch; //scratch space for update_world_matrices()
+	mutable std::vector< Transform const * > world_batch_transforms; //transform for each world_batch entry
 
 	//The "draw" function provides a convenient way to pass all the things in a scene to OpenGL:
+	// (drawables are submitted sorted by pipeline state -- program, vao, textures, primitive type --
+	//  so the order of 'drawables' only matters between drawables with identical state;
+	//  repeated meshes are drawn with instancing -- see 'instancing' below)
 	void draw(Camera const &camera) const;
 
 	//..sometimes, you want to draw with a custom projection matrix and/or light space:
 	void draw(glm::mat4 const &clip_from_world, glm::mat4x3 const &light_from_world = glm::mat4x3(1.0f)) const;
 
+	//view-frustum culling: drawables with bounds are tested against the view before drawing:
+	bool frustum_culling = true;
+	//check if a box is entirely outside the view volume (-w <= x,y,z <= w):
+	static bool outside_frustum(glm::mat4 const &clip_from_box, glm::vec3 const &min, glm::vec3 const &max);
+	//(optional) bounding volume hierarchy over this scene's drawables:
+	// if set, draw() updates it and culls with it instead of testing every drawable.
+	// (not owned by the scene; not copied by set())
+	BVH *bvh = nullptr;
+
+	//counters from the most recent draw():
+	struct DrawStats {
+		uint32_t tested = 0; //drawables with bounds checked against the frustum
+		uint32_t culled = 0; //...of which were outside the frustum (and skipped)
+		uint32_t drawn = 0; //drawables sent to OpenGL
+		uint32_t draw_calls = 0; //draw calls issued (fewer than 'drawn' when instancing)
+	};
+	mutable DrawStats draw_stats;
+
+	//instancing: runs of at least 'min_instances' drawables with the same state and vertex range
+	// (and an instanced pipeline) are drawn with one instanced draw call:
+	bool instancing = true;
+	uint32_t min_instances = 2;
+
+	//per-object uniform block, filled by draw() for pipelines with an OBJECT_block:
+	// all blocks for a draw() are written at once into a ring of buffer segments (one map per draw(), fenced
+	// so the CPU never overwrites a segment the GPU is still reading) and each drawable binds its range.
+	// GLSL declaration:
+	//   layout(std140) uniform Object {
+	//     mat4 CLIP_FROM_OBJECT;
+	//     mat4x3 LIGHT_FROM_OBJECT;
+	//     mat3 LIGHT_FROM_NORMAL;
+	//     ivec4 OBJECT_LIGHTS[2]; //(optional) indices into LIGHTS of the lights that affect this object...
+	//     int OBJECT_LIGHT_COUNT; //...and how many there are
+	//   };
+	// programs should bind their block to ObjectBlockBinding with glUniformBlockBinding.
+	enum : uint32_t { MaxObjectLights = 8 }; //lights per drawable (for pipelines with a LIGHTS_block)
+	struct ObjectBlock {
+		glm::mat4 CLIP_FROM_OBJECT;
+		glm::vec4 LIGHT_FROM_OBJECT[4]; //(std140 pads each mat4x3 column to a vec4)
+		glm::vec4 LIGHT_FROM_NORMAL[3]; //(...and each mat3 column)
+		glm::ivec4 OBJECT_LIGHTS[MaxObjectLights / 4];
+		glm::ivec4 OBJECT_LIGHT_COUNT; //(only .x is used)
+	};
+	static_assert(sizeof(ObjectBlock) == 4*4*4 + 4*4*4 + 3*4*4 + 2*4*4 + 4*4, "ObjectBlock matches std140 layout.");
+	enum : GLuint { ObjectBlockBinding = 0 }; //uniform buffer binding point used for the Object block
+
+	//scene lights, uploaded by draw() for pipelines with a LIGHTS_block:
+	// each drawable gets (in its ObjectBlock) the MaxObjectLights lights nearest to its bounds;
+	// hemisphere and directional lights are never out of range and are picked first.
+	// at most MaxLights lights are used (the first ones in 'lights').
+	// (with 'light_clusters' set, lights are instead clustered -- see below)
+	// GLSL declaration:
+	//   struct Light {
+	//     vec4 position; //xyz: position (in light space), w: type (0: point, 1: hemisphere, 2: spot, 3: directional)
+	//     vec4 direction; //xyz: direction (in light space), w: spot cutoff (cosine of half the cone angle)
+	//     vec4 energy; //xyz: energy, w: unused
+	//   };
+	//   layout(std140) uniform Lights {
+	//     ivec4 LIGHT_COUNT; //(only .x is used)
+	//     ivec4 CLUSTER_DIMS; //xyz: cluster grid size, w: 1 if lights are clustered
+	//     vec4 CLUSTER_FROM_WINDOW; //cluster xy = gl_FragCoord.xy * CLUSTER_FROM_WINDOW.xy + CLUSTER_FROM_WINDOW.zw
+	//     vec4 CLUSTER_DEPTH; //cluster z = log(1.0 / gl_FragCoord.w) * CLUSTER_DEPTH.x + CLUSTER_DEPTH.y
+	//     Light LIGHTS[MAX_LIGHTS];
+	//   };
+	enum : uint32_t { MaxLights = 64 };
+	struct PackedLight {
+		glm::vec4 position;
+		glm::vec4 direction;
+		glm::vec4 energy;
+	};
+	struct LightsBlock {
+		glm::ivec4 LIGHT_COUNT;
+		glm::ivec4 CLUSTER_DIMS;
+		glm::vec4 CLUSTER_FROM_WINDOW;
+		glm::vec4 CLUSTER_DEPTH;
+		PackedLight LIGHTS[MaxLights];
+	};
+	static_assert(sizeof(LightsBlock) == 4 * 4*4 + MaxLights * 3*4*4, "LightsBlock matches std140 layout.");
+	enum : GLuint { LightsBlockBinding = 1 }; //uniform buffer binding point used for the Lights block
+
+	//(optional) clustered lighting, for scenes with many point and spot lights:
+	// if set, draw() assigns point and spot lights to the clusters of the view volume (see LightClusters.hpp)
+	// and the fragment shader loops over the lights in its cluster (plus the hemisphere and directional lights in LIGHTS).
+	// (not owned by the scene; may be shared between scenes)
+	// GLSL declaration (texture units are fixed, so bind the samplers to these once):
+	//   uniform samplerBuffer CLUSTER_LIGHTS; //unit ClusterLightsUnit: three texels (position, direction, energy) per light
+	//   uniform usamplerBuffer CLUSTER_GRID; //unit ClusterGridUnit: (first, count) in CLUSTER_INDICES per cluster
+	//   uniform usamplerBuffer CLUSTER_INDICES; //unit ClusterIndicesUnit: light index (in CLUSTER_LIGHTS)
+	LightClusters *light_clusters = nullptr;
+	enum : GLuint {
+		ClusterLightsUnit = Drawable::Pipeline::TextureCount,
+		ClusterGridUnit,
+		ClusterIndicesUnit
+	};
+	//point/spot lights with no distance limit are clustered out to where their (1/d^2) falloff drops below this:
+	float light_cutoff = 1.0f / 256.0f;
+	//radius of the sphere a point/spot light is clustered with (its distance, or where it falls below light_cutoff):
+	float cluster_radius(Light const &light) const;
+
+	//render queue used by draw():
+	struct DrawKey {
+		GLuint program = 0;
+		GLuint vao = 0;
+		GLuint textures[Drawable::Pipeline::TextureCount] = { };
+		GLenum type = GL_TRIANGLES;
+		GLuint instanced_program = 0; //instanced.program if drawable could be instanced, otherwise 0
+		GLuint start = 0;
+		GLuint count = 0;
+		GLenum index_type = 0;
+		GLint base_vertex = 0;
+		auto operator<=>(DrawKey const &) const = default;
+	};
+	struct DrawItem {
+		DrawKey key;
+		Drawable const *drawable = nullptr;
+	};
+	//a range of the (sorted) queue, drawn either one-by-one or as instances:
+	struct DrawBatch {
+		uint32_t begin = 0, end = 0;
+		uint32_t first_instance = -1U; //index into instance_data, or -1U if not instanced
+	};
+	//per-instance attributes, as stored in the instance buffer:
+	struct InstanceData {
+		glm::mat4x3 world_from_object;
+		glm::mat3 world_from_normal;
+	};
+	static_assert(sizeof(InstanceData) == 4*3*4 + 4*3*3, "InstanceData is packed.");
+	//scratch space for draw():
+	mutable std::vector< Drawable const * > visible_drawables;
+	mutable std::vector< DrawItem > draw_queue;
+	mutable std::vector< DrawBatch > draw_batches;
+	mutable std::vector< InstanceData > instance_data;
+	//OpenGL objects used by draw() (made on first use; deleted with the scene -- not shared with copies):
+	mutable GLuint instance_buffer = 0; //holds instance_data
+	mutable GLuint lights_buffer = 0; //holds lights_block
+	//ring of uniform buffer segments for per-object blocks:
+	// each draw() writes all its blocks into the next segment; a fence per segment keeps
+	// the CPU from overwriting data the GPU hasn't read yet.
+	struct ObjectBlockRing {
+		enum : uint32_t { Segments = 3 };
+
+		GLuint buffer = 0;
+		GLsizeiptr stride = 0; //sizeof(ObjectBlock) rounded up to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+		GLsizeiptr segment_size = 0;
+		uint32_t segment = 0; //segment currently being written/used
+		GLsync fences[Segments] = { };
+
+		//map space for 'count' blocks in the next segment (leaves buffer bound to GL_UNIFORM_BUFFER until unmap()):
+		char *map(uint32_t count);
+		void unmap();
+		//call once the GPU commands reading the current segment have been issued:
+		void fence();
+		//offset of a block in the current segment:
+		GLintptr offset(uint32_t index) const {
+			return GLintptr(segment) * segment_size + GLintptr(index) * stride;
+		}
+		//delete the buffer and fences:
+		void release();
+
+		ObjectBlockRing() = default;
+		ObjectBlockRing(ObjectBlockRing const &) = delete; //(OpenGL objects have one owner)
+		ObjectBlockRing &operator=(ObjectBlockRing const &) = delete;
+	};
+	mutable ObjectBlockRing object_block_ring;
+	//texture buffers holding light clusters (see light_clusters):
+	struct ClusterBuffers {
+		enum : uint32_t { Count = 3 }; //lights, grid, indices
+		GLuint buffers[Count] = { };
+		GLuint textures[Count] = { };
+		GLuint const units[Count] = { ClusterLightsUnit, ClusterGridUnit, ClusterIndicesUnit };
+
+		void upload(uint32_t i, GLenum format, void const *data, size_t size);
+		void bind();
+		void unbind();
+		//delete the buffers and textures:
+		void release();
+
+		ClusterBuffers() = default;
+		ClusterBuffers(ClusterBuffers const &) = delete; //(OpenGL objects have one owner)
+		ClusterBuffers &operator=(ClusterBuffers const &) = delete;
+	};
+	mutable ClusterBuffers cluster_buffers;
+	mutable LightsBlock lights_block;
+	mutable std::vector< glm::vec4 > light_ranges; //world-space position and range of each light in lights_block
+	                                                //(range > 0: reaches that far; 0: no distance limit, picked by distance; < 0: always picked first -- hemisphere/directional)
+	mutable std::vector< std::pair< float, int32_t > > light_order; //(distance, index) for picking a drawable's lights
+	mutable std::vector< PackedLight > cluster_lights; //lights uploaded for clustering...
+	mutable std::vector< LightClusters::Light > cluster_spheres; //...and their world-space bounding spheres
+
 	//add transforms/objects/cameras from a scene file to this scene:
 	// the 'on_drawable' callback gives your code a chance to look up mesh data and make Drawables:
 	// throws on file format errors
 	void load(std::string const &filename,
 		std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable = nullptr
 	);
+	//...with mesh names passed as interned NameIDs (resolved once per name as the file is read; faster to look up -- see MeshBuffer::lookup):
+	void load(std::string const &filename,
+		std::function< void(Scene &, Transform *, NameID) > const &on_drawable
+	);
+
+	//load() in two phases (see Load.hpp):
+	// prepare() reads the file and adds transforms/cameras/lights (no OpenGL calls; safe on a loader worker thread),
+	// upload() then calls 'on_drawable' for each mesh in the file (on the main thread, since Drawables generally need OpenGL objects)
+	struct Staging {
+		std::string filename;
+		std::vector< std::pair< Transform *, NameID > > meshes; //transform and mesh name of each mesh entry
+	};
+	Staging prepare(std::string const &filename);
+	void upload(Staging const &staging,
+		std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable
+	);
+	void upload(Staging const &staging,
+		std::function< void(Scene &, Transform *, NameID) > const &on_drawable
+	);
 
 	//this function is called to read extra chunks from the scene file after the main chunks are read:
 	// this is useful if you, e.g., subclassing scene to represent a game level/area
+	// ('from' holds every chunk other than the main ones, in file order -- read them with read_chunk())
 	virtual void load_extra(std::istream &from, std::vector< char > const &str0, std::vector< Transform * > const &xfh0) { }
 
 	//empty scene:
 	Scene() = default;
+	//(deletes the OpenGL objects draw() made, so destroy scenes that have been drawn before the OpenGL context)
+	virtual ~Scene();
 
 	//load a scene:
 	Scene(std::string const &filename, std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable);
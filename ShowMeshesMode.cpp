@@ -3,6 +3,7 @@
 #include "ShowMeshesProgram.hpp"
 #include "DrawLines.hpp"
 
+#include <algorithm>
 #include <iostream>
 
 ShowMeshesMode::ShowMeshesMode(MeshBuffer const &buffer_) : buffer(buffer_) {
@@ -30,11 +31,15 @@ ShowMeshesMode::ShowMeshesMode(MeshBuffer const &buffer_) : buffer(buffer_) {
 		scene_drawable->pipeline.count = 0;
 	}
 
-	//select first mesh in buffer:
-	if (!buffer.meshes.empty()) {
-		current_mesh_name = buffer.meshes.begin()->first;
+	//list meshes in name order:
+	mesh_names.reserve(buffer.meshes.size());
+	for (auto const &slot : buffer.meshes) {
+		mesh_names.emplace_back(slot.str);
 	}
-	select_prev_mesh();
+	std::sort(mesh_names.begin(), mesh_names.end());
+
+	//select first mesh in buffer:
+	select_mesh(mesh_names.empty() ? "" : mesh_names[0]);
 }
 
 ShowMeshesMode::~ShowMeshesMode() {
@@ -155,55 +160,40 @@ void ShowMeshesMode::draw(glm::uvec2 const &drawable_size) {
 }
 
 void ShowMeshesMode::select_prev_mesh() {
-	auto f = buffer.meshes.find(current_mesh_name);
-	if (f != buffer.meshes.end()) {
-		if (f != buffer.meshes.begin()) --f;
-	}
-
-	if (f != buffer.meshes.end()) {
-		current_mesh_name = f->first;
-		scene_drawable->pipeline.type = f->second.type;
-		scene_drawable->pipeline.start = f->second.start;
-		scene_drawable->pipeline.count = f->second.count;
-		current_mesh_min = f->second.min;
-		current_mesh_max = f->second.max;
-	} else {
-		current_mesh_name = "";
-		scene_drawable->pipeline.type = GL_TRIANGLES;
-		scene_drawable->pipeline.start = 0;
-		scene_drawable->pipeline.count = 0;
-		current_mesh_min = glm::vec3(0.0f);
-		current_mesh_max = glm::vec3(0.0f);
-	}
+	auto f = std::lower_bound(mesh_names.begin(), mesh_names.end(), current_mesh_name);
+	if (f != mesh_names.begin()) --f;
+	select_mesh(f != mesh_names.end() ? *f : "");
 }
 
 void ShowMeshesMode::select_next_mesh() {
-	auto f = buffer.meshes.find(current_mesh_name);
-	if (f != buffer.meshes.end()) {
-		++f;
-		if (f == buffer.meshes.end()) --f;
-	}
-	if (f == buffer.meshes.end()) {
-		auto temp = buffer.meshes.rbegin();
-		if (temp != buffer.meshes.rend()) {
-			++temp;
-			f = temp.base();
-			assert(f != buffer.meshes.end());
-		}
-	}
+	auto f = std::upper_bound(mesh_names.begin(), mesh_names.end(), current_mesh_name);
+	if (f == mesh_names.end() && f != mesh_names.begin()) --f;
+	select_mesh(f != mesh_names.end() ? *f : "");
+}
 
-	if (f != buffer.meshes.end()) {
-		current_mesh_name = f->first;
-		scene_drawable->pipeline.type = f->second.type;
-		scene_drawable->pipeline.start = f->second.start;
-		scene_drawable->pipeline.count = f->second.count;
-		current_mesh_min = f->second.min;
-		current_mesh_max = f->second.max;
+void ShowMeshesMode::select_mesh(std::string const &name) {
+	Mesh const *mesh = buffer.meshes.find(std::string_view(name));
+
+	if (mesh) {
+		current_mesh_name = name;
+		scene_drawable->pipeline.type = mesh->type;
+		scene_drawable->pipeline.start = mesh->start;
+		scene_drawable->pipeline.count = mesh->count;
+		scene_drawable->pipeline.index_type = mesh->index_type;
+		scene_drawable->pipeline.base_vertex = mesh->base_vertex;
+		scene_drawable->pipeline.vertex_count = mesh->vertex_count;
+		scene_drawable->pipeline.position_scale = mesh->position_scale;
+		scene_drawable->pipeline.position_offset = mesh->position_offset;
+		current_mesh_min = mesh->min;
+		current_mesh_max = mesh->max;
 	} else {
 		current_mesh_name = "";
 		scene_drawable->pipeline.type = GL_TRIANGLES;
 		scene_drawable->pipeline.start = 0;
 		scene_drawable->pipeline.count = 0;
+		scene_drawable->pipeline.index_type = 0;
+		scene_drawable->pipeline.position_scale = glm::vec3(1.0f);
+		scene_drawable->pipeline.position_offset = glm::vec3(0.0f);
 		current_mesh_min = glm::vec3(0.0f);
 		current_mesh_max = glm::vec3(0.0f);
 	}
@@ -30,12 +30,16 @@ struct ShowMeshesMode : Mode {
 	//MeshBuffer being viewed:
 	MeshBuffer const &buffer;
 
+	//names of meshes in the buffer, sorted (MeshBuffer::meshes is a hash table, so has no useful order):
+	std::vector< std::string > mesh_names;
+
 	//currently selected mesh:
 	std::string current_mesh_name = "";
 	glm::vec3 current_mesh_min = glm::vec3(0.0f);
 	glm::vec3 current_mesh_max = glm::vec3(0.0f);
 	void select_prev_mesh();
 	void select_next_mesh();
+	void select_mesh(std::string const &name); //(or nothing, if name isn't in the buffer)
 	
 	//Vertex array object used to bind mesh buffer for drawing:
 	GLuint vao = 0;
@@ -14,6 +14,8 @@ ShowSceneMode::ShowSceneMode(Scene const &scene_) : scene(scene_) {
 		scene_camera->near = 0.01f;
 		//scene_camera->transform and scene_camera->aspect will be set in draw()
 	}
+
+	bvh.build(scene);
 }
 
 ShowSceneMode::~ShowSceneMode() {
@@ -61,6 +63,32 @@ bool ShowSceneMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_
 			return true;
 		}
 	}
+	//----- right-click picking -----
+	if (evt.type == SDL_EVENT_MOUSE_BUTTON_DOWN && evt.button.button == SDL_BUTTON_RIGHT) {
+		//ray through the mouse position, in camera space:
+		float tan_half_fovy = std::tan(0.5f * scene_camera->fovy);
+		float aspect = float(window_size.x) / float(window_size.y);
+		glm::vec3 direction = glm::vec3(
+			(evt.button.x / float(window_size.x) * 2.0f - 1.0f) * tan_half_fovy * aspect,
+			(1.0f - evt.button.y / float(window_size.y) * 2.0f) * tan_half_fovy,
+			-1.0f
+		);
+		//...and in world space:
+		glm::mat4x3 world_from_camera = scene_camera->transform->make_world_from_local();
+		glm::vec3 origin = world_from_camera[3];
+		direction = world_from_camera * glm::vec4(direction, 0.0f);
+
+		bvh.update(scene);
+		BVH::Hit hit;
+		if (bvh.raycast(origin, direction, &hit)) {
+			picked = hit.drawable;
+			std::cout << "Picked '" << picked->transform->name << "'." << std::endl;
+		} else {
+			picked = nullptr;
+		}
+		return true;
+	}
+
 	//mouse wheel: dolly
 	if (evt.type == SDL_EVENT_MOUSE_WHEEL) {
 		camera.radius *= std::pow(0.5f, 0.1f * evt.wheel.y);
@@ -128,6 +156,19 @@ void ShowSceneMode::draw(glm::uvec2 const &drawable_size) {
 				glm::u8vec4(0xff, 0xff, 0xff, 0xff)
 			);
 		}
+
+		//picked drawable's bounding box:
+		if (picked) {
+			glm::mat4x3 world_from_object = picked->transform->make_world_from_local();
+			glm::vec3 center = 0.5f * (picked->min + picked->max);
+			glm::vec3 extent = 0.5f * (picked->max - picked->min);
+			draw_lines.draw_box(glm::mat4x3(
+				world_from_object[0] * extent.x,
+				world_from_object[1] * extent.y,
+				world_from_object[2] * extent.z,
+				world_from_object * glm::vec4(center, 1.0f)
+			), glm::u8vec4(0xff, 0x00, 0xff, 0xff));
+		}
 		/*
 		glEnable(GL_LINE_SMOOTH);
 		glEnable(GL_BLEND);
@@ -10,6 +10,7 @@
 #include "Mode.hpp"
 #include "Scene.hpp"
 #include "Mesh.hpp"
+#include "BVH.hpp"
 
 struct ShowSceneMode : Mode {
 	ShowSceneMode(Scene const &scene);
@@ -33,4 +34,8 @@ struct ShowSceneMode : Mode {
 	//mode uses a secondary Scene to hold a camera:
 	Scene camera_scene;
 	Scene::Camera *scene_camera = nullptr;
+
+	//right-click to pick a drawable (uses a BVH over the scene's drawables):
+	BVH bvh;
+	Scene::Drawable const *picked = nullptr;
 };
@@ -0,0 +1,41 @@
+#include "Texture.hpp"
+
+#include "load_save_png.hpp"
+#include "Load.hpp"
+#include "gl_errors.hpp"
+
+Texture::Texture(std::string const &filename) : Texture(prepare(filename)) {
+}
+
+Texture::Staging Texture::prepare(std::string const &filename) {
+	Staging staging;
+	staging.filename = filename;
+	load_png(filename, &staging.size, &staging.data, LowerLeftOrigin);
+	return staging;
+}
+
+Texture::Texture(Staging const &staging) : size(staging.size) {
+	//upload data:
+	// (on the OpenGL context's thread -- this may be called from a loader worker thread)
+	load_on_gl_thread([&](){
+		glGenTextures(1, &texture);
+		load_count_gl_objects(1);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size.x, size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, staging.data.data());
+		glGenerateMipmap(GL_TEXTURE_2D);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		GL_ERRORS();
+	});
+}
+
+Texture::~Texture() {
+	if (texture != 0) {
+		glDeleteTextures(1, &texture);
+		texture = 0;
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+/*
+ * A "Texture" is an OpenGL 2D texture (with mipmaps) loaded from a PNG file.
+ *
+ * Textures can be loaded in two phases (see Load.hpp):
+ *  Texture::prepare() decodes the file on any thread, and
+ *  the Texture(Staging) constructor uploads the result on the OpenGL thread.
+ *
+ */
+
+#include "GL.hpp"
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+struct Texture {
+	struct Staging;
+
+	//construct from a PNG file (same as Texture(prepare(filename))):
+	// note: will throw if file fails to read.
+	Texture(std::string const &filename);
+
+	//two-phase loading -- decode a PNG file (no OpenGL calls; safe on any thread):
+	// note: will throw if file fails to read.
+	static Staging prepare(std::string const &filename);
+	//...then create the texture (OpenGL calls: sent to the main thread with load_on_gl_thread if needed):
+	explicit Texture(Staging const &staging);
+
+	~Texture();
+
+	//the texture object is deleted with the Texture, so it isn't copyable:
+	Texture(Texture const &) = delete;
+	Texture &operator=(Texture const &) = delete;
+
+	//This is the OpenGL texture object (GL_TEXTURE_2D; e.g., for Scene::Drawable::Pipeline::textures):
+	GLuint texture = 0;
+	glm::uvec2 size = glm::uvec2(0);
+
+	//CPU-side result of prepare():
+	struct Staging {
+		std::string filename;
+		glm::uvec2 size = glm::uvec2(0);
+		std::vector< glm::u8vec4 > data; //rows from the bottom up (as OpenGL expects)
+	};
+};
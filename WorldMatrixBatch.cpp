@@ -0,0 +1,195 @@
+#include "WorldMatrixBatch.hpp"
+
+#include <cassert>
+
+//SSE is part of the baseline on x86-64 (gcc/clang define __SSE2__; MSVC defines _M_X64):
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define WORLD_MATRIX_BATCH_SSE 1
+#include <xmmintrin.h>
+#endif
+
+void WorldMatrixBatch::clear() {
+	count = 0;
+	px.clear(); py.clear(); pz.clear();
+	qx.clear(); qy.clear(); qz.clear(); qw.clear();
+	sx.clear(); sy.clear(); sz.clear();
+	parent.clear();
+	world_from_parent.clear();
+}
+
+uint32_t WorldMatrixBatch::add(glm::vec3 const &position, glm::quat const &rotation, glm::vec3 const &scale, int32_t parent_) {
+	assert(parent_ == NoParent || (parent_ >= 0 && uint32_t(parent_) < count)); //parents must come before children
+
+	px.emplace_back(position.x); py.emplace_back(position.y); pz.emplace_back(position.z);
+	qx.emplace_back(rotation.x); qy.emplace_back(rotation.y); qz.emplace_back(rotation.z); qw.emplace_back(rotation.w);
+	sx.emplace_back(scale.x); sy.emplace_back(scale.y); sz.emplace_back(scale.z);
+	parent.emplace_back(parent_);
+
+	return count++;
+}
+
+uint32_t WorldMatrixBatch::add(glm::vec3 const &position, glm::quat const &rotation, glm::vec3 const &scale, glm::mat4x3 const &world_from_parent_) {
+	uint32_t ret = add(position, rotation, scale, NoParent);
+	parent[ret] = -2 - int32_t(world_from_parent.size());
+	world_from_parent.emplace_back(world_from_parent_);
+	return ret;
+}
+
+glm::mat4x3 WorldMatrixBatch::world_from_local(uint32_t i) const {
+	assert(i < count);
+	float const *W = &world[i * 16];
+	return glm::mat4x3(
+		glm::vec3(W[0], W[1], W[2]),
+		glm::vec3(W[4], W[5], W[6]),
+		glm::vec3(W[8], W[9], W[10]),
+		glm::vec3(W[12], W[13], W[14])
+	);
+}
+
+void WorldMatrixBatch::compute() {
+	//pad inputs to a multiple of four with identity transforms (so the kernel needs no tail handling):
+	uint32_t padded = (count + 3) & ~3u;
+	px.resize(padded, 0.0f); py.resize(padded, 0.0f); pz.resize(padded, 0.0f);
+	qx.resize(padded, 0.0f); qy.resize(padded, 0.0f); qz.resize(padded, 0.0f); qw.resize(padded, 1.0f);
+	sx.resize(padded, 1.0f); sy.resize(padded, 1.0f); sz.resize(padded, 1.0f);
+
+	local.resize(size_t(padded) * 16);
+	world.resize(size_t(padded) * 16);
+
+	//---- (1) parent_from_local for every entry ----
+	// same math as Scene::Transform::make_parent_from_local() (translate * rotate * scale)
+	// and glm::mat3_cast() (for the rotation)
+
+#ifdef WORLD_MATRIX_BATCH_SSE
+	__m128 const one = _mm_set1_ps(1.0f);
+	__m128 const two = _mm_set1_ps(2.0f);
+	for (uint32_t i = 0; i < padded; i += 4) {
+		__m128 x = _mm_loadu_ps(&qx[i]);
+		__m128 y = _mm_loadu_ps(&qy[i]);
+		__m128 z = _mm_loadu_ps(&qz[i]);
+		__m128 w = _mm_loadu_ps(&qw[i]);
+
+		__m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+		__m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+		__m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+		__m128 s_x = _mm_loadu_ps(&sx[i]);
+		__m128 s_y = _mm_loadu_ps(&sy[i]);
+		__m128 s_z = _mm_loadu_ps(&sz[i]);
+
+		//columns (as x/y/z rows of four entries each):
+		__m128 c[4][4];
+		c[0][0] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), s_x);
+		c[0][1] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), s_x);
+		c[0][2] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), s_x);
+
+		c[1][0] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), s_y);
+		c[1][1] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), s_y);
+		c[1][2] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), s_y);
+
+		c[2][0] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), s_z);
+		c[2][1] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), s_z);
+		c[2][2] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), s_z);
+
+		c[3][0] = _mm_loadu_ps(&px[i]);
+		c[3][1] = _mm_loadu_ps(&py[i]);
+		c[3][2] = _mm_loadu_ps(&pz[i]);
+
+		//transpose from structure-of-arrays to one (x,y,z,0) column per entry:
+		for (uint32_t col = 0; col < 4; ++col) {
+			c[col][3] = _mm_setzero_ps();
+			_MM_TRANSPOSE4_PS(c[col][0], c[col][1], c[col][2], c[col][3]);
+			for (uint32_t k = 0; k < 4; ++k) {
+				_mm_storeu_ps(&local[(i + k) * 16 + col * 4], c[col][k]);
+			}
+		}
+	}
+#else
+	for (uint32_t i = 0; i < padded; ++i) {
+		float x = qx[i], y = qy[i], z = qz[i], w = qw[i];
+		float xx = x * x, yy = y * y, zz = z * z;
+		float xy = x * y, xz = x * z, yz = y * z;
+		float wx = w * x, wy = w * y, wz = w * z;
+
+		float *L = &local[i * 16];
+		L[0]  = (1.0f - 2.0f * (yy + zz)) * sx[i];
+		L[1]  = 2.0f * (xy + wz) * sx[i];
+		L[2]  = 2.0f * (xz - wy) * sx[i];
+		L[3]  = 0.0f;
+		L[4]  = 2.0f * (xy - wz) * sy[i];
+		L[5]  = (1.0f - 2.0f * (xx + zz)) * sy[i];
+		L[6]  = 2.0f * (yz + wx) * sy[i];
+		L[7]  = 0.0f;
+		L[8]  = 2.0f * (xz + wy) * sz[i];
+		L[9]  = 2.0f * (yz - wx) * sz[i];
+		L[10] = (1.0f - 2.0f * (xx + yy)) * sz[i];
+		L[11] = 0.0f;
+		L[12] = px[i];
+		L[13] = py[i];
+		L[14] = pz[i];
+		L[15] = 0.0f;
+	}
+#endif
+
+	//---- (2) world_from_local = world_from_parent * parent_from_local ----
+	// (sequential, since each entry depends on its parent -- but each product is done a column at a time)
+
+	for (uint32_t i = 0; i < count; ++i) {
+		float const *L = &local[i * 16];
+		float *W = &world[i * 16];
+
+		float const *P = nullptr;
+		float external[16];
+		if (parent[i] >= 0) {
+			P = &world[parent[i] * 16];
+		} else if (parent[i] != NoParent) {
+			glm::mat4x3 const &m = world_from_parent[-2 - parent[i]];
+			for (uint32_t col = 0; col < 4; ++col) {
+				external[col * 4 + 0] = m[col].x;
+				external[col * 4 + 1] = m[col].y;
+				external[col * 4 + 2] = m[col].z;
+				external[col * 4 + 3] = 0.0f;
+			}
+			P = external;
+		} else {
+			//root: world_from_local == parent_from_local
+			for (uint32_t k = 0; k < 16; ++k) W[k] = L[k];
+			continue;
+		}
+
+#ifdef WORLD_MATRIX_BATCH_SSE
+		__m128 P0 = _mm_loadu_ps(P + 0);
+		__m128 P1 = _mm_loadu_ps(P + 4);
+		__m128 P2 = _mm_loadu_ps(P + 8);
+		__m128 P3 = _mm_loadu_ps(P + 12);
+		for (uint32_t col = 0; col < 4; ++col) {
+			__m128 l = _mm_loadu_ps(L + col * 4);
+			__m128 r = _mm_add_ps(
+				_mm_add_ps(
+					_mm_mul_ps(P0, _mm_shuffle_ps(l, l, _MM_SHUFFLE(0,0,0,0))),
+					_mm_mul_ps(P1, _mm_shuffle_ps(l, l, _MM_SHUFFLE(1,1,1,1)))
+				),
+				_mm_mul_ps(P2, _mm_shuffle_ps(l, l, _MM_SHUFFLE(2,2,2,2)))
+			);
+			if (col == 3) r = _mm_add_ps(r, P3); //(local matrix has an implicit (0,0,0,1) bottom row)
+			_mm_storeu_ps(W + col * 4, r);
+		}
+#else
+		for (uint32_t col = 0; col < 4; ++col) {
+			for (uint32_t row = 0; row < 3; ++row) {
+				float v = P[0 * 4 + row] * L[col * 4 + 0]
+				        + P[1 * 4 + row] * L[col * 4 + 1]
+				        + P[2 * 4 + row] * L[col * 4 + 2];
+				if (col == 3) v += P[3 * 4 + row]; //(local matrix has an implicit (0,0,0,1) bottom row)
+				W[col * 4 + row] = v;
+			}
+			W[col * 4 + 3] = 0.0f;
+		}
+#endif
+	}
+
+	//drop padding so that add() can continue to append:
+	px.resize(count); py.resize(count); pz.resize(count);
+	qx.resize(count); qy.resize(count); qz.resize(count); qw.resize(count);
+	sx.resize(count); sy.resize(count); sz.resize(count);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+/*
+ * WorldMatrixBatch computes world_from_local matrices for many transforms at once.
+ *
+ * Transforms are added in parent-before-child order; their position/rotation/scale
+ * are stored in structure-of-arrays form so that compute() can build the local
+ * (parent_from_local) matrices four at a time with SSE, then concatenate each
+ * with its parent's world matrix (also with SSE).
+ *
+ * When SSE is not available (e.g., on ARM), compute() uses an equivalent scalar path.
+ *
+ * This is used by Scene::update_world_matrices(), but doesn't depend on Scene
+ * (so it is easy to benchmark -- see bench-transforms.cpp).
+ *
+ */
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <vector>
+#include <cstdint>
+
+struct WorldMatrixBatch {
+	//remove all entries (keeps allocations around for re-use):
+	void clear();
+
+	//Parent references passed to add():
+	enum : int32_t { NoParent = -1 };
+	//add a transform; returns its index in the batch.
+	// 'parent' is either NoParent or the index of an *earlier* entry in this batch:
+	uint32_t add(glm::vec3 const &position, glm::quat const &rotation, glm::vec3 const &scale, int32_t parent = NoParent);
+	//...or, for a transform whose parent is not in the batch, pass the parent's world_from_local directly:
+	uint32_t add(glm::vec3 const &position, glm::quat const &rotation, glm::vec3 const &scale, glm::mat4x3 const &world_from_parent);
+
+	//compute world_from_local for every entry:
+	void compute();
+
+	//read a result of compute():
+	glm::mat4x3 world_from_local(uint32_t i) const;
+
+	uint32_t size() const { return count; }
+
+	//-- internals ---
+	uint32_t count = 0;
+
+	//inputs, structure-of-arrays (each padded to a multiple of four entries):
+	std::vector< float > px, py, pz;
+	std::vector< float > qx, qy, qz, qw;
+	std::vector< float > sx, sy, sz;
+
+	//per-entry parent: index of an earlier entry, NoParent, or (-2 - i) for world_from_parent[i]:
+	std::vector< int32_t > parent;
+	std::vector< glm::mat4x3 > world_from_parent;
+
+	//scratch + outputs, four columns of four floats (w unused) per entry:
+	std::vector< float > local;
+	std::vector< float > world;
+};
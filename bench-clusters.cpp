@@ -0,0 +1,135 @@
+//bench-clusters: benchmark for assigning scene lights to view-volume clusters.
+//
+// Generates a scene -- a square "town" of drawable-free transforms with point and spot lights
+// scattered over it (street lights, windows, etc.) and a camera looking across it -- then, for
+// increasing light counts and thread counts, times LightClusters::assign() as the lights move.
+//
+// Reports per-frame stats: assignment time, lights that reach the view, occupied clusters,
+// and lights per occupied cluster (mean / max), plus a histogram of lights per cluster for the largest run.
+//
+// Usage:
+//  bench-clusters [lights=2048] [frames=100] [town size=200]
+
+#include "Scene.hpp"
+#include "LightClusters.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+int main(int argc, char **argv) {
+	uint32_t count = 2048;
+	uint32_t frames = 100;
+	float size = 200.0f;
+	if (argc > 1) count = std::max(1u, uint32_t(std::stoul(argv[1])));
+	if (argc > 2) frames = std::max(1u, uint32_t(std::stoul(argv[2])));
+	if (argc > 3) size = std::max(1.0f, std::stof(argv[3]));
+
+	//---- generate scene ----
+	Scene scene;
+	std::mt19937 mt(0x15466);
+	std::uniform_real_distribution< float > r(0.0f, 1.0f);
+	for (uint32_t i = 0; i < count; ++i) {
+		Scene::Transform &t = scene.transforms.emplace_back();
+		t.name = "Light." + std::to_string(i);
+		t.position = glm::vec3((r(mt) - 0.5f) * size, (r(mt) - 0.5f) * size, 0.5f + 8.0f * r(mt) * r(mt));
+		//(lights point down-ish)
+		t.rotation = glm::angleAxis(0.5f * r(mt), glm::normalize(glm::vec3(r(mt) - 0.5f, r(mt) - 0.5f, 0.0f)));
+
+		Scene::Light &light = scene.lights.emplace_back(&t);
+		light.type = (r(mt) < 0.75f ? Scene::Light::Point : Scene::Light::Spot);
+		light.energy = glm::vec3(1.0f, 0.8f, 0.6f) * (2.0f + 30.0f * r(mt) * r(mt));
+		light.spot_fov = glm::radians(30.0f + 60.0f * r(mt));
+		//some lights are limited by distance, the rest by falloff (see Scene::cluster_radius):
+		if (r(mt) < 0.5f) light.distance = 2.0f + 10.0f * r(mt);
+	}
+
+	//camera at the edge of town, looking across it:
+	Scene::Transform &camera_transform = scene.transforms.emplace_back();
+	camera_transform.name = "Camera";
+	camera_transform.position = glm::vec3(0.0f, -0.5f * size, 2.0f);
+	camera_transform.rotation = glm::angleAxis(glm::radians(85.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+	Scene::Camera &camera = scene.cameras.emplace_back(&camera_transform);
+	camera.aspect = 16.0f / 9.0f;
+	camera.near = 0.1f;
+
+	glm::mat4 clip_from_world = camera.make_projection() * glm::mat4(camera_transform.make_local_from_world());
+
+	//lights as Scene::draw() would hand them to LightClusters:
+	std::vector< LightClusters::Light > spheres;
+	auto gather = [&](uint32_t lights, uint32_t frame) {
+		spheres.clear();
+		uint32_t i = 0;
+		for (auto const &light : scene.lights) {
+			if (i == lights) break;
+			//bob lights up and down so every frame has new positions:
+			light.transform->position.z += 0.01f * std::sin(0.1f * float(frame + i));
+			spheres.emplace_back(LightClusters::Light{ glm::vec3(light.transform->make_world_from_local()[3]), scene.cluster_radius(light) });
+			++i;
+		}
+	};
+
+	std::vector< uint32_t > thread_counts{ 1 };
+	for (uint32_t t = 2; t <= std::max(1u, std::thread::hardware_concurrency()) && t <= 8; t *= 2) {
+		thread_counts.emplace_back(t);
+	}
+
+	std::cout << "Assigning lights in a " << size << "x" << size << " town to 16x9x24 clusters, " << frames << " frames per run." << std::endl;
+	std::cout << std::setw(8) << "lights" << std::setw(9) << "threads"
+		<< std::setw(12) << "ms/frame" << std::setw(10) << "visible"
+		<< std::setw(10) << "occupied" << std::setw(10) << "mean" << std::setw(8) << "max"
+		<< std::setw(11) << "indices" << std::endl;
+
+	LightClusters::Stats last;
+	std::vector< glm::uvec2 > last_grid;
+	for (uint32_t lights = std::max(1u, count / 8); /* later */; lights = std::min(count, lights * 2)) {
+		for (uint32_t threads : thread_counts) {
+			LightClusters clusters(threads);
+			clusters.far = size;
+
+			double total = 0.0;
+			for (uint32_t frame = 0; frame < frames; ++frame) {
+				gather(lights, frame);
+				clusters.assign(clip_from_world, spheres);
+				total += clusters.stats.assign_ms;
+			}
+			LightClusters::Stats const &stats = clusters.stats;
+			std::cout << std::setw(8) << lights << std::setw(9) << threads
+				<< std::setw(12) << std::fixed << std::setprecision(3) << (total / frames)
+				<< std::setw(10) << stats.visible << std::setw(10) << stats.occupied
+				<< std::setw(10) << std::setprecision(1) << stats.mean_lights << std::setw(8) << stats.max_lights
+				<< std::setw(11) << clusters.indices.size() << std::endl;
+
+			last = stats;
+			last_grid = clusters.grid;
+		}
+		if (lights == count) break;
+	}
+
+	//---- histogram of lights per cluster (largest run) ----
+	std::vector< uint32_t > buckets(8, 0); //0, 1, 2-3, 4-7, ..., 64+
+	for (auto const &cell : last_grid) {
+		uint32_t b = 0;
+		while (b + 1 < buckets.size() && (1u << b) <= cell.y) ++b;
+		buckets[b] += 1;
+	}
+	std::cout << "Lights per cluster (" << count << " lights):" << std::endl;
+	for (uint32_t b = 0; b < buckets.size(); ++b) {
+		std::string label;
+		if (b == 0) label = "0";
+		else if (b == 1) label = "1";
+		else if (b + 1 == buckets.size()) label = std::to_string(1u << (b - 1)) + "+";
+		else label = std::to_string(1u << (b - 1)) + "-" + std::to_string((1u << b) - 1);
+		std::cout << "  " << std::setw(7) << label << ": " << std::setw(6) << buckets[b]
+			<< " " << std::string(size_t(60.0f * buckets[b] / float(std::max(1u, last.clusters))), '#') << std::endl;
+	}
+
+	return 0;
+}
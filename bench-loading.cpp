@@ -0,0 +1,134 @@
+//bench-loading: benchmark for loading .pnct files with and without compressed chunks.
+//
+// For each mesh file, writes two copies next to the executable -- plain (MeshBuffer::write) and with
+// compressed vertex and index chunks (MeshBuffer::write(..., true)) -- then times MeshBuffer::prepare()
+// on the original and on each copy, plus a pass over the vertex and index data (so that the pages of
+// mapped files are actually read):
+//  warm: the file is already in the page cache (median of the runs)
+//  cold: the file's pages are dropped from the page cache before each run (median of the runs)
+//   (with posix_fadvise; linux only -- elsewhere cold runs are reported as "n/a")
+//
+// Usage:
+//  bench-loading [runs=20] [file.pnct ...]
+//  (files default to ../dist/ropegame.pnct and ../dist/inner_mesh_test.pnct)
+
+#include "Mesh.hpp"
+#include "data_path.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+//drop a file's pages from the page cache (false if that isn't possible here):
+static bool evict(std::string const &filename) {
+	#if defined(__linux__)
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+	fdatasync(fd); //(dirty pages can't be dropped)
+	bool ok = (posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0);
+	close(fd);
+	return ok;
+	#else
+	(void)filename;
+	return false;
+	#endif
+}
+
+//load a file the way the game does, and read all of its data; returns milliseconds:
+static double time_load(std::string const &filename) {
+	auto before = std::chrono::high_resolution_clock::now();
+	MeshBuffer::Staging staging = MeshBuffer::prepare(filename);
+	uint64_t sum = 0;
+	for (auto data : { staging.vertices, staging.indices }) {
+		for (size_t i = 0; i + 8 <= data.size(); i += 8) {
+			uint64_t word;
+			std::memcpy(&word, data.data() + i, 8);
+			sum += word;
+		}
+	}
+	auto after = std::chrono::high_resolution_clock::now();
+	static volatile uint64_t sink = 0; //(so the pass over the data isn't optimized away)
+	sink = sink + sum;
+	return std::chrono::duration< double >(after - before).count() * 1000.0;
+}
+
+static double median(std::vector< double > times) {
+	std::sort(times.begin(), times.end());
+	return times.empty() ? 0.0 : times[times.size() / 2];
+}
+
+int main(int argc, char **argv) {
+	uint32_t runs = 20;
+	std::vector< std::string > files;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (i == 1 && !arg.empty() && arg.find_first_not_of("0123456789") == std::string::npos) {
+			runs = std::max(1u, uint32_t(std::stoul(arg)));
+		} else {
+			files.emplace_back(arg);
+		}
+	}
+	if (files.empty()) {
+		files.emplace_back(data_path("../dist/ropegame.pnct"));
+		files.emplace_back(data_path("../dist/inner_mesh_test.pnct"));
+	}
+
+	std::cout << "Loading .pnct files with MeshBuffer::prepare() (plus a pass over the data), median of " << runs << " runs." << std::endl;
+	std::cout << std::setw(24) << "file" << std::setw(13) << "chunks"
+		<< std::setw(10) << "bytes" << std::setw(12) << "warm ms" << std::setw(12) << "cold ms" << std::endl;
+
+	try {
+		for (auto const &file : files) {
+			std::string name = file.substr(file.find_last_of("/\\") + 1);
+
+			//plain and compressed copies:
+			std::string plain = data_path("bench-loading.plain.pnct");
+			std::string compressed = data_path("bench-loading.compressed.pnct");
+			{
+				MeshBuffer::Staging staging = MeshBuffer::prepare(file);
+				std::ofstream out_plain(plain, std::ios::binary);
+				MeshBuffer::write(staging, &out_plain);
+				std::ofstream out_compressed(compressed, std::ios::binary);
+				MeshBuffer::write(staging, &out_compressed, true);
+			}
+
+			for (auto const &[label, path] : std::vector< std::pair< std::string, std::string > >{ { "(original)", file }, { "plain", plain }, { "compressed", compressed } }) {
+				std::vector< double > warm, cold;
+				bool can_evict = true;
+				time_load(path); //(warm up the cache)
+				for (uint32_t run = 0; run < runs; ++run) {
+					warm.emplace_back(time_load(path));
+				}
+				for (uint32_t run = 0; run < runs && can_evict; ++run) {
+					can_evict = evict(path);
+					if (can_evict) cold.emplace_back(time_load(path));
+				}
+
+				size_t bytes = std::ifstream(path, std::ios::binary | std::ios::ate).tellg();
+				std::cout << std::setw(24) << name << std::setw(13) << label << std::setw(10) << bytes
+					<< std::setw(12) << std::fixed << std::setprecision(3) << median(warm);
+				if (can_evict) std::cout << std::setw(12) << median(cold) << std::endl;
+				else std::cout << std::setw(12) << "n/a" << std::endl;
+			}
+
+			std::remove(plain.c_str());
+			std::remove(compressed.c_str());
+		}
+	} catch (std::exception &e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
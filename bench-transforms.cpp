@@ -0,0 +1,119 @@
+//bench-transforms: micro-benchmark for computing Scene world matrices.
+//
+// Builds a scene of transform chains (like the legs of a rig) and times:
+//  - 'recursive': walk the parent chain for every transform, no caching (how make_world_from_local used to work)
+//  - 'lazy':      make_world_from_local() on every transform, using the per-transform cache
+//  - 'batched':   Scene::update_world_matrices() (structure-of-arrays + SIMD)
+// ...both when every transform moves each frame and when nothing moves.
+//
+// Usage:
+//  bench-transforms [transforms=10000] [chain depth=8] [iterations=200]
+
+#include "Scene.hpp"
+
+#include <glm/glm.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <string>
+#include <vector>
+#include <functional>
+
+static glm::mat4x3 recursive_world_from_local(Scene::Transform const &t) {
+	if (!t.parent) return t.make_parent_from_local();
+	return recursive_world_from_local(*t.parent) * glm::mat4(t.make_parent_from_local());
+}
+
+int main(int argc, char **argv) {
+	uint32_t count = 10000;
+	uint32_t depth = 8;
+	uint32_t iterations = 200;
+	if (argc > 1) count = uint32_t(std::stoul(argv[1]));
+	if (argc > 2) depth = std::max(1u, uint32_t(std::stoul(argv[2])));
+	if (argc > 3) iterations = std::max(1u, uint32_t(std::stoul(argv[3])));
+
+	//---- build scene: 'count' transforms arranged as chains of length 'depth' ----
+	Scene scene;
+	std::mt19937 mt(0x15466);
+	std::uniform_real_distribution< float > r(-1.0f, 1.0f);
+	std::vector< Scene::Transform * > roots;
+	for (uint32_t i = 0; i < count; ++i) {
+		Scene::Transform &t = scene.transforms.emplace_back();
+		t.position = glm::vec3(r(mt), r(mt), r(mt));
+		t.rotation = glm::normalize(glm::quat(r(mt), r(mt), r(mt), r(mt)));
+		t.scale = glm::vec3(1.0f + 0.1f * r(mt));
+		if (i % depth == 0) {
+			roots.emplace_back(&t);
+		} else {
+			t.parent = &scene.transforms[i - 1];
+		}
+	}
+
+	std::cout << "Timing world matrices for " << count << " transforms (chains of " << depth << "), " << iterations << " iterations." << std::endl;
+
+	float checksum = 0.0f; //accumulated so the compiler can't skip any work
+
+	//move every root (and, thus, every transform):
+	uint32_t frame = 0;
+	auto move_all = [&]() {
+		++frame;
+		for (auto *t : roots) {
+			t->position.z = 0.001f * float(frame);
+		}
+	};
+
+	auto time = [&](std::string const &name, std::function< void() > const &setup, std::function< void() > const &work) {
+		double total = 0.0;
+		for (uint32_t i = 0; i < iterations; ++i) {
+			setup();
+			auto before = std::chrono::high_resolution_clock::now();
+			work();
+			auto after = std::chrono::high_resolution_clock::now();
+			total += std::chrono::duration< double >(after - before).count();
+		}
+		double per = total / double(iterations) / double(count) * 1e9;
+		std::cout << "  " << std::setw(28) << std::left << name << std::right << std::fixed << std::setprecision(2)
+			<< std::setw(9) << per << " ns/transform  (" << std::setprecision(3) << (total / iterations * 1e3) << " ms/frame)" << std::endl;
+	};
+
+	time("recursive (all moving)", move_all, [&]() {
+		for (auto const &t : scene.transforms) checksum += recursive_world_from_local(t)[3].x;
+	});
+	time("lazy (all moving)", move_all, [&]() {
+		for (auto const &t : scene.transforms) checksum += t.make_world_from_local()[3].x;
+	});
+	time("batched (all moving)", move_all, [&]() {
+		scene.update_world_matrices();
+		checksum += scene.transforms.back().world_cache.world_from_local[3].x;
+	});
+
+	time("recursive (static)", [](){}, [&]() {
+		for (auto const &t : scene.transforms) checksum += recursive_world_from_local(t)[3].x;
+	});
+	time("lazy (static)", [](){}, [&]() {
+		for (auto const &t : scene.transforms) checksum += t.make_world_from_local()[3].x;
+	});
+	time("batched (static)", [](){}, [&]() {
+		scene.update_world_matrices();
+		checksum += scene.transforms.back().world_cache.world_from_local[3].x;
+	});
+
+	//---- check that the batched path agrees with the recursive one ----
+	move_all();
+	scene.update_world_matrices();
+	float max_error = 0.0f;
+	for (auto const &t : scene.transforms) {
+		glm::mat4x3 a = recursive_world_from_local(t);
+		glm::mat4x3 const &b = t.world_cache.world_from_local;
+		for (uint32_t c = 0; c < 4; ++c) {
+			glm::vec3 d = glm::abs(a[c] - b[c]);
+			max_error = std::max(max_error, std::max(d.x, std::max(d.y, d.z)));
+		}
+	}
+	std::cout << "Max difference between batched and recursive results: " << std::scientific << max_error << std::endl;
+	std::cout << "(checksum: " << checksum << ")" << std::endl;
+
+	return 0;
+}
@@ -0,0 +1,297 @@
+//cook-assets: offline tool that turns exported .pnct and .scene files into their runtime-ready forms.
+//
+// Runs headless (no window, no OpenGL context), so it can be part of an asset pipeline.
+//
+// .pnct files are read with MeshBuffer::prepare(), then:
+//  - welded and reordered for the vertex cache, overdraw, and vertex fetch (MeshBuffer::optimize)
+//    (unless that makes them larger, as for flat-shaded meshes whose triangles share no vertices)
+//  - (with --quantize) converted to the compact vertex format (MeshBuffer::quantize)
+//  - meshes with identical contents share one copy of their data (MeshBuffer::merge_duplicates)
+//  - written with each mesh's bounds and 16-byte-aligned chunks (MeshBuffer::write)
+//    (with --compress-chunks, vertex and index chunks are stored compressed -- see ChunkCompressed)
+// .scene files are written with a deduplicated string table and 16-byte-aligned chunks;
+//  their mesh entries are checked against the meshes of any .pnct files cooked in the same run.
+//
+// Other files (e.g., .png textures) are copied as they are.
+//
+// Each output is written to a temporary file and then renamed, so cooking a file in place is fine
+// (and a failed cook leaves no partial output).
+//
+// With --pack, outputs go into one pack file instead (see Pack.hpp) -- named by their paths relative to
+// the pack's directory, which is where the game finds them once the pack is mounted -- and --compress
+// deflates the entries that get smaller.
+//
+// Usage:
+//  cook-assets [--quantize] [--no-optimize] [--compress-chunks] [--quiet] [--pack <file.pack> [--compress]] <input> <output> [<input> <output> ...]
+
+#include "Mesh.hpp"
+#include "MappedFile.hpp"
+#include "Pack.hpp"
+#include "read_write_chunk.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <set>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+	//scene file entries (as in Scene::prepare):
+	struct HierarchyEntry {
+		uint32_t parent;
+		uint32_t name_begin;
+		uint32_t name_end;
+		glm::vec3 position;
+		glm::quat rotation;
+		glm::vec3 scale;
+	};
+	static_assert(sizeof(HierarchyEntry) == 4 + 4 + 4 + 4*3 + 4*4 + 4*3, "HierarchyEntry is packed.");
+
+	struct MeshEntry {
+		uint32_t transform;
+		uint32_t name_begin;
+		uint32_t name_end;
+	};
+	static_assert(sizeof(MeshEntry) == 4 + 4 + 4, "MeshEntry is packed.");
+
+	bool ends_with(std::string const &str, std::string const &suffix) {
+		return str.size() >= suffix.size() && str.substr(str.size() - suffix.size()) == suffix;
+	}
+
+	//write through a temporary file, replacing 'filename' only once everything is written:
+	template< typename F >
+	void write_file(std::string const &filename, F const &write) {
+		std::string temp = filename + ".tmp";
+		{
+			std::ofstream out(temp, std::ios::binary);
+			if (!out) throw std::runtime_error("Failed to open '" + temp + "' for writing.");
+			write(&out);
+			if (!out) throw std::runtime_error("Failed to write '" + temp + "'.");
+		}
+		std::remove(filename.c_str()); //(rename() won't replace existing files on windows)
+		if (std::rename(temp.c_str(), filename.c_str()) != 0) {
+			throw std::runtime_error("Failed to rename '" + temp + "' to '" + filename + "'.");
+		}
+	}
+
+	struct Options {
+		bool optimize = true;
+		bool quantize = false;
+		bool quiet = false;
+		std::string pack; //(pack to write, if any)
+		bool compress = false;
+		bool compress_chunks = false;
+	};
+
+	//where cooked files go -- loose files, or entries of a pack:
+	struct Output {
+		Output(Options const &options_) : options(options_) {
+			size_t slash = options.pack.find_last_of("/\\");
+			pack_directory = (slash == std::string::npos ? "" : options.pack.substr(0, slash + 1));
+		}
+		Options const &options;
+		std::string pack_directory;
+		PackWriter pack;
+
+		void add(std::string const &filename, std::string const &data) {
+			if (options.pack.empty()) {
+				write_file(filename, [&](std::ostream *out) { *out << data; });
+			} else {
+				if (filename.size() <= pack_directory.size() || filename.compare(0, pack_directory.size(), pack_directory) != 0) {
+					throw std::runtime_error("Can't put '" + filename + "' in pack '" + options.pack + "': it isn't in the pack's directory.");
+				}
+				pack.add(filename.substr(pack_directory.size()), std::vector< char >(data.begin(), data.end()), options.compress);
+			}
+		}
+		void finish() {
+			if (options.pack.empty()) return;
+			std::ostringstream data;
+			pack.write(&data);
+			write_file(options.pack, [&](std::ostream *out) { *out << data.str(); });
+			if (!options.quiet) {
+				std::cout << "Wrote " << pack.files.size() << " files to '" << options.pack << "' (" << data.str().size() << " bytes)." << std::endl;
+			}
+		}
+	};
+
+	void cook_meshes(std::string const &from, std::string const &to, Options const &options, Output *output, std::set< std::string > *mesh_names) {
+		std::ostringstream report;
+
+		MeshBuffer::Staging staging = MeshBuffer::prepare(from);
+		size_t before = staging.file->size;
+
+		if (options.optimize) {
+			//(meshes whose triangles share few vertices -- e.g., flat-shaded ones -- get bigger when indexed; keep those as they are)
+			MeshBuffer::Staging optimized = MeshBuffer::prepare(from);
+			MeshBuffer::optimize(&optimized, &report);
+			if (optimized.vertices.size() + optimized.indices.size() <= staging.vertices.size() + staging.indices.size()) {
+				staging = std::move(optimized);
+			} else {
+				report << "  (kept un-optimized: indexing would make vertex data larger)\n";
+			}
+		}
+		if (options.quantize) MeshBuffer::quantize(&staging, &report);
+		MeshBuffer::merge_duplicates(&staging, &report);
+
+		std::ostringstream data;
+		MeshBuffer::write(staging, &data, options.compress_chunks);
+		output->add(to, data.str());
+
+		for (auto const &slot : staging.meshes) {
+			mesh_names->emplace(slot.str);
+		}
+
+		if (!options.quiet) {
+			std::cout << report.str();
+			std::cout << "'" << from << "' (" << before << " bytes) -> '" << to << "' (" << data.str().size() << " bytes), " << staging.meshes.size() << " meshes." << std::endl;
+		}
+	}
+
+	void cook_scene(std::string const &from, std::string const &to, Options const &options, Output *output, std::set< std::string > const &mesh_names) {
+		MappedFile file(from);
+		ChunkReader reader(file);
+
+		std::span< char const > names = reader.read< char >("str0");
+		std::span< HierarchyEntry const > hierarchy = reader.read< HierarchyEntry >("xfh0");
+		std::span< MeshEntry const > meshes = reader.read< MeshEntry >("msh0");
+		std::span< char const > cameras = reader.read< char >("cam0");
+		std::span< char const > lights = reader.read< char >("lmp0");
+
+		//Scene::prepare() passes every chunk it doesn't read (in order) to Scene::load_extra(), so keep those:
+		std::vector< ChunkReader::Entry const * > extra;
+		for (auto const &entry : reader.entries) {
+			bool main = false;
+			for (char const *magic : { "str0", "xfh0", "msh0", "cam0", "lmp0" }) {
+				if (&entry == reader.find(magic)) main = true;
+			}
+			if (!main) extra.emplace_back(&entry);
+		}
+
+		//build a string table with each name stored once:
+		std::vector< char > strings;
+		std::unordered_map< std::string_view, uint32_t > offsets;
+		auto intern = [&](uint32_t name_begin, uint32_t name_end, uint32_t *new_begin, uint32_t *new_end, char const *what) {
+			if (!(name_begin <= name_end && name_end <= names.size())) {
+				throw std::runtime_error("scene file '" + from + "' contains " + what + " entry with invalid name indices");
+			}
+			std::string_view name(names.data() + name_begin, name_end - name_begin);
+			auto f = offsets.emplace(name, uint32_t(strings.size()));
+			if (f.second) strings.insert(strings.end(), name.begin(), name.end());
+			*new_begin = f.first->second;
+			*new_end = f.first->second + uint32_t(name.size());
+			return name;
+		};
+
+		std::vector< HierarchyEntry > new_hierarchy(hierarchy.begin(), hierarchy.end());
+		for (auto &h : new_hierarchy) {
+			intern(h.name_begin, h.name_end, &h.name_begin, &h.name_end, "hierarchy");
+		}
+
+		std::vector< MeshEntry > new_meshes(meshes.begin(), meshes.end());
+		uint32_t missing = 0;
+		for (auto &m : new_meshes) {
+			std::string_view name = intern(m.name_begin, m.name_end, &m.name_begin, &m.name_end, "mesh");
+			if (m.transform >= hierarchy.size()) {
+				throw std::runtime_error("scene file '" + from + "' contains mesh entry with invalid transform index (" + std::to_string(m.transform) + ")");
+			}
+			if (!mesh_names.empty() && !mesh_names.count(std::string(name))) {
+				std::cerr << "WARNING: scene file '" << from << "' refers to mesh '" << name << "', which isn't in any cooked mesh file." << std::endl;
+				missing += 1;
+			}
+		}
+
+		ChunkWriter writer;
+		writer.add("str0", strings);
+		writer.add("xfh0", new_hierarchy);
+		writer.add("msh0", new_meshes);
+		writer.add("cam0", std::vector< char >(cameras.begin(), cameras.end()));
+		writer.add("lmp0", std::vector< char >(lights.begin(), lights.end()));
+		for (auto const *entry : extra) {
+			std::vector< char > contents(entry->data_size());
+			reader.read_into(*entry, contents);
+			writer.add(entry->magic, contents, entry->compressed);
+		}
+
+		std::ostringstream data;
+		writer.write(&data);
+		output->add(to, data.str());
+
+		if (!options.quiet) {
+			std::cout << "'" << from << "' (" << file.size << " bytes) -> '" << to << "' (" << data.str().size() << " bytes), "
+				<< hierarchy.size() << " transforms, " << meshes.size() << " mesh entries (" << missing << " missing), "
+				<< names.size() << " -> " << strings.size() << " bytes of names." << std::endl;
+		}
+	}
+
+	void copy_file(std::string const &from, std::string const &to, Options const &options, Output *output) {
+		MappedFile file(from);
+		output->add(to, std::string(file.data, file.data + file.size));
+		if (!options.quiet) {
+			std::cout << "'" << from << "' -> '" << to << "' (" << file.size << " bytes, copied)." << std::endl;
+		}
+	}
+}
+
+int main(int argc, char **argv) {
+	Options options;
+	std::vector< std::pair< std::string, std::string > > pnct_files, scene_files, other_files;
+
+	bool usage = false;
+	std::vector< std::string > paths;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--quantize") options.quantize = true;
+		else if (arg == "--no-optimize") options.optimize = false;
+		else if (arg == "--quiet") options.quiet = true;
+		else if (arg == "--compress") options.compress = true;
+		else if (arg == "--compress-chunks") options.compress_chunks = true;
+		else if (arg == "--pack" && i + 1 < argc) options.pack = argv[++i];
+		else if (arg.substr(0, 2) == "--") usage = true;
+		else paths.emplace_back(arg);
+	}
+	if (paths.empty() || paths.size() % 2 != 0 || (options.compress && options.pack.empty())) usage = true;
+	for (size_t i = 0; i + 1 < paths.size(); i += 2) {
+		if (ends_with(paths[i], ".pnct") && ends_with(paths[i+1], ".pnct")) {
+			pnct_files.emplace_back(paths[i], paths[i+1]);
+		} else if (ends_with(paths[i], ".scene") && ends_with(paths[i+1], ".scene")) {
+			scene_files.emplace_back(paths[i], paths[i+1]);
+		} else if (ends_with(paths[i], ".pnct") || ends_with(paths[i], ".scene") || ends_with(paths[i+1], ".pnct") || ends_with(paths[i+1], ".scene")) {
+			std::cerr << "Can't cook '" << paths[i] << "' to '" << paths[i+1] << "' (expecting .pnct -> .pnct or .scene -> .scene)." << std::endl;
+			usage = true;
+		} else {
+			other_files.emplace_back(paths[i], paths[i+1]);
+		}
+	}
+	if (usage) {
+		std::cerr << "Usage:\n\t" << argv[0] << " [--quantize] [--no-optimize] [--compress-chunks] [--quiet] [--pack <file.pack> [--compress]] <input> <output> [<input> <output> ...]" << std::endl;
+		return 1;
+	}
+
+	try {
+		//meshes first, so scenes can be checked against them:
+		Output output(options);
+		std::set< std::string > mesh_names;
+		for (auto const &[from, to] : pnct_files) {
+			cook_meshes(from, to, options, &output, &mesh_names);
+		}
+		for (auto const &[from, to] : scene_files) {
+			cook_scene(from, to, options, &output, mesh_names);
+		}
+		for (auto const &[from, to] : other_files) {
+			copy_file(from, to, options, &output);
+		}
+		output.finish();
+	} catch (std::exception &e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
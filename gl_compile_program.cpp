@@ -1,4 +1,5 @@
 #include "gl_compile_program.hpp"
+#include "Load.hpp"
 
 #include <vector>
 #include <string>
@@ -7,6 +8,7 @@
 
 static GLuint gl_compile_shader(GLenum type, std::string const &source) {
 	GLuint shader = glCreateShader(type);
+	load_count_gl_objects(1);
 	GLchar const *str = source.c_str();
 	GLint str_length = GLint(source.size());
 	glShaderSource(shader, 1, &str, &str_length);
@@ -36,6 +38,7 @@ GLuint gl_compile_program(
 	GLuint fragment_shader = gl_compile_shader(GL_FRAGMENT_SHADER, fragment_shader_source);
 
 	GLuint program = glCreateProgram();
+	load_count_gl_objects(1);
 	glAttachShader(program, vertex_shader);
 	glAttachShader(program, fragment_shader);
 
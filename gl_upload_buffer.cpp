@@ -0,0 +1,123 @@
+#include "gl_upload_buffer.hpp"
+
+#include "Load.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+//Staging buffers, one slice each (only touched on the OpenGL context's thread):
+// (separate buffer objects rather than one big one, so several uploads can each have a slice mapped at once)
+static struct StagingRing {
+	enum : GLsizeiptr { SliceSize = 256 * 1024 };
+	enum : uint32_t { Slices = 4 }; //(more are made only if every slice is mapped at once)
+
+	struct Slice {
+		GLuint buffer = 0;
+		GLsync fence = 0; //set once the GPU copy out of this slice has been issued
+		bool mapped = false; //being filled by an upload
+	};
+	std::vector< Slice > slices;
+	uint32_t next = 0; //(slices are handed out round-robin, so the one tried first is usually the oldest)
+
+	//a slice the GPU is done reading (waits only if every slice is still being read):
+	uint32_t acquire() {
+		uint32_t oldest = -1U;
+		for (uint32_t s = 0; s < slices.size(); ++s) {
+			uint32_t i = (next + s) % uint32_t(slices.size());
+			Slice &slice = slices[i];
+			if (slice.mapped) continue;
+			if (slice.fence) {
+				GLenum status = glClientWaitSync(slice.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+				if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+					if (oldest == -1U) oldest = i;
+					continue;
+				}
+				glDeleteSync(slice.fence);
+				slice.fence = 0;
+			}
+			return use(i);
+		}
+
+		if (slices.size() < Slices || oldest == -1U) {
+			Slice &slice = slices.emplace_back();
+			glGenBuffers(1, &slice.buffer);
+			load_count_gl_objects(1);
+			glBindBuffer(GL_COPY_READ_BUFFER, slice.buffer);
+			glBufferData(GL_COPY_READ_BUFFER, SliceSize, nullptr, GL_STREAM_DRAW);
+			glBindBuffer(GL_COPY_READ_BUFFER, 0);
+			return use(uint32_t(slices.size()) - 1);
+		}
+
+		Slice &slice = slices[oldest];
+		while (glClientWaitSync(slice.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) { }
+		glDeleteSync(slice.fence);
+		slice.fence = 0;
+		return use(oldest);
+	}
+
+	uint32_t use(uint32_t i) {
+		next = (i + 1) % uint32_t(slices.size());
+		return i;
+	}
+} staging_ring;
+
+void gl_upload_buffer(GLuint buffer, std::span< char const > data, GLenum usage) {
+	bool sliced = (GLsizeiptr(data.size()) > StagingRing::SliceSize);
+
+	//notes: bind first, then unbind
+	// (GL_COPY_READ/WRITE_BUFFER bindings, so other bindings -- e.g., GL_ARRAY_BUFFER -- are left alone)
+	load_on_gl_thread([&](){
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, data.size(), sliced ? nullptr : data.data(), usage);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	});
+	if (!sliced) return;
+
+	for (size_t begin = 0; begin < data.size(); begin += StagingRing::SliceSize) {
+		GLsizeiptr size = GLsizeiptr(std::min< size_t >(StagingRing::SliceSize, data.size() - begin));
+
+		uint32_t index = 0;
+		void *ptr = nullptr;
+		load_on_gl_thread([&](){
+			index = staging_ring.acquire();
+			//unsynchronized is safe: the slice's fence says the GPU is done with it:
+			glBindBuffer(GL_COPY_READ_BUFFER, staging_ring.slices[index].buffer);
+			ptr = glMapBufferRange(GL_COPY_READ_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+			glBindBuffer(GL_COPY_READ_BUFFER, 0);
+			if (!ptr) throw std::runtime_error("Failed to map staging buffer for upload.");
+			staging_ring.slices[index].mapped = true;
+		});
+
+		//(on the calling thread -- a worker, when loading in the background)
+		std::memcpy(ptr, data.data() + begin, size);
+
+		load_on_gl_thread([&](){
+			StagingRing::Slice &slice = staging_ring.slices[index];
+			assert(slice.mapped && slice.fence == 0);
+			glBindBuffer(GL_COPY_READ_BUFFER, slice.buffer);
+			GLboolean unmapped = glUnmapBuffer(GL_COPY_READ_BUFFER);
+			slice.mapped = false;
+			if (unmapped) {
+				glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+				glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, GLintptr(begin), size);
+				glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+				slice.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			}
+			glBindBuffer(GL_COPY_READ_BUFFER, 0);
+			if (!unmapped) throw std::runtime_error("Staging buffer contents were lost during upload (glUnmapBuffer failed).");
+		});
+	}
+}
+
+void gl_upload_buffer_release() {
+	for (auto &slice : staging_ring.slices) {
+		assert(!slice.mapped && "no uploads should be in progress");
+		if (slice.fence) glDeleteSync(slice.fence);
+		glDeleteBuffers(1, &slice.buffer);
+	}
+	staging_ring.slices.clear();
+	staging_ring.next = 0;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "GL.hpp"
+
+#include <span>
+
+//(re)fills an OpenGL buffer object with 'data' (like glBufferData(..., usage) would):
+// data larger than a slice (256k) is streamed through a small ring of staging buffers -- each slice is
+// copied into a mapped staging buffer, then copied to 'buffer' by the GPU (glCopyBufferSubData); fences
+// keep a staging buffer from being reused until the GPU has read it.
+// may be called from a loader worker thread: OpenGL calls go through load_on_gl_thread, one short call
+// per step (so the main thread's update_load_functions budget can spread a large upload over many frames),
+// and the copies into mapped memory happen on the calling thread.
+// throws if a staging buffer can't be mapped.
+void gl_upload_buffer(GLuint buffer, std::span< char const > data, GLenum usage = GL_STATIC_DRAW);
+
+//delete the staging buffers (and their fences); call before destroying the OpenGL context
+// (on the context's thread, with no uploads in progress; later uploads make new staging buffers):
+void gl_upload_buffer_release();
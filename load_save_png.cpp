@@ -1,7 +1,9 @@
 #include "load_save_png.hpp"
+#include "MappedFile.hpp"
 
 #include <png.h>
 
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <cassert>
@@ -17,11 +19,10 @@ void save_png(std::ostream &to, unsigned int width, unsigned int height, glm::u8
 void load_png(std::string filename, glm::uvec2 *size, std::vector< glm::u8vec4 > *data, OriginLocation origin) {
 	assert(size);
 
-	std::ifstream file(filename.c_str(), std::ios::binary);
-	if (!file) {
-		throw std::runtime_error("Failed to open PNG image file '" + filename + "'.");
-	}
-	if (!load_png(file, &size->x, &size->y, data, origin)) {
+	//(mapped -- or found in a mounted pack -- so it loads the same way as other data files)
+	MappedFile file(filename);
+	MemoryStream from(file.data, file.data + file.size);
+	if (!load_png(from, &size->x, &size->y, data, origin)) {
 		throw std::runtime_error("Failed to read PNG image from '" + filename + "'.");
 	}
 }
@@ -4,11 +4,17 @@
 //The 'PlayMode' mode plays the game:
 #include "PlayMode.hpp"
 
+//The 'LoadingMode' mode shows progress while assets load:
+#include "LoadingMode.hpp"
+
 //For asset loading:
 #include "Load.hpp"
+#include "Pack.hpp"
+#include "data_path.hpp"
 
 //GL.hpp will include a non-namespace-polluting set of opengl prototypes:
 #include "GL.hpp"
+#include "gl_upload_buffer.hpp"
 
 //for screenshots:
 #include "load_save_png.hpp"
@@ -19,9 +25,11 @@
 
 //...and for c++ standard library functions:
 #include <chrono>
+#include <fstream>
 #include <iostream>
 #include <stdexcept>
 #include <memory>
+#include <string>
 #include <algorithm>
 
 #ifdef _WIN32
@@ -110,10 +118,24 @@ int main(int argc, char **argv) {
 	//SDL_ShowCursor(SDL_DISABLE);
 
 	//------------ load assets --------------
-	call_load_functions();
+	//files in the asset pack (if there is one -- see cook-assets.cpp) are loaded from it instead of from loose files:
+	if (std::ifstream(data_path("assets.pack"))) {
+		Pack::mount(data_path("assets.pack"));
+	}
 
-	//------------ create game mode + make current --------------
-	Mode::set_current(std::make_shared< PlayMode >());
+	//start loading in the background, but finish what the loading screen uses (DrawLines) first:
+	start_load_functions();
+	finish_load_functions(LoadTagEarly);
+
+	//------------ create loading mode (which makes the game mode once loading is done) + make current --------------
+	auto loading_mode = std::make_shared< LoadingMode >([](){
+		return std::make_shared< PlayMode >();
+	});
+	//"--load-report-json <file>" saves the startup load report (timing, bytes read, GL objects per load function):
+	for (int i = 1; i + 1 < argc; ++i) {
+		if (std::string(argv[i]) == "--load-report-json") loading_mode->report_json = argv[i+1];
+	}
+	Mode::set_current(loading_mode);
 
 	//------------ main loop ------------
 
@@ -194,6 +216,8 @@ int main(int argc, char **argv) {
 
 
 	//------------  teardown ------------
+	abort_load_functions(); //(if the window was closed while loading; before anything loads rely on goes away)
+	gl_upload_buffer_release(); //(staging buffers used by MeshBuffer uploads)
 
 	SDL_GL_DestroyContext(context);
 	context = 0;
@@ -0,0 +1,325 @@
+#include "optimize_mesh.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <string_view>
+#include <unordered_map>
+
+//FIFO cache simulation: a vertex is in the cache if fewer than 'cache_size' misses happened since its own miss.
+// returns the number of misses (0-3) for one triangle.
+namespace {
+	struct FIFOCache {
+		FIFOCache(uint32_t vertex_count, uint32_t cache_size_) : missed_at(vertex_count, 0), cache_size(cache_size_), time(cache_size_ + 1) { }
+		std::vector< uint32_t > missed_at;
+		uint32_t cache_size;
+		uint32_t time; //(starts past cache_size so that nothing starts in the cache)
+
+		uint32_t triangle(uint32_t const *tri) {
+			uint32_t misses = 0;
+			for (uint32_t c = 0; c < 3; ++c) {
+				uint32_t v = tri[c];
+				if (time - missed_at[v] > cache_size) {
+					missed_at[v] = time;
+					time += 1;
+					misses += 1;
+				}
+			}
+			return misses;
+		}
+		//empty the cache:
+		void flush() {
+			time += cache_size + 1;
+		}
+	};
+}
+
+VertexCacheStats analyze_vertex_cache(std::span< uint32_t const > indices, uint32_t vertex_count, uint32_t cache_size) {
+	assert(indices.size() % 3 == 0);
+	VertexCacheStats stats;
+	stats.triangles = uint32_t(indices.size() / 3);
+
+	FIFOCache cache(vertex_count, cache_size);
+	std::vector< bool > used(vertex_count, false);
+	for (size_t i = 0; i < indices.size(); i += 3) {
+		stats.transforms += cache.triangle(&indices[i]);
+		for (uint32_t c = 0; c < 3; ++c) {
+			if (!used[indices[i+c]]) {
+				used[indices[i+c]] = true;
+				stats.vertices += 1;
+			}
+		}
+	}
+	return stats;
+}
+
+void optimize_vertex_cache(std::span< uint32_t > indices, uint32_t vertex_count) {
+	assert(indices.size() % 3 == 0);
+	uint32_t triangle_count = uint32_t(indices.size() / 3);
+	if (triangle_count == 0) return;
+
+	//scoring parameters from Forsyth's article:
+	constexpr uint32_t CacheSize = 32; //(modeled as LRU; scores only need to be roughly right)
+	constexpr float CacheDecayPower = 1.5f;
+	constexpr float LastTriScore = 0.75f;
+	constexpr float ValenceBoostScale = 2.0f;
+	constexpr float ValenceBoostPower = 0.5f;
+	constexpr uint32_t MaxValence = 64; //(scores for larger valences use this one)
+
+	static std::array< float, CacheSize > const cache_scores = [](){
+		std::array< float, CacheSize > ret;
+		for (uint32_t p = 0; p < CacheSize; ++p) {
+			if (p < 3) ret[p] = LastTriScore; //(the last triangle's vertices score the same, so its orientation doesn't matter)
+			else ret[p] = std::pow(1.0f - float(p - 3) / float(CacheSize - 3), CacheDecayPower);
+		}
+		return ret;
+	}();
+	static std::array< float, MaxValence + 1 > const valence_scores = [](){
+		std::array< float, MaxValence + 1 > ret;
+		ret[0] = 0.0f;
+		for (uint32_t v = 1; v <= MaxValence; ++v) {
+			ret[v] = ValenceBoostScale * std::pow(float(v), -ValenceBoostPower);
+		}
+		return ret;
+	}();
+
+	//triangles using each vertex (adjacency[offsets[v]] .. adjacency[offsets[v] + live[v]]):
+	std::vector< uint32_t > live(vertex_count, 0);
+	for (uint32_t v : indices) {
+		assert(v < vertex_count);
+		live[v] += 1;
+	}
+	std::vector< uint32_t > offsets(vertex_count + 1, 0);
+	for (uint32_t v = 0; v < vertex_count; ++v) {
+		offsets[v+1] = offsets[v] + live[v];
+	}
+	std::vector< uint32_t > adjacency(indices.size());
+	{
+		std::vector< uint32_t > fill(offsets.begin(), offsets.end() - 1);
+		for (uint32_t i = 0; i < indices.size(); ++i) {
+			adjacency[fill[indices[i]]++] = i / 3;
+		}
+	}
+
+	std::vector< int32_t > cache_position(vertex_count, -1);
+	auto vertex_score = [&](uint32_t v) {
+		if (live[v] == 0) return -1.0f; //(no triangles left to draw)
+		float score = valence_scores[std::min(live[v], MaxValence)];
+		if (cache_position[v] >= 0) score += cache_scores[cache_position[v]];
+		return score;
+	};
+
+	std::vector< float > vertex_scores(vertex_count);
+	for (uint32_t v = 0; v < vertex_count; ++v) {
+		vertex_scores[v] = vertex_score(v);
+	}
+	std::vector< float > triangle_scores(triangle_count);
+	for (uint32_t t = 0; t < triangle_count; ++t) {
+		triangle_scores[t] = vertex_scores[indices[3*t+0]] + vertex_scores[indices[3*t+1]] + vertex_scores[indices[3*t+2]];
+	}
+
+	std::vector< bool > emitted(triangle_count, false);
+	std::vector< uint32_t > output;
+	output.reserve(indices.size());
+
+	std::array< uint32_t, CacheSize + 3 > cache;
+	uint32_t cache_count = 0;
+	std::array< uint32_t, CacheSize + 3 > next_cache;
+
+	uint32_t best = uint32_t(std::max_element(triangle_scores.begin(), triangle_scores.end()) - triangle_scores.begin());
+	uint32_t cursor = 0; //(for restarting, when no triangle touches the cache: the next un-emitted triangle in input order)
+
+	for (uint32_t emitted_count = 0; emitted_count < triangle_count; ++emitted_count) {
+		if (best == -1U) {
+			while (emitted[cursor]) ++cursor;
+			best = cursor;
+		}
+		uint32_t const *tri = &indices[3 * best];
+		output.insert(output.end(), tri, tri + 3);
+		emitted[best] = true;
+
+		//remove the triangle from its vertices' adjacency:
+		for (uint32_t c = 0; c < 3; ++c) {
+			uint32_t v = tri[c];
+			uint32_t *begin = &adjacency[offsets[v]];
+			uint32_t *end = begin + live[v];
+			uint32_t *found = std::find(begin, end, best);
+			assert(found != end);
+			std::swap(*found, *(end - 1));
+			live[v] -= 1;
+		}
+
+		//move the triangle's vertices to the front of the cache:
+		uint32_t next_count = 0;
+		for (uint32_t c = 0; c < 3; ++c) {
+			if (std::find(next_cache.begin(), next_cache.begin() + next_count, tri[c]) == next_cache.begin() + next_count) {
+				next_cache[next_count++] = tri[c];
+			}
+		}
+		for (uint32_t i = 0; i < cache_count; ++i) {
+			uint32_t v = cache[i];
+			if (v != tri[0] && v != tri[1] && v != tri[2]) next_cache[next_count++] = v;
+		}
+		std::swap(cache, next_cache);
+		cache_count = next_count;
+
+		//update scores of vertices in (or just pushed out of) the cache, and their triangles:
+		for (uint32_t i = 0; i < cache_count; ++i) {
+			cache_position[cache[i]] = (i < CacheSize ? int32_t(i) : -1);
+		}
+		best = -1U;
+		float best_score = -1.0f;
+		for (uint32_t i = 0; i < cache_count; ++i) {
+			uint32_t v = cache[i];
+			float score = vertex_score(v);
+			float delta = score - vertex_scores[v];
+			vertex_scores[v] = score;
+			for (uint32_t a = offsets[v]; a < offsets[v] + live[v]; ++a) {
+				uint32_t t = adjacency[a];
+				triangle_scores[t] += delta;
+				if (triangle_scores[t] > best_score) {
+					best_score = triangle_scores[t];
+					best = t;
+				}
+			}
+		}
+		cache_count = std::min(cache_count, CacheSize);
+	}
+
+	std::copy(output.begin(), output.end(), indices.begin());
+}
+
+void optimize_overdraw(std::span< uint32_t > indices, std::span< glm::vec3 const > positions, float threshold) {
+	assert(indices.size() % 3 == 0);
+	uint32_t triangle_count = uint32_t(indices.size() / 3);
+	uint32_t vertex_count = uint32_t(positions.size());
+	if (triangle_count == 0) return;
+
+	constexpr uint32_t CacheSize = 16;
+
+	//hard boundaries -- triangles where the cache starts over (all three vertices miss):
+	std::vector< uint32_t > hard;
+	{
+		FIFOCache cache(vertex_count, CacheSize);
+		for (uint32_t t = 0; t < triangle_count; ++t) {
+			if (cache.triangle(&indices[3*t]) == 3) hard.emplace_back(t);
+		}
+		if (hard.empty() || hard[0] != 0) hard.insert(hard.begin(), 0);
+	}
+
+	//soft boundaries -- split hard clusters wherever the miss ratio so far is already close to the whole cluster's:
+	std::vector< uint32_t > clusters;
+	{
+		FIFOCache cache(vertex_count, CacheSize);
+		FIFOCache soft(vertex_count, CacheSize);
+		std::vector< uint32_t > misses(triangle_count);
+		for (uint32_t t = 0; t < triangle_count; ++t) {
+			misses[t] = cache.triangle(&indices[3*t]);
+		}
+		for (uint32_t h = 0; h < hard.size(); ++h) {
+			uint32_t begin = hard[h];
+			uint32_t end = (h + 1 < hard.size() ? hard[h+1] : triangle_count);
+			uint32_t total = 0;
+			for (uint32_t t = begin; t < end; ++t) total += misses[t];
+			float cluster_threshold = threshold * float(total) / float(end - begin);
+
+			//(restarting a cluster empties the cache, so re-simulate from each soft boundary)
+			soft.flush();
+			clusters.emplace_back(begin);
+			uint32_t running_misses = 0, running_triangles = 0;
+			for (uint32_t t = begin; t < end; ++t) {
+				running_misses += soft.triangle(&indices[3*t]);
+				running_triangles += 1;
+				if (t + 1 < end && float(running_misses) / float(running_triangles) <= cluster_threshold) {
+					clusters.emplace_back(t + 1);
+					soft.flush();
+					running_misses = running_triangles = 0;
+				}
+			}
+		}
+	}
+
+	//sort clusters so that those facing away from the mesh's center draw first:
+	// (area-weighted centroid and normal of each cluster, compared to the mesh's centroid)
+	struct Cluster {
+		uint32_t begin, end;
+		float sort;
+	};
+	std::vector< Cluster > sorted;
+	sorted.reserve(clusters.size());
+	std::vector< glm::vec3 > centroids, normals;
+	centroids.reserve(clusters.size());
+	normals.reserve(clusters.size());
+	glm::vec3 mesh_centroid = glm::vec3(0.0f);
+	float mesh_area = 0.0f;
+	for (uint32_t c = 0; c < clusters.size(); ++c) {
+		Cluster &cluster = sorted.emplace_back();
+		cluster.begin = clusters[c];
+		cluster.end = (c + 1 < clusters.size() ? clusters[c+1] : triangle_count);
+		glm::vec3 centroid = glm::vec3(0.0f);
+		glm::vec3 normal = glm::vec3(0.0f);
+		float area = 0.0f;
+		for (uint32_t t = cluster.begin; t < cluster.end; ++t) {
+			glm::vec3 const &a = positions[indices[3*t+0]];
+			glm::vec3 const &b = positions[indices[3*t+1]];
+			glm::vec3 const &c = positions[indices[3*t+2]];
+			glm::vec3 n = glm::cross(b - a, c - a); //(length is twice the area)
+			float twice_area = glm::length(n);
+			centroid += (a + b + c) * (twice_area / 3.0f);
+			normal += n;
+			area += twice_area;
+		}
+		mesh_centroid += centroid;
+		mesh_area += area;
+		centroids.emplace_back(area > 0.0f ? centroid / area : glm::vec3(0.0f));
+		normals.emplace_back(glm::length(normal) > 0.0f ? glm::normalize(normal) : glm::vec3(0.0f));
+	}
+	if (mesh_area > 0.0f) mesh_centroid /= mesh_area;
+	for (uint32_t c = 0; c < sorted.size(); ++c) {
+		sorted[c].sort = glm::dot(centroids[c] - mesh_centroid, normals[c]);
+	}
+	std::stable_sort(sorted.begin(), sorted.end(), [](Cluster const &a, Cluster const &b) {
+		return a.sort > b.sort;
+	});
+
+	std::vector< uint32_t > output;
+	output.reserve(indices.size());
+	for (auto const &cluster : sorted) {
+		output.insert(output.end(), indices.begin() + 3 * cluster.begin, indices.begin() + 3 * cluster.end);
+	}
+	std::copy(output.begin(), output.end(), indices.begin());
+}
+
+std::vector< uint32_t > optimize_vertex_fetch(std::span< uint32_t > indices, uint32_t vertex_count) {
+	std::vector< uint32_t > order;
+	order.reserve(vertex_count);
+	std::vector< uint32_t > remap(vertex_count, -1U);
+	for (uint32_t &v : indices) {
+		assert(v < vertex_count);
+		if (remap[v] == -1U) {
+			remap[v] = uint32_t(order.size());
+			order.emplace_back(v);
+		}
+		v = remap[v];
+	}
+	return order;
+}
+
+std::vector< uint32_t > weld_vertices(char const *vertices, size_t stride, uint32_t count, std::vector< uint32_t > *indices_) {
+	assert(indices_);
+	auto &indices = *indices_;
+	indices.clear();
+	indices.reserve(count);
+
+	std::vector< uint32_t > order;
+	std::unordered_map< std::string_view, uint32_t > welded;
+	welded.reserve(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		auto f = welded.emplace(std::string_view(vertices + i * stride, stride), uint32_t(order.size()));
+		if (f.second) order.emplace_back(i);
+		indices.emplace_back(f.first->second);
+	}
+	return order;
+}
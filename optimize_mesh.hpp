@@ -0,0 +1,56 @@
+#pragma once
+
+/*
+ * Helpers that reorder indexed triangle lists (and their vertices) so the GPU does less work:
+ *
+ *  optimize_vertex_cache() reorders triangles so that vertices are re-used while they are still
+ *   in the post-transform vertex cache (Tom Forsyth's "Linear-Speed Vertex Cache Optimisation").
+ *  optimize_overdraw() splits that order into clusters -- where doing so costs little cache
+ *   efficiency -- and draws outward-facing clusters first, so more fragments fail the depth test
+ *   (after Sander, Nehab, and Barczak's "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw").
+ *  optimize_vertex_fetch() renumbers vertices in order of first use, so vertex fetches walk memory in order.
+ *
+ * weld_vertices() turns un-indexed triangles into indexed ones (so they can be optimized).
+ * analyze_vertex_cache() measures the result.
+ *
+ * These only touch CPU-side data (no OpenGL), so they can run at load time or in offline tools.
+ * MeshBuffer::optimize() applies them to every mesh in a MeshBuffer::Staging.
+ *
+ */
+
+#include <glm/glm.hpp>
+
+#include <span>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+//post-transform cache statistics for an indexed triangle list:
+struct VertexCacheStats {
+	uint32_t triangles = 0;
+	uint32_t vertices = 0; //distinct vertices used
+	uint32_t transforms = 0; //vertex shader invocations (cache misses)
+
+	//average cache miss ratio: transforms per triangle (0.5 is ideal for large regular grids; 3 is no re-use at all):
+	float acmr() const { return triangles ? float(transforms) / float(triangles) : 0.0f; }
+	//average transform to vertex ratio: transforms per vertex used (1 is ideal):
+	float atvr() const { return vertices ? float(transforms) / float(vertices) : 0.0f; }
+};
+
+//simulate a FIFO post-transform cache of 'cache_size' entries (indices are in [0, vertex_count)):
+VertexCacheStats analyze_vertex_cache(std::span< uint32_t const > indices, uint32_t vertex_count, uint32_t cache_size = 16);
+
+//reorder triangles (in place) for post-transform cache re-use:
+void optimize_vertex_cache(std::span< uint32_t > indices, uint32_t vertex_count);
+
+//reorder clusters of triangles (in place) to reduce overdraw; call after optimize_vertex_cache:
+// 'threshold' is how much worse than the input the ACMR is allowed to get (1.05 == 5% worse) in exchange for smaller clusters
+void optimize_overdraw(std::span< uint32_t > indices, std::span< glm::vec3 const > positions, float threshold = 1.05f);
+
+//renumber vertices (in place) in order of first use:
+// returns the new vertex order: new vertex i is old vertex order[i] (unused vertices are left out)
+std::vector< uint32_t > optimize_vertex_fetch(std::span< uint32_t > indices, uint32_t vertex_count);
+
+//index 'count' vertices of 'stride' bytes each, so that identical vertices are stored once:
+// returns the vertices to keep (as in optimize_vertex_fetch); *indices gets one index (into that list) per input vertex
+std::vector< uint32_t > weld_vertices(char const *vertices, size_t stride, uint32_t count, std::vector< uint32_t > *indices);
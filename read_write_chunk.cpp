@@ -0,0 +1,269 @@
+#include "read_write_chunk.hpp"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <array>
+#include <string>
+
+uint32_t chunk_crc32(void const *data_, size_t size, uint32_t crc) {
+	static std::array< uint32_t, 256 > const table = []() {
+		std::array< uint32_t, 256 > ret;
+		for (uint32_t i = 0; i < 256; ++i) {
+			uint32_t c = i;
+			for (uint32_t k = 0; k < 8; ++k) {
+				c = (c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1);
+			}
+			ret[i] = c;
+		}
+		return ret;
+	}();
+
+	uint8_t const *data = reinterpret_cast< uint8_t const * >(data_);
+	crc = ~crc;
+	for (size_t i = 0; i < size; ++i) {
+		crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+namespace {
+	struct ChunkHeader {
+		char magic[4] = {'\0', '\0', '\0', '\0'};
+		uint32_t size = 0;
+	};
+	static_assert(sizeof(ChunkHeader) == 8, "header is packed");
+
+	//compressed data is fed to zlib (and a stream's data read) this many bytes at a time:
+	constexpr size_t DecompressBlock = 64 * 1024;
+
+	//zlib inflate into a fixed destination; 'next_in' is called for more input when zlib runs out:
+	template< typename F >
+	void inflate_into(char *to, size_t size, F const &next_in) {
+		z_stream z;
+		std::memset(&z, 0, sizeof(z));
+		if (inflateInit(&z) != Z_OK) {
+			throw std::runtime_error("Failed to start decompressing chunk");
+		}
+		z.next_out = reinterpret_cast< Bytef * >(to);
+		z.avail_out = uInt(size);
+		int result = Z_OK;
+		while (result == Z_OK) {
+			if (z.avail_in == 0 && !next_in(&z)) break;
+			result = inflate(&z, Z_NO_FLUSH);
+		}
+		size_t written = size - z.avail_out;
+		inflateEnd(&z);
+		if (result != Z_STREAM_END || written != size) {
+			throw std::runtime_error("Failed to decompress chunk (data is damaged or has the wrong size)");
+		}
+	}
+}
+
+std::vector< char > compress_chunk(void const *data, size_t size) {
+	if (size > 0x7fffffffu) {
+		throw std::runtime_error("Chunk is too large to compress");
+	}
+	uint32_t size32 = uint32_t(size);
+	uLongf stored = compressBound(uLong(size));
+	std::vector< char > ret(sizeof(size32) + stored);
+	std::memcpy(ret.data(), &size32, sizeof(size32));
+	if (compress2(reinterpret_cast< Bytef * >(ret.data() + sizeof(size32)), &stored, reinterpret_cast< Bytef const * >(data), uLong(size), Z_BEST_COMPRESSION) != Z_OK) {
+		throw std::runtime_error("Failed to compress chunk");
+	}
+	ret.resize(sizeof(size32) + stored);
+	return ret;
+}
+
+void decompress_chunk(char const *stream, size_t stream_size, char *to, size_t size) {
+	inflate_into(to, size, [&](z_stream *z) {
+		if (stream_size == 0) return false;
+		size_t block = std::min(stream_size, DecompressBlock);
+		//(zlib only reads next_in, though it isn't declared const without ZLIB_CONST)
+		z->next_in = reinterpret_cast< Bytef * >(const_cast< char * >(stream));
+		z->avail_in = uInt(block);
+		stream += block;
+		stream_size -= block;
+		return true;
+	});
+}
+
+void decompress_chunk(std::istream &from, size_t stream_size, char *to, size_t size) {
+	std::unique_ptr< char[] > buffer(new char[DecompressBlock]);
+	inflate_into(to, size, [&](z_stream *z) {
+		if (stream_size == 0) return false;
+		size_t block = std::min(stream_size, DecompressBlock);
+		if (!from.read(buffer.get(), block)) {
+			throw std::runtime_error("Failed to read chunk data.");
+		}
+		z->next_in = reinterpret_cast< Bytef * >(buffer.get());
+		z->avail_in = uInt(block);
+		stream_size -= block;
+		return true;
+	});
+}
+
+ChunkReader::ChunkReader(char const *begin_, char const *end_) : begin(begin_), end(end_) {
+	size_t file_size = size_t(end - begin);
+
+	ChunkHeader header;
+	if (file_size >= sizeof(header)) std::memcpy(&header, begin, sizeof(header));
+
+	char const *covered = begin; //end of the furthest chunk (for detecting trailing data)
+
+	std::string magic = (file_size >= sizeof(header) ? std::string(header.magic, 4) : "");
+	if (magic == "dir1" || magic == "dir2") {
+		//---- directory: read entries ----
+		has_directory = true;
+		if (header.size > file_size - sizeof(header)) {
+			throw std::runtime_error("Malformed chunk directory");
+		}
+		char const *first = begin + sizeof(header); //first directory entry
+		uint32_t entries_size = header.size;
+		if (magic == "dir2") {
+			ChunkDirectoryHeader dh;
+			if (entries_size < sizeof(dh)) {
+				throw std::runtime_error("Malformed chunk directory");
+			}
+			std::memcpy(&dh, first, sizeof(dh));
+			if (dh.alignment == 0 || (dh.alignment & (dh.alignment - 1)) != 0) {
+				throw std::runtime_error("Chunk directory has invalid alignment (" + std::to_string(dh.alignment) + ")");
+			}
+			alignment = dh.alignment;
+			first += sizeof(dh);
+			entries_size -= uint32_t(sizeof(dh));
+		}
+		if (entries_size % sizeof(ChunkDirectoryEntry) != 0) {
+			throw std::runtime_error("Malformed chunk directory");
+		}
+		uint32_t count = entries_size / uint32_t(sizeof(ChunkDirectoryEntry));
+		entries.reserve(count);
+		for (uint32_t i = 0; i < count; ++i) {
+			ChunkDirectoryEntry d;
+			std::memcpy(&d, first + i * sizeof(ChunkDirectoryEntry), sizeof(d));
+			bool compressed = (d.size & ChunkCompressed);
+			d.size &= ~ChunkCompressed;
+			if (d.offset < sizeof(header) || d.offset > file_size || d.size > file_size - d.offset) {
+				throw std::runtime_error("Chunk directory entry '" + std::string(d.magic, 4) + "' is out of range");
+			}
+			if (d.offset % alignment != 0) {
+				throw std::runtime_error("Chunk directory entry '" + std::string(d.magic, 4) + "' is not aligned");
+			}
+			Entry &entry = entries.emplace_back();
+			entry.magic = std::string(d.magic, 4);
+			entry.data = begin + d.offset;
+			entry.size = d.size;
+			entry.crc32 = d.crc32;
+			entry.has_crc32 = true;
+			entry.compressed = compressed;
+		}
+		covered = begin + sizeof(header) + header.size;
+		for (auto const &entry : entries) {
+			covered = std::max(covered, entry.data + entry.size);
+		}
+	} else {
+		//---- no directory: scan chunk headers ----
+		char const *at = begin;
+		while (size_t(end - at) >= sizeof(header)) {
+			std::memcpy(&header, at, sizeof(header));
+			bool compressed = (header.size & ChunkCompressed);
+			header.size &= ~ChunkCompressed;
+			if (header.size > size_t(end - at) - sizeof(header)) break; //(incomplete chunk)
+			Entry &entry = entries.emplace_back();
+			entry.magic = std::string(header.magic, 4);
+			entry.data = at + sizeof(header);
+			entry.size = header.size;
+			entry.compressed = compressed;
+			at = entry.data + entry.size;
+		}
+		covered = at;
+	}
+
+	//compressed chunks start with their decompressed size:
+	for (auto &entry : entries) {
+		if (!entry.compressed) continue;
+		if (entry.size < sizeof(entry.decompressed_size)) {
+			throw std::runtime_error("Compressed chunk '" + entry.magic + "' is too small");
+		}
+		std::memcpy(&entry.decompressed_size, entry.data, sizeof(entry.decompressed_size));
+	}
+
+	trailing = (covered < end);
+}
+
+void ChunkReader::read_into(Entry const &entry, std::span< char > to) const {
+	if (to.size() != entry.data_size()) {
+		throw std::runtime_error("Chunk '" + entry.magic + "' is " + std::to_string(entry.data_size()) + " bytes, not " + std::to_string(to.size()) + ".");
+	}
+	if (verify && entry.has_crc32 && chunk_crc32(entry.data, entry.size) != entry.crc32) {
+		throw std::runtime_error("Checksum mismatch in chunk '" + entry.magic + "'");
+	}
+	if (entry.compressed) {
+		uint32_t header = uint32_t(sizeof(entry.decompressed_size));
+		decompress_chunk(entry.data + header, entry.size - header, to.data(), to.size());
+	} else if (!to.empty()) {
+		std::memcpy(to.data(), entry.data, to.size());
+	}
+}
+
+ChunkReader::Entry const *ChunkReader::find(std::string const &magic) const {
+	for (auto const &entry : entries) {
+		if (entry.magic == magic) return &entry;
+	}
+	return nullptr;
+}
+
+void ChunkWriter::write(std::ostream *to_) const {
+	assert(to_);
+	auto &to = *to_;
+
+	if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+		throw std::runtime_error("Chunk alignment (" + std::to_string(alignment) + ") is not a power of two");
+	}
+	bool aligned = (alignment > 1);
+
+	//directory chunk contents ("dir2" starts with a header giving the alignment):
+	std::vector< char > directory;
+	if (aligned) {
+		ChunkDirectoryHeader dh;
+		dh.alignment = alignment;
+		directory.insert(directory.end(), reinterpret_cast< char const * >(&dh), reinterpret_cast< char const * >(&dh + 1));
+	}
+
+	//chunks follow the directory (each with its own header, padded so data lands on an alignment boundary):
+	std::vector< size_t > padding(chunks.size(), 0);
+	size_t offset = sizeof(ChunkHeader) + directory.size() + chunks.size() * sizeof(ChunkDirectoryEntry);
+	for (size_t i = 0; i < chunks.size(); ++i) {
+		Chunk const &chunk = chunks[i];
+		assert(chunk.magic.size() == 4);
+		size_t data_offset = (offset + sizeof(ChunkHeader) + alignment - 1) / alignment * alignment;
+		padding[i] = data_offset - sizeof(ChunkHeader) - offset;
+		offset = data_offset;
+		if (offset + chunk.data.size() > 0xffffffffu) {
+			throw std::runtime_error("Chunk file would be larger than 4GB");
+		}
+		if (chunk.data.size() >= ChunkCompressed) {
+			throw std::runtime_error("Chunk '" + chunk.magic + "' is larger than 2GB");
+		}
+		ChunkDirectoryEntry entry;
+		std::memcpy(entry.magic, chunk.magic.data(), 4);
+		entry.offset = uint32_t(offset);
+		entry.size = uint32_t(chunk.data.size()) | (chunk.compressed ? ChunkCompressed : 0);
+		entry.crc32 = chunk_crc32(chunk.data.data(), chunk.data.size());
+		directory.insert(directory.end(), reinterpret_cast< char const * >(&entry), reinterpret_cast< char const * >(&entry + 1));
+		offset += chunk.data.size();
+	}
+
+	write_chunk(aligned ? "dir2" : "dir1", directory, &to);
+	for (size_t i = 0; i < chunks.size(); ++i) {
+		static char const zeros[256] = { };
+		for (size_t p = padding[i]; p > 0; p -= std::min(p, sizeof(zeros))) {
+			to.write(zeros, std::min(p, sizeof(zeros)));
+		}
+		ChunkHeader header;
+		std::memcpy(header.magic, chunks[i].magic.data(), 4);
+		header.size = uint32_t(chunks[i].data.size()) | (chunks[i].compressed ? ChunkCompressed : 0);
+		to.write(reinterpret_cast< char const * >(&header), sizeof(header));
+		to.write(chunks[i].data.data(), chunks[i].data.size());
+	}
+}
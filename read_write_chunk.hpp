@@ -1,15 +1,41 @@
 #pragma once
 
+#include "MappedFile.hpp"
+
 #include <iostream>
 #include <vector>
 #include <stdexcept>
 #include <cassert>
+#include <cstring>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <algorithm>
+
+//Chunks may be stored compressed (zlib deflate); a flag in the chunk's size (in its header and directory entry) says so:
+// |ma|gi|c.|..| <-- four byte "magic number"
+// |sz|sz|sz|sz| <-- ChunkCompressed | sz
+// |us|us|us|us| <-- size of the data once decompressed
+// |zz...zz| <-- (sz - 4) bytes of zlib stream
+// Readers decompress straight into the destination (read_chunk's vector, ChunkReader's aligned copy, or a caller's
+//  buffer via ChunkReader::read_into), a block at a time, so the whole compressed chunk is never copied.
+constexpr uint32_t ChunkCompressed = 0x80000000u;
+
+//make a compressed chunk's data (as above, after the size) from 'size' bytes:
+std::vector< char > compress_chunk(void const *data, size_t size);
+//decompress a compressed chunk's zlib stream (from memory, or read from a stream) into exactly 'size' bytes; throws on failure:
+void decompress_chunk(char const *stream, size_t stream_size, char *to, size_t size);
+void decompress_chunk(std::istream &from, size_t stream_size, char *to, size_t size);
 
 //helper function that reads an array of structures preceded by a simple header:
 //Expected format:
 // |ma|gi|c.|..| <-- four byte "magic number"
 // |sz|sz|sz|sz| <-- four byte (native endian) size
 // |TT...TT| * (sz/sizeof(TT)) <-- enough T structures to make up sz bytes
+// (or a compressed chunk, as above)
 
 template< typename T >
 void read_chunk(std::istream &from, std::string const &magic, std::vector< T > *to_) {
@@ -30,6 +56,20 @@ void read_chunk(std::istream &from, std::string const &magic, std::vector< T > *
 		throw std::runtime_error("Unexpected magic number in chunk");
 	}
 
+	if (header.size & ChunkCompressed) {
+		uint32_t stored = header.size & ~ChunkCompressed;
+		uint32_t size = 0;
+		if (stored < sizeof(size) || !from.read(reinterpret_cast< char * >(&size), sizeof(size))) {
+			throw std::runtime_error("Failed to read compressed chunk header");
+		}
+		if (size % sizeof(T) != 0) {
+			throw std::runtime_error("Size of chunk not divisible by element size");
+		}
+		to.resize(size / sizeof(T));
+		decompress_chunk(from, stored - sizeof(size), reinterpret_cast< char * >(to.data()), size);
+		return;
+	}
+
 	if (header.size % sizeof(T) != 0) {
 		throw std::runtime_error("Size of chunk not divisible by element size");
 	}
@@ -40,10 +80,158 @@ void read_chunk(std::istream &from, std::string const &magic, std::vector< T > *
 	}
 }
 
+//Chunk files may begin with a directory -- itself a chunk -- listing every chunk in the file:
+// |di|r1|sz|sz| <-- "dir1" header; sz == 16 * (number of entries)
+// |ma|gi|c.|..|of|fs|et|..|sz|sz|sz|sz|cr|cr|cr|cr| * entries <-- magic, offset of data (from start of file), size, crc32 of data
+// ...followed by the chunks themselves, each still with its own header.
+// (so readers can jump straight to -- or skip -- chunks and check their data;
+//  files without a directory are still read, by scanning their chunk headers)
+//
+//A "dir2" directory also promises that chunk data is aligned:
+// |di|r2|sz|sz| <-- "dir2" header; sz == 16 + 16 * (number of entries)
+// |al|al|al|al|00|00|00|00|00|00|00|00|00|00|00|00| <-- alignment (power of two) of every chunk's data offset, reserved
+// |ma|gi|c.|..|of|fs|et|..|sz|sz|sz|sz|cr|cr|cr|cr| * entries <-- as above
+// ...followed by the chunks, each preceded by zero padding (before its header) to put its data on an alignment boundary.
+// (in both, a compressed chunk's size -- and crc32 -- are of its data as stored)
+// (since mappings start on page boundaries, aligned file offsets mean aligned memory: chunk data can be
+//  used in place as SIMD-friendly arrays or uploaded directly, with no copy)
+struct ChunkDirectoryHeader {
+	uint32_t alignment = 1;
+	uint32_t reserved[3] = { 0, 0, 0 };
+};
+static_assert(sizeof(ChunkDirectoryHeader) == 16, "directory header is packed");
+
+struct ChunkDirectoryEntry {
+	char magic[4] = {'\0', '\0', '\0', '\0'};
+	uint32_t offset = 0;
+	uint32_t size = 0;
+	uint32_t crc32 = 0;
+};
+static_assert(sizeof(ChunkDirectoryEntry) == 16, "directory entry is packed");
+
+//CRC-32 (same as zlib's crc32, so tools can compute it easily); pass a previous result as 'crc' to continue it:
+uint32_t chunk_crc32(void const *data, size_t size, uint32_t crc = 0);
+
+//helper that reads chunks in place from memory -- typically a MappedFile:
+// read< T >() finds a chunk by its magic and returns a span pointing directly at its data, so nothing is copied.
+// (if the data isn't aligned for T -- or to the alignment asked for -- it is copied into storage owned by the reader;
+//  this never happens for files with a "dir2" directory whose alignment is at least as large)
+// spans stay valid as long as both the reader and the memory do.
+// chunks may be read in any order (and from several threads at once); unread chunks are skipped.
+struct ChunkReader {
+	//find chunks (from the directory, if there is one); throws on malformed directories:
+	ChunkReader(char const *begin, char const *end);
+	ChunkReader(MappedFile const &file) : ChunkReader(file.data, file.data + file.size) { }
+
+	struct Entry {
+		std::string magic;
+		char const *data = nullptr;
+		uint32_t size = 0;
+		uint32_t crc32 = 0;
+		bool has_crc32 = false; //(chunks in files without a directory have no checksum)
+		bool compressed = false; //(data/size are the stored -- compressed -- data, including the decompressed size)
+		uint32_t decompressed_size = 0;
+		//size of the chunk's contents:
+		uint32_t data_size() const { return compressed ? decompressed_size : size; }
+	};
+	std::vector< Entry > entries; //in file order
+	bool has_directory = false; //file started with a "dir1" or "dir2" chunk
+	uint32_t alignment = 1; //alignment of every chunk's data (from a "dir2" directory)
+	bool trailing = false; //file contains bytes that aren't part of any chunk
+
+	bool verify = true; //check crc32s in read() (for chunks that have them)
+
+	//first chunk with the given magic (or nullptr if there is none):
+	Entry const *find(std::string const &magic) const;
+
+	//find + check a chunk (throws if it is missing, has a bad size, or fails its checksum):
+	// 'align' is the alignment the returned data should have (at least alignof(T); a power of two)
+	// (compressed chunks are decompressed into storage owned by the reader)
+	template< typename T >
+	std::span< T const > read(std::string const &magic, size_t align = alignof(T)) const {
+		static_assert(std::is_trivially_copyable_v< T >, "chunks hold plain data");
+		align = std::max(align, alignof(T));
+		assert((align & (align - 1)) == 0 && "alignment is a power of two");
 
-//helper function to write a chunk of data in the same format as read_chunk:
+		Entry const *entry = find(magic);
+		if (!entry) {
+			throw std::runtime_error("Missing chunk '" + magic + "'");
+		}
+		if (entry->data_size() % sizeof(T) != 0) {
+			throw std::runtime_error("Size of chunk not divisible by element size");
+		}
+
+		char const *data = entry->data;
+		size_t count = entry->data_size() / sizeof(T);
+		if (entry->compressed) {
+			std::unique_ptr< char[] > copy(new char[entry->decompressed_size + align]);
+			uintptr_t aligned = (reinterpret_cast< uintptr_t >(copy.get()) + align - 1) / align * align;
+			read_into(*entry, std::span< char >(reinterpret_cast< char * >(aligned), entry->decompressed_size));
+			data = reinterpret_cast< char const * >(aligned);
+			std::lock_guard< std::mutex > lock(copies_mutex);
+			copies.emplace_back(std::move(copy));
+			return std::span< T const >(reinterpret_cast< T const * >(data), count);
+		}
+		if (verify && entry->has_crc32 && chunk_crc32(entry->data, entry->size) != entry->crc32) {
+			throw std::runtime_error("Checksum mismatch in chunk '" + magic + "'");
+		}
+		if (reinterpret_cast< uintptr_t >(data) % align != 0) {
+			//misaligned (e.g., after a string chunk whose size isn't a multiple of four), so copy:
+			std::unique_ptr< char[] > copy(new char[entry->size + align]);
+			uintptr_t aligned = (reinterpret_cast< uintptr_t >(copy.get()) + align - 1) / align * align;
+			std::memcpy(reinterpret_cast< char * >(aligned), data, entry->size);
+			data = reinterpret_cast< char const * >(aligned);
+			std::lock_guard< std::mutex > lock(copies_mutex);
+			copies.emplace_back(std::move(copy));
+		}
+		return std::span< T const >(reinterpret_cast< T const * >(data), count);
+	}
+
+	//check a chunk and copy -- or decompress -- its contents to 'to' (e.g., a mapped buffer; must be entry.data_size() bytes):
+	void read_into(Entry const &entry, std::span< char > to) const;
+
+	char const *begin;
+	char const *end;
+	mutable std::mutex copies_mutex;
+	mutable std::vector< std::unique_ptr< char[] > > copies; //storage for misaligned chunks
+};
+
+//helper that collects chunks and writes them -- with a directory -- in the format ChunkReader reads:
+struct ChunkWriter {
+	//alignment of chunk data in the file (a power of two; e.g., 16 for SIMD or 64 for cache lines);
+	// 1 writes an unpadded "dir1" file, anything larger a padded "dir2" file:
+	uint32_t alignment = 16;
+
+	struct Chunk {
+		std::string magic;
+		std::vector< char > data; //(as stored)
+		bool compressed = false;
+	};
+	std::vector< Chunk > chunks; //written in this order
+
+	//add a chunk (compressed, if 'compress' is set -- see ChunkCompressed):
+	template< typename T >
+	void add(std::string const &magic, std::vector< T > const &from, bool compress = false) {
+		static_assert(std::is_trivially_copyable_v< T >, "chunks hold plain data");
+		assert(magic.size() == 4);
+		Chunk &chunk = chunks.emplace_back();
+		chunk.magic = magic;
+		if (compress) {
+			chunk.data = compress_chunk(from.data(), from.size() * sizeof(T));
+			chunk.compressed = true;
+		} else {
+			chunk.data.resize(from.size() * sizeof(T));
+			if (!from.empty()) std::memcpy(chunk.data.data(), from.data(), chunk.data.size());
+		}
+	}
+
+	//write directory and chunks:
+	void write(std::ostream *to) const;
+};
+
+//helper function to write a chunk of data in the same format as read_chunk (compressed, if 'compress' is set):
 template< typename T >
-void write_chunk(std::string const &magic, std::vector< T > const &from, std::ostream *to_) {
+void write_chunk(std::string const &magic, std::vector< T > const &from, std::ostream *to_, bool compress = false) {
 	assert(magic.size() == 4);
 	assert(to_);
 	auto &to = *to_;
@@ -60,6 +248,21 @@ void write_chunk(std::string const &magic, std::vector< T > const &from, std::os
 	header.magic[3] = magic[3];
 	header.size = uint32_t(from.size() * sizeof(T));
 
+	if (compress) {
+		std::vector< char > stored = compress_chunk(from.data(), from.size() * sizeof(T));
+		header.size = ChunkCompressed | uint32_t(stored.size());
+		to.write(reinterpret_cast< const char * >(&header), sizeof(header));
+		to.write(stored.data(), stored.size());
+		return;
+	}
+
 	to.write(reinterpret_cast< const char * >(&header), sizeof(header));
 	to.write(reinterpret_cast< const char * >(from.data()), from.size() * sizeof(T));
 }
+
+//...or add it to a ChunkWriter (which writes a directory-first file):
+template< typename T >
+void write_chunk(std::string const &magic, std::vector< T > const &from, ChunkWriter *to, bool compress = false) {
+	assert(to);
+	to->add(magic, from, compress);
+}
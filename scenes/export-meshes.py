@@ -3,6 +3,7 @@
 #based on 'export-sprites.py' and 'glsprite.py' from TCHOW Rainbow; code used is released into the public domain.
 #Patched for 15-466-f19 to remove non-pnct formats!
 #Patched for 15-466-f20 to merge data all at once (slightly faster)
+#Patched to weld identical vertices and write indexed meshes ("idx1" + "ix16"/"ix32" chunks)
 
 #Note: Script meant to be executed within blender 4.x, as per:
 #blender --background --python export-meshes.py -- [...see below...]
@@ -38,6 +39,7 @@ else:
 print(" of '" + infile + "' to '" + outfile + "'.")
 
 import struct
+import zlib
 
 bpy.ops.wm.open_mainfile(filepath=infile)
 
@@ -94,10 +96,20 @@ data = []
 #strings contains the mesh names:
 strings = b''
 
-#index gives offsets into the data (and names) for each mesh:
+#index gives offsets into the data, indices (and names) for each mesh:
 index = b''
 
+#indices contains, for each mesh, the triangles' vertices (relative to the mesh's first vertex):
+indices = []
+
+#...and the same meshes as un-indexed triangles ("idx0" format), in case welding doesn't save space:
+# (e.g., for flat-shaded meshes, where few corners share a normal)
+soup_data = []
+soup_index = b''
+
 vertex_count = 0
+corner_count = 0
+max_mesh_vertices = 0
 for obj in bpy.data.objects:
 	if obj.data in to_write:
 		to_write.remove(obj.data)
@@ -136,9 +148,11 @@ for obj in bpy.data.objects:
 	name_end = len(strings)
 	index += struct.pack('I', name_begin)
 	index += struct.pack('I', name_end)
+	soup_index += struct.pack('II', name_begin, name_end)
 
 	index += struct.pack('I', vertex_count) #vertex_begin
-	#...count will be written below
+	soup_index += struct.pack('I', corner_count) #vertex_begin
+	#...vertex_end, index_begin, index_end will be written below
 
 	colors = None
 	if len(obj.data.color_attributes) == 0:
@@ -157,6 +171,11 @@ for obj in bpy.data.objects:
 			print("WARNING: object '" + name + "' has multiple texture coordinate layers; only exporting '" + obj.data.uv_layers.active.name + "'")
 
 	local_data = b''
+	local_soup_data = b''
+
+	#welded vertices (packed vertex -> index in this mesh), so corners that share all attributes share a vertex:
+	welded = dict()
+	index_begin = len(indices)
 
 	#write the mesh triangles:
 	for poly in mesh.polygons:
@@ -165,10 +184,11 @@ for obj in bpy.data.objects:
 			assert(mesh.loops[poly.loop_indices[i]].vertex_index == poly.vertices[i])
 			loop = mesh.loops[poly.loop_indices[i]]
 			vertex = mesh.vertices[loop.vertex_index]
+			packed = b''
 			for x in vertex.co:
-				local_data += struct.pack('f', x)
+				packed += struct.pack('f', x)
 			for x in loop.normal:
-				local_data += struct.pack('f', x)
+				packed += struct.pack('f', x)
 
 			col = None
 			if colors != None and colors.domain == 'POINT':
@@ -177,42 +197,91 @@ for obj in bpy.data.objects:
 				col = colors.data[poly.loop_indices[i]].color
 			else:
 				col = (1.0, 1.0, 1.0, 1.0)
-			local_data += struct.pack('BBBB', int(col[0] * 255), int(col[1] * 255), int(col[2] * 255), 255)
+			packed += struct.pack('BBBB', int(col[0] * 255), int(col[1] * 255), int(col[2] * 255), 255)
 
 			if uvs != None:
 				uv = uvs[poly.loop_indices[i]].uv
-				local_data += struct.pack('ff', uv.x, uv.y)
+				packed += struct.pack('ff', uv.x, uv.y)
 			else:
-				local_data += struct.pack('ff', 0, 0)
+				packed += struct.pack('ff', 0, 0)
+
+			if packed not in welded:
+				welded[packed] = len(welded)
+				local_data += packed
+			indices.append(welded[packed])
+			local_soup_data += packed
 		if len(local_data) > 1000:
 			data.append(local_data)
 			local_data = b''
-	vertex_count += len(mesh.polygons) * 3
+		if len(local_soup_data) > 1000:
+			soup_data.append(local_soup_data)
+			local_soup_data = b''
+	vertex_count += len(welded)
+	corner_count += len(mesh.polygons) * 3
+	max_mesh_vertices = max(max_mesh_vertices, len(welded))
 
 	data.append(local_data)
+	soup_data.append(local_soup_data)
 
 	index += struct.pack('I', vertex_count) #vertex_end
+	index += struct.pack('I', index_begin) #index_begin
+	index += struct.pack('I', len(indices)) #index_end
+	soup_index += struct.pack('I', corner_count) #vertex_end
 
 data = b''.join(data)
+soup_data = b''.join(soup_data)
 
 #check that code created as much data as anticipated:
 assert(vertex_count * (4*3+4*3+1*4+4*2) == len(data))
+assert(corner_count * (4*3+4*3+1*4+4*2) == len(soup_data))
+
+#indices are relative to each mesh's first vertex, so 16 bits suffice unless some mesh is very large:
+if max_mesh_vertices <= 0x10000:
+	index_chunk = (b'ix16', struct.pack(str(len(indices)) + 'H', *indices))
+else:
+	index_chunk = (b'ix32', struct.pack(str(len(indices)) + 'I', *indices))
+
+print("Welded " + str(corner_count) + " triangle corners to " + str(vertex_count) + " vertices.")
 
 #write the data chunk and index chunk to an output blob:
 blob = open(outfile, 'wb')
-#first chunk: the data
-blob.write(struct.pack('4s',b'pnct')) #type
-blob.write(struct.pack('I', len(data))) #length
-blob.write(data)
-#second chunk: the strings
-blob.write(struct.pack('4s',b'str0')) #type
-blob.write(struct.pack('I', len(strings))) #length
-blob.write(strings)
-#third chunk: the index
-blob.write(struct.pack('4s',b'idx0')) #type
-blob.write(struct.pack('I', len(index))) #length
-blob.write(index)
+if len(data) + len(index) + len(index_chunk[1]) < len(soup_data) + len(soup_index):
+	chunks = [
+		(b'pnct', data), #first chunk: the data
+		(b'str0', strings), #second chunk: the strings
+		(b'idx1', index), #third chunk: the index
+		index_chunk, #fourth chunk: the indices
+	]
+else:
+	print("(welding doesn't save space, so writing un-indexed triangles)")
+	index_chunk = (b'', b'')
+	data = soup_data
+	index = soup_index
+	chunks = [
+		(b'pnct', data), #first chunk: the data
+		(b'str0', strings), #second chunk: the strings
+		(b'idx0', index), #third chunk: the index
+	]
+#directory of { magic, offset, size, crc32 } so readers can find chunks directly (see read_write_chunk.hpp),
+# with chunk data padded to 16-byte boundaries so it can be used in place:
+alignment = 16
+directory = struct.pack('IIII', alignment, 0, 0, 0)
+offset = 8 + len(directory) + 16 * len(chunks)
+padding = []
+for (magic, chunk) in chunks:
+	data_offset = (offset + 8 + alignment - 1) // alignment * alignment
+	padding.append(data_offset - 8 - offset)
+	directory += struct.pack('4sIII', magic, data_offset, len(chunk), zlib.crc32(chunk))
+	offset = data_offset + len(chunk)
+blob.write(struct.pack('4s',b'dir2')) #type
+blob.write(struct.pack('I', len(directory))) #length
+blob.write(directory)
+for ((magic, chunk), pad) in zip(chunks, padding):
+	blob.write(b'\0' * pad)
+	blob.write(struct.pack('4s',magic)) #type
+	blob.write(struct.pack('I', len(chunk))) #length
+	blob.write(chunk)
 wrote = blob.tell()
 blob.close()
 
-print("Wrote " + str(wrote) + " bytes [== " + str(len(data)+8) + " bytes of data + " + str(len(strings)+8) + " bytes of strings + " + str(len(index)+8) + " bytes of index] to '" + outfile + "'")
+print("Wrote " + str(wrote) + " bytes [== " + str(len(directory)+8) + " bytes of directory + " + str(len(data)+8) + " bytes of data + " + str(len(strings)+8) + " bytes of strings + " + str(len(index)+8) + " bytes of index + " + str(len(index_chunk[1])+8 if index_chunk[0] else 0) + " bytes of indices + " + str(sum(padding)) + " bytes of padding] to '" + outfile + "'")
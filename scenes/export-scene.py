@@ -37,6 +37,7 @@ import bpy
 import mathutils
 import struct
 import math
+import zlib
 
 #---------------------------------------------------------------------
 #Export scene:
@@ -52,6 +53,8 @@ else:
 	collection = bpy.context.scene.collection
 
 #Scene file format:
+# dir2 len < alignment 0 0 0 > < magic offset size crc32 > * [chunk directory; see read_write_chunk.hpp]
+# (each chunk below is padded so its data starts on an alignment boundary)
 # str0 len < char > * [strings chunk]
 # xfh0 len < ... > * [transform hierarchy]
 # msh0 len < uint uint uint > [hierarchy point + mesh name]
@@ -215,10 +218,9 @@ write_objects(collection)
 
 #write the strings chunk and scene chunk to an output blob:
 blob = open(outfile, 'wb')
+chunks = []
 def write_chunk(magic, data):
-	blob.write(struct.pack('4s',magic)) #type
-	blob.write(struct.pack('I', len(data))) #length
-	blob.write(data)
+	chunks.append((magic, data))
 
 write_chunk(b'str0', strings_data)
 write_chunk(b'xfh0', xfh_data)
@@ -226,5 +228,26 @@ write_chunk(b'msh0', mesh_data)
 write_chunk(b'cam0', camera_data)
 write_chunk(b'lmp0', lamp_data)
 
+#directory of { magic, offset, size, crc32 } so readers can find chunks directly,
+# with chunk data padded to 16-byte boundaries so it can be used in place:
+alignment = 16
+directory = struct.pack('IIII', alignment, 0, 0, 0)
+offset = 8 + len(directory) + 16 * len(chunks)
+padding = []
+for (magic, data) in chunks:
+	data_offset = (offset + 8 + alignment - 1) // alignment * alignment
+	padding.append(data_offset - 8 - offset)
+	directory += struct.pack('4sIII', magic, data_offset, len(data), zlib.crc32(data))
+	offset = data_offset + len(data)
+blob.write(struct.pack('4s',b'dir2')) #type
+blob.write(struct.pack('I', len(directory))) #length
+blob.write(directory)
+
+for ((magic, data), pad) in zip(chunks, padding):
+	blob.write(b'\0' * pad)
+	blob.write(struct.pack('4s',magic)) #type
+	blob.write(struct.pack('I', len(data))) #length
+	blob.write(data)
+
 print("Wrote " + str(blob.tell()) + " bytes to '" + outfile + "'")
 blob.close()
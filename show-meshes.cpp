@@ -2,6 +2,7 @@
 #include "ShowMeshesMode.hpp"
 #include "Load.hpp"
 #include "GL.hpp"
+#include "gl_upload_buffer.hpp"
 #include "load_save_png.hpp"
 
 #include <SDL3/SDL.h>
@@ -11,6 +12,7 @@
 #include <iostream>
 #include <stdexcept>
 #include <memory>
+#include <string>
 #include <algorithm>
 
 int main(int argc, char **argv) {
@@ -84,9 +86,20 @@ int main(int argc, char **argv) {
 	//------------ create game mode + make current --------------
 	bool usage = false;
 	MeshBuffer *buffer = nullptr;
-	if (argc == 2) {
+	//'--optimize' reorders the meshes for the vertex cache (etc) as they load, and prints statistics:
+	//'--quantize' stores vertices in the compact format (after optimizing, if both are given), and prints errors:
+	bool optimize = false, quantize = false;
+	for (int i = 1; i + 1 < argc; ++i) {
+		if (std::string(argv[i]) == "--optimize") optimize = true;
+		else if (std::string(argv[i]) == "--quantize") quantize = true;
+		else usage = true;
+	}
+	if (argc >= 2 && !usage) {
 		try {
-			buffer = new MeshBuffer(argv[1]);
+			MeshBuffer::Staging staging = MeshBuffer::prepare(argv[argc-1]);
+			if (optimize) MeshBuffer::optimize(&staging, &std::cout);
+			if (quantize) MeshBuffer::quantize(&staging, &std::cout);
+			buffer = new MeshBuffer(staging);
 		} catch (std::exception &e) {
 			std::cerr << "ERROR: " << e.what() << std::endl;
 			usage = true;
@@ -100,7 +113,7 @@ int main(int argc, char **argv) {
 		usage = true;
 	}
 	if (usage) {
-		std::cerr << "Usage:\n\t" << argv[0] << " [path/to/meshes.pnct]" << std::endl;
+		std::cerr << "Usage:\n\t" << argv[0] << " [--optimize] [--quantize] [path/to/meshes.pnct]" << std::endl;
 		return 1;
 	}
 
@@ -183,6 +196,8 @@ int main(int argc, char **argv) {
 
 
 	//------------  teardown ------------
+	gl_upload_buffer_release(); //(staging buffers used by MeshBuffer uploads)
+
 	SDL_GL_DestroyContext(context);
 	context = 0;
 
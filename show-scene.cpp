@@ -2,6 +2,7 @@
 #include "ShowSceneMode.hpp"
 #include "Load.hpp"
 #include "GL.hpp"
+#include "gl_upload_buffer.hpp"
 #include "load_save_png.hpp"
 #include "ShowSceneProgram.hpp"
 
@@ -123,6 +124,14 @@ int main(int argc, char **argv) {
 				drawable.pipeline.type = mesh.type;
 				drawable.pipeline.start = mesh.start;
 				drawable.pipeline.count = mesh.count;
+				drawable.pipeline.index_type = mesh.index_type;
+				drawable.pipeline.base_vertex = mesh.base_vertex;
+				drawable.pipeline.vertex_count = mesh.vertex_count;
+				drawable.pipeline.position_scale = mesh.position_scale;
+				drawable.pipeline.position_offset = mesh.position_offset;
+
+				drawable.min = mesh.min;
+				drawable.max = mesh.max;
 
 			});
 		} catch (std::exception &e) {
@@ -225,6 +234,12 @@ int main(int argc, char **argv) {
 
 
 	//------------  teardown ------------
+	gl_upload_buffer_release(); //(staging buffers used by MeshBuffer uploads)
+
+	//(the scene's OpenGL objects go before the context does)
+	delete scene;
+	scene = nullptr;
+
 	SDL_GL_DestroyContext(context);
 	context = 0;
 